@@ -0,0 +1,65 @@
+#ifndef AMIGABADBLOCK_H_INCLUDED
+#define AMIGABADBLOCK_H_INCLUDED
+
+#include <vector>
+#include "amigatypes.h"
+
+namespace amigadrive
+{
+	/*!
+	*	The bad block remappings of a drive, from the BADB chain of its RDB. Entries
+	*	are kept sorted by bad block, with neighbouring remappings which are contiguous
+	*	on both sides merged, so a lookup is a binary search of a short table and a
+	*	range only splits where the remapping actually changes.
+	*/
+	class BadBlockMap
+	{
+		public:
+			/*!
+			*	Adds a remapping of count device blocks from bad onwards to good onwards.
+			*	A block which is already remapped keeps its first remapping.
+			*/
+			void add(u64 bad, u64 good, u64 count);
+
+			/*!
+			*	Sorts and merges the table. Call it after the last add and before any lookups.
+			*/
+			void seal(void);
+
+			/*!
+			*	Returns the number of device blocks remapped.
+			*/
+			u64 blockCount(void);
+
+			/*!
+			*	Returns the number of entries in the table once sealed.
+			*/
+			u64 entryCount(void);
+
+			/*!
+			*	Returns the block to be used in place of the given one.
+			*/
+			u64 lookup(u64 block);
+
+			/*!
+			*	Returns how many of the count blocks from block on go to consecutive blocks
+			*	of the medium, setting target to the first of them. Splitting a range with
+			*	this gives the fewest pieces the remapping allows.
+			*/
+			u64 piece(u64 block, u64 count, u64 &target);
+
+		private:
+			struct Entry
+			{
+				u64 bad;
+				u64 good;
+				u64 count;
+			};
+
+			std::vector<Entry> m_entries;
+
+			size_t find(u64 block);
+	};
+}
+
+#endif // AMIGABADBLOCK_H_INCLUDED
@@ -0,0 +1,112 @@
+#ifndef AMIGABLOCK_H_INCLUDED
+#define AMIGABLOCK_H_INCLUDED
+
+#include <string.h>
+#include "amigatypes.h"
+
+namespace amigadrive
+{
+	/*!
+	*	Loads a big-endian longword. Compilers turn this into a single load and byte
+	*	swap, which makes it much cheaper than fe32 in inner loops.
+	*/
+	inline u32 be32(const void *p)
+	{
+		const u8 *b = (const u8 *)p;
+
+		return ((u32)b[0] << 24) | ((u32)b[1] << 16) | ((u32)b[2] << 8) | (u32)b[3];
+	}
+
+	/*!
+	*	Loads a big-endian word.
+	*/
+	inline u32 be16(const void *p)
+	{
+		const u8 *b = (const u8 *)p;
+
+		return ((u32)b[0] << 8) | (u32)b[1];
+	}
+
+	/*!
+	*	Stores a big-endian longword.
+	*/
+	inline void putBE32(void *p, u32 v)
+	{
+		u8 *b = (u8 *)p;
+
+		b[0] = v >> 24;
+		b[1] = v >> 16;
+		b[2] = v >> 8;
+		b[3] = v;
+	}
+
+	/*!
+	*	Sums every big-endian longword of a block of BYTES bytes. AmigaDOS file system
+	*	blocks are valid when this comes to zero. The bytes argument is unused, and is
+	*	only there so the specialisations share a signature with the generic kernel.
+	*/
+	template<u32 BYTES> u32 sumBlockKernel(const void *block, u32 bytes)
+	{
+		const u8 *p = (const u8 *)block;
+		u32 sum = 0;
+		u32 i;
+
+		for (i = 0; i < BYTES; i += 4)
+			sum += be32(p + i);
+		return sum;
+	}
+
+	/*!
+	*	True if a block of BYTES bytes is all zeroes.
+	*/
+	template<u32 BYTES> bool zeroBlockKernel(const void *block, u32 bytes)
+	{
+		const u64 *p = (const u64 *)block;
+		u64 acc = 0;
+		u32 i;
+
+		for (i = 0; i < BYTES / sizeof(u64); i++)
+			acc |= p[i];
+		return acc == 0;
+	}
+
+	/*!
+	*	Copies a block of BYTES bytes.
+	*/
+	template<u32 BYTES> void copyBlockKernel(void *to, const void *from, u32 bytes)
+	{
+		memcpy(to, from, BYTES);
+	}
+
+	/*!
+	*	The per block size kernels. Devices and volumes look theirs up once, when their
+	*	block size is known, so the per-block work has no size tests in it.
+	*/
+	struct BlockKernels
+	{
+		u32 bytes;
+		u32 (*sum)(const void *block, u32 bytes);
+		bool (*isZero)(const void *block, u32 bytes);
+		void (*copy)(void *to, const void *from, u32 bytes);
+	};
+
+	/*!
+	*	The largest block size any Amiga structure or file system block may have here.
+	*/
+	#define MAX_BLOCKBYTES 32768
+
+	/*!
+	*	Returns true for the block sizes we can work with: powers of two from 512 bytes
+	*	to MAX_BLOCKBYTES.
+	*/
+	bool validBlockBytes(u32 bytes);
+
+	/*!
+	*	Returns the kernels for the given block size. 512, 1024, 2048 and 4096 byte blocks
+	*	get kernels specialised for their size; other valid sizes share a generic set
+	*	which loops over the size at run time. Returns the 512 byte kernels for invalid sizes.
+	*/
+	const BlockKernels *blockKernels(u32 bytes);
+}
+
+#endif // AMIGABLOCK_H_INCLUDED
@@ -0,0 +1,91 @@
+#ifndef AMIGABSD_H_INCLUDED
+#define AMIGABSD_H_INCLUDED
+
+#include <vector>
+#include "amigadrive.h"
+
+// NetBSD/amiga partition dos types - NBR\7 root, NBS\1 swap, NBU\7 anything else - whose last byte is the BSD file system type
+#define NETBSD_DOST_MASK 0xFFFFFF00
+#define NETBSD_DOST_ROOT 0x4E425200
+#define NETBSD_DOST_SWAP 0x4E425300
+#define NETBSD_DOST_USER 0x4E425500
+// the older BSDR, BSDS and BSDU dos types
+#define NETBSD_DOST_OLD 0x42534400
+
+// both magic numbers of a BSD disklabel
+#define BSD_DISKMAGIC 0x82564557
+// the sectors at the start of a volume searched for one
+#define BSD_LABEL_SECTORS 16
+// the most slices a label may hold, as many as fit a sector
+#define BSD_MAXSLICES 22
+
+// BSD file system types
+#define BSD_FS_UNUSED 0
+#define BSD_FS_SWAP 1
+#define BSD_FS_BSDFFS 7
+
+namespace amigadrive
+{
+	/*!
+	*	A slice of a volume, as a BSD disklabel gives it. Start and count are in 512
+	*	byte device blocks, with start counted from the start of the volume.
+	*/
+	struct BSDSlice
+	{
+		char letter;
+		u8 fsType;
+		u64 start;
+		u64 count;
+	};
+
+	/*!
+	*	The BSD slices of a volume. A disklabel is looked for in the first
+	*	BSD_LABEL_SECTORS sectors of the volume, in either byte order, so labels
+	*	written by big and little endian ports are both found. A NetBSD/amiga
+	*	partition without one is a single slice, as NetBSD itself sees it, lettered
+	*	a for root, b for swap and d for the rest.
+	*/
+	class DiskLabel
+	{
+		public:
+			DiskLabel(Volume *volume, UI *messenger);
+
+			/*!
+			*	Returns true for the dos types NetBSD/amiga gives its partitions.
+			*/
+			static bool isNetBSD(u32 dosType);
+
+			/*!
+			*	Returns the name NetBSD gives a file system type, e.g. 4.2BSD.
+			*/
+			static const char *fsTypeName(u8 fsType);
+
+			/*!
+			*	Looks for the volume's slices. Returns false if it has none.
+			*/
+			bool read(void);
+
+			/*!
+			*	Returns true if the slices came from a disklabel on the volume, rather
+			*	than from its dos type.
+			*/
+			bool hasLabel(void);
+
+			const std::vector<BSDSlice> &slices(void);
+
+			/*!
+			*	Returns the slice with the given letter, or null.
+			*/
+			const BSDSlice *slice(char letter);
+
+		private:
+			Volume *m_volume;
+			UI *m_messenger;
+			bool m_label;
+			std::vector<BSDSlice> m_slices;
+
+			bool parse(const u8 *label, u32 room, bool bigEndian);
+	};
+}
+
+#endif // AMIGABSD_H_INCLUDED
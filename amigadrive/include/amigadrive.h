@@ -1,11 +1,16 @@
 #ifndef AMIGADRIVE_H_INCLUDED
 #define AMIGADRIVE_H_INCLUDED
 
+#include <stdio.h>
+#include <chrono>
+#include <vector>
 #include "amigaui.h"
 #include "exception.h"
 #include "amigatypes.h"
 #include "amigastruct.h"
 #include "amigautils.h"
+#include "amigastats.h"
+#include "amigablock.h"
 
 /*! \mainpage AmigaDrive - a library for working with Amiga devices and device images.
  *
@@ -35,10 +40,35 @@ namespace amigadrive
 {
 	typedef enum {DD_DISKETTE, HD_DISKETTE, HARD_DRIVE} DriveType;
 	typedef enum {DRV_32, DRV_64} DriveArch;
+	typedef enum {BOOT_NDOS, BOOT_DOS, BOOT_BOOTABLE, BOOT_KICKSTART} BootClass;
 
 	class Device;
 	class Volume;
 	class DeviceIO;
+	class Scanner;
+	class CopyTimer;
+	class FloppyIO;
+	class CopyJournal;
+	class BadBlockMap;
+	class RDBBlocks;
+
+	/*!
+	*	Sums the first summedLongs longwords of an RDB structure occupying a block of
+	*	blockBytes bytes. Returns 0 if the checksum is valid, non-zero otherwise.
+	*/
+	int sumBlock(struct blockHeader *header, u32 blockBytes = BLOCKSIZE);
+
+	/*!
+	*	Fills in the chkSum field of an RDB structure so that its first summedLongs
+	*	longwords sum to zero, which is what sumBlock checks.
+	*/
+	void setChecksum(struct blockHeader *header);
+
+	/*!
+	*	Writes a dos type as AmigaDOS shows it, e.g. DOS\3, into a buffer of at least
+	*	6 bytes.
+	*/
+	void dosTypeString(char *out, u32 dosType);
 
 	/*!
 	* 	A Volume class models an Amiga partition. The Device class keeps a list of Volumes, one per Amiga partition.
@@ -55,10 +85,29 @@ namespace amigadrive
 			Volume *m_prevVol;
 			stringStore *m_strings;
 			struct partitionBlock *m_partBlock;
+			bool m_ownPart;
+			u32 m_sectorBytes;
+			u32 m_blockBytes;
+			const BlockKernels *m_kernels;
+			u64 m_startBlock;
+			u64 m_blockCount;
+			IOStats m_stats;
 			// struct amigaPartGeometry *m_partGeom;
 
+			void setGeometry(u32 rdbBlockBytes);
+
 		public:
-			Volume(DeviceIO *io, UI *messenger, bool ro, struct rigidDiskBlock *rdb, u32 block);
+			/*!
+			*	Makes a volume for a PART block of the RDB, which has to outlive it.
+			*/
+			Volume(DeviceIO *io, UI *messenger, bool ro, struct partitionBlock *part, u32 rdbBlockBytes);
+
+			/*!
+			*	Makes a volume for a device without a partition table, from the geometry
+			*	the device's type implies. It looks just like one found in an RDB.
+			*/
+			Volume(DeviceIO *io, UI *messenger, bool ro, const char *name, u32 dosType, u32 heads, u32 sectors, u32 lowCyl, u32 highCyl,
+				u32 sectorBytes = BLOCKSIZE);
 			~Volume();
 
 			/*!
@@ -67,24 +116,78 @@ namespace amigadrive
 			const char *volName(void);
 
 			/*!
-			*	Return the start block of the volume or -1 on error.
+			*	Return the start block of the volume or -1 on error. Like every block number
+			*	the Device deals in, this counts 512 byte device blocks, whatever the volume's
+			*	own block size.
 			*/
 			s64 volStartBlock(void);
 
 			/*!
-			*	Return the volume's block count or -1 on error.
+			*	Return the volume's block count, in 512 byte device blocks, or -1 on error.
+			*	This covers every cylinder from lowCyl to highCyl inclusive.
 			*/
 			s64 volBlockCount(void);
 
 			/*!
-			*	Return the number of bytes per block.
+			*	Return the number of bytes per block of the volume's file system: sectorPerBlock
+			*	of the volume's sectors.
 			*/
 			s64 volBytesPerBlock(void);
 
+			/*!
+			*	Return the size of the sectors the partition's geometry counts. This is
+			*	the partition's sizeBlocks, falling back on the RDB's block size.
+			*/
+			u32 volSectorBytes(void);
+
+			/*!
+			*	Returns the checksum, zero-detect and copy kernels for the volume's block size.
+			*/
+			const BlockKernels *volKernels(void);
+
+			/*!
+			*	Reads count of the volume's own blocks, numbered from the start of the
+			*	partition, into a buffer of at least count * volBytesPerBlock() bytes.
+			*/
+			bool volRead(void *buffer, u64 block, u64 count = 1);
+
+			/*!
+			*	Reads count 512 byte device blocks, numbered from the start of the partition.
+			*	File systems which pick their own block size read with this.
+			*/
+			bool volReadDevice(void *buffer, u64 block, u64 count);
+
+			/*!
+			*	Writes count of the volume's own blocks, numbered from the start of the partition.
+			*/
+			bool volWrite(void *buffer, u64 block, u64 count = 1);
+
 			/*!
 			*	Return the volume type
 			*/
 			char *volType(void);
+
+			/*!
+			*	Return the boot priority of the volume.
+			*/
+			s32 volBootPriority(void);
+
+			/*!
+			*	Returns the dos type the partition table gives the volume.
+			*/
+			u32 volDosType(void);
+
+			/*!
+			*	Returns the number of blocks reserved at the start of the volume, which
+			*	the file system doesn't use - the boot blocks.
+			*/
+			u32 volReserved(void);
+
+			/*!
+			*	Returns the I/O statistics for this volume. These are only collected
+			*	once Device::enableStats has been called.
+			*/
+			IOStats *volStats(void);
 	};
 
 	/*!
@@ -95,19 +198,31 @@ namespace amigadrive
 	{
 		friend class Device;
 		friend class Volume;
+		friend class FloppyIO;
+		friend class RDBBlocks;
 		protected:
 			DriveArch m_drvArch;
 			u64 m_sectorCount;
+			u32 m_sectorBytes;
+			u32 m_physSectorBytes;
 			UI *m_messenger;
+			IOStats *m_stats;
+			// set by drivers which can only be read forwards, such as pipes; m_sectorCount
+			// is then only an upper bound
+			bool m_sequential;
+			// the drive's bad block remappings, applied by the io wrappers; null on clean drives
+			BadBlockMap *m_remap;
 
 		public:
-			DeviceIO() {;};
+			DeviceIO() : m_drvArch(DRV_32), m_sectorCount(0), m_sectorBytes(BLOCKSIZE), m_physSectorBytes(BLOCKSIZE),
+				m_messenger(nullptr), m_stats(nullptr), m_sequential(false), m_remap(nullptr) {;};
 			virtual ~DeviceIO() {;};
 
 		protected:
 			/*!
 			*	Initialises the IO driver with a user interface object, the name of the fire/device and whether
-			*	it should be opened read-only.
+			*	it should be opened read-only. Drivers set m_sectorCount (in 512 byte blocks), m_drvArch and,
+			*	where the medium has them, m_sectorBytes and m_physSectorBytes.
 			*/
 			virtual void initDriver(UI *messenger, const char *devName, bool readOnly) = 0;
 
@@ -126,6 +241,111 @@ namespace amigadrive
 			* \param blockNumber - zero-based Block number to be written.
 			*/
 			virtual bool writeBlock(Block *writeBuffer, u64 blockNumber) = 0;
+
+			/*!
+			* Reads count consecutive 512 byte sectors into the buffer. Returns true only if every
+			* sector was read. The default implementation calls readBlock once per sector; drivers
+			* that can satisfy a range with a single request should override it.
+			*
+			* \param readBuffer - A pointer to an array of at least count blocks.
+			* \param blockNumber - zero-based number of the first block to be read.
+			* \param count - the number of blocks to read.
+			*/
+			virtual bool readBlocks(Block *readBuffer, u64 blockNumber, u64 count);
+
+			/*!
+			* Writes count consecutive 512 byte sectors from the buffer. Returns true only if every
+			* sector was written. The default implementation calls writeBlock once per sector.
+			*
+			* \param writeBuffer - A pointer to an array of at least count blocks.
+			* \param blockNumber - zero-based number of the first block to be written.
+			* \param count - the number of blocks to write.
+			*/
+			virtual bool writeBlocks(Block *writeBuffer, u64 blockNumber, u64 count);
+
+			/*!
+			* Hints that the given range is about to be transferred in order. Used by bulk copies.
+			* The default does nothing.
+			*/
+			virtual void adviseSequential(u64 blockNumber, u64 count) {;};
+
+			/*!
+			* Hints that a bulk copy is done with the given range, so it needn't be cached.
+			* The default does nothing.
+			*
+			* \param written - true if the range was written rather than read.
+			*/
+			virtual void adviseDone(u64 blockNumber, u64 count, bool written) {;};
+
+			/*!
+			* Copies count sectors from blockNumber on into a file at the given byte offset
+			* inside the kernel, without them passing through a buffer of ours. Holes in the
+			* medium are skipped, so they stay holes. Returns the number of sectors copied,
+			* which is short only on error, or -1 if the driver, the kernel or the two file
+			* systems can't copy this way; nothing has been written then. The default
+			* always returns -1.
+			*/
+			virtual s64 copyToFile(int fd, u64 fileOffset, u64 blockNumber, u64 count) { return -1; };
+
+			/*!
+			*	Device and Volume go through these rather than calling the driver directly.
+			*	With no statistics and no bad blocks they cost a test of m_remap and one of
+			*	m_stats; otherwise each call is remapped, timed and recorded.
+			*/
+			bool ioRead(Block *readBuffer, u64 blockNumber)
+			{
+				if (m_remap)
+					return remappedIO(IOStats::READ, readBuffer, blockNumber, 1);
+				if (!m_stats)
+					return readBlock(readBuffer, blockNumber);
+				return timedIO(IOStats::READ, readBuffer, blockNumber, 1);
+			}
+
+			bool ioReadBlocks(Block *readBuffer, u64 blockNumber, u64 count)
+			{
+				if (m_remap)
+					return remappedIO(IOStats::READ, readBuffer, blockNumber, count);
+				if (!m_stats)
+					return readBlocks(readBuffer, blockNumber, count);
+				return timedIO(IOStats::READ, readBuffer, blockNumber, count);
+			}
+
+			bool ioWrite(Block *writeBuffer, u64 blockNumber)
+			{
+				if (m_remap)
+					return remappedIO(IOStats::WRITE, writeBuffer, blockNumber, 1);
+				if (!m_stats)
+					return writeBlock(writeBuffer, blockNumber);
+				return timedIO(IOStats::WRITE, writeBuffer, blockNumber, 1);
+			}
+
+			bool ioWriteBlocks(Block *writeBuffer, u64 blockNumber, u64 count)
+			{
+				if (m_remap)
+					return remappedIO(IOStats::WRITE, writeBuffer, blockNumber, count);
+				if (!m_stats)
+					return writeBlocks(writeBuffer, blockNumber, count);
+				return timedIO(IOStats::WRITE, writeBuffer, blockNumber, count);
+			}
+
+			/*!
+			*	Reads one block of an RDB structure. RDB block numbers count blocks of
+			*	the RDB's own size, which may be larger than a device block.
+			*/
+			bool ioReadStruct(Block *readBuffer, u64 block, u32 blockBytes)
+			{
+				return ioReadBlocks(readBuffer, block * (blockBytes / BLOCKSIZE), blockBytes / BLOCKSIZE);
+			}
+
+			/*!
+			*	Copies into a file as copyToFile does. Drives with bad blocks remapped
+			*	can't, as the copy would miss the remapping.
+			*/
+			s64 ioCopyToFile(int fd, u64 fileOffset, u64 blockNumber, u64 count);
+
+		private:
+			bool timedIO(IOStats::Direction dir, Block *buffer, u64 blockNumber, u64 count);
+			bool remappedIO(IOStats::Direction dir, Block *buffer, u64 blockNumber, u64 count);
 	};
 
 	/*!
@@ -139,6 +359,8 @@ namespace amigadrive
 	*/
 	class Device
 	{
+		friend class Scanner;
+		friend class CopyTimer;
 		public:
 		/*!
 		*   Opens given device/file and read its configuration.
@@ -151,17 +373,70 @@ namespace amigadrive
 			*/
 			u64 blockCount(void);
 
+			/*!
+			* Returns the logical sector size of the underlying medium in bytes - the smallest unit
+			* it can transfer. 512 for dump files.
+			*/
+			u32 sectorBytes(void);
+
+			/*!
+			* Returns the physical sector size of the underlying medium in bytes - the unit it
+			* writes without a read-modify-write cycle.
+			*/
+			u32 physicalSectorBytes(void);
+
+			/*!
+			* Returns DD_DISKETTE or HD_DISKETTE for ADF images, HARD_DRIVE otherwise.
+			*/
+			DriveType driveType(void);
+
+			/*!
+			* Classifies the diskette boot block in the first two blocks of the device.
+			*/
+			BootClass bootBlockClass(void);
+
+			/*!
+			* Returns true for an image of a single file system without a partition table,
+			* such as an emulator's partition hardfile. It has one volume covering the device.
+			*/
+			bool isBareVolume(void);
+
+			/*!
+			* Returns the size of the blocks the RDB structures are stored in - the RDB's
+			* blockBytes, or 512 for devices without one.
+			*/
+			u32 blockBytes(void);
+
 			/*!
 			* Returns the given 512 byte block in the supplied buffer.
 			* Returns true on a successfull read, otherwise it returns false.
 			*/
 			bool readBlock(Block readBuffer, u64 blockNumber);
 
+			/*!
+			* Reads count 512 byte blocks from blockNumber on into the buffer. Dump files
+			* may be read this way from several threads at once.
+			*/
+			bool readBlocks(Block *readBuffer, u64 blockNumber, u64 count);
+
 			/*!
 			* Writes the given 512 byte sector to the device. Returns true on a successful write.
 			*/
 			bool writeBlock(Block writeBuffer, u64 blockNumber);
 
+			/*!
+			* Writes count 512 byte blocks from the buffer to the device from blockNumber on.
+			* Returns false if the device was opened read-only.
+			*/
+			bool writeBlocks(Block *writeBuffer, u64 blockNumber, u64 count);
+
+			/*!
+			*	Replaces the volumes read from the RDB with one for each of the given
+			*	PART blocks, which are copied, and whose geometry counts from the start
+			*	of the device - as a partition table which was recovered gives them.
+			*/
+			void usePartitions(const std::vector<struct partitionBlock> &parts);
+
 			/*!
 			*	Returns the number of volumes.
 			*/
@@ -209,15 +484,86 @@ namespace amigadrive
 			*/
 			bool partCopyIn(const char *outFile, int partition);
 
+			/*!
+			*	Copies every partition out to a file of its own in the named directory,
+			*	which is created if need be. The files are named after the partition
+			*	number and drive name, e.g. 1-DH0.hdf. The device is read once, in order,
+			*	while the partition files are written concurrently.
+			*/
+			bool exportAllPartitions(const char *dir);
+
+			/*!
+			*	Returns the number of file system drivers stored in the RDB.
+			*/
+			int fileSystemCount(void);
+
+			/*!
+			*	Returns the FSHD block of a stored file system driver, numbered from 1,
+			*	or null if there's no such driver.
+			*/
+			const struct fileSysHeaderBlock *fileSystemHeader(int fileSystem);
+
+			/*!
+			*	Reads the code of a stored file system driver from its LSEG chain. It's
+			*	a hunk format executable, as the handler would be on disk. Returns false
+			*	if the chain is broken.
+			*/
+			bool fileSystemCode(int fileSystem, std::vector<u8> &code);
+
+			/*!
+			*	Writes every stored file system driver to a file of its own in the named
+			*	directory, which is created if need be. The files are named after the
+			*	driver's number, dos type and version, e.g. 1-DOS3-45.13.bin.
+			*/
+			bool extractFileSystems(const char *dir);
+
+			/*!
+			*	Journals the block and partition copies which follow in the named file, so
+			*	an interrupted copy can be resumed by running it again with the same journal.
+			*	The journal is deleted when the copy completes. Null turns journalling off.
+			*/
+			void setJournal(const char *journalFile);
+
+			/*!
+			*	Makes the block and partition copies read back everything they write and
+			*	compare it with what was read, reporting the ranges of blocks which differ.
+			*	Reading back overlaps the copy, so it costs little more than the reads.
+			*/
+			void setVerify(bool verify);
+
 			/*!
 			*  Displays what we know about this disk or disk image.
 			*/
 			void About(void);
 
+			/*!
+			*	Starts collecting I/O statistics for the device, for each of its volumes, and
+			*	for the files the copy operations read and write.
+			*/
+			void enableStats(void);
+
+			/*!
+			*	Returns the statistics for all I/O on the device.
+			*/
+			IOStats *ioStats(void);
+
+			/*!
+			*	Returns the statistics for the input and output files of the copy operations.
+			*/
+			IOStats *fileStats(void);
+
+			/*!
+			*	Writes the device, volume and file statistics through the messenger, along with
+			*	how much of the time spent copying was outside of either.
+			*/
+			void dumpStats(void);
+
 		protected:
 
 		private:
 			bool m_ro;
+			// the volumes are a recovered partition table's rather than the RDB's
+			bool m_recovered;
 			DeviceIO *m_io;
 			UI *m_messenger;
 			Volume *m_volPtr;
@@ -227,8 +573,41 @@ namespace amigadrive
 
 			struct rigidDiskBlock *m_rdb;
 			struct bootcodeBlock *m_bootcode;
-
+			FloppyIO *m_floppy;
+			BadBlockMap *m_badBlocks;
+			RDBBlocks *m_rdbBlocks;
+			std::vector<struct fileSysHeaderBlock *> m_fileSystems;
+			u32 m_blockBytes;
+			const BlockKernels *m_kernels;
+
+			Block *m_header;
+			int m_headerBlocks;
+
+			const char *m_journal;
+			bool m_verify;
+
+			bool m_statsEnabled;
+			IOStats m_ioStats;
+			IOStats m_fileStats;
+			u64 m_copyNanos;
+			u64 m_copyIONanos;
+
+			bool fileTransfer(IOStats::Direction dir, FILE *f, Block *buffer, u64 fileBlock, u64 count);
+			bool rangeValid(s64 begin, s64 count);
+			int copyRangeOut(const char *outfile, s64 begin, s64 size);
+			s64 resumeCopy(CopyJournal *J, FILE *file, s64 begin, s64 size, Block *buffer);
+			void finishJournal(CopyJournal *J, bool ok);
+			void progress(s64 done, s64 size);
+			u64 ioNanos(void);
+
+			int readHeader(void);
+			void loadFloppy(void);
+			void makeFloppyVolume(void);
+			bool makeBareVolume(void);
+			void printVolumes(void);
 			struct rigidDiskBlock *getRDB(void);
+			void loadBadBlocks(void);
+			void loadFileSystems(void);
 			struct bootcodeBlock *getBootCode(void);
 			void printPartAmiga(void);
 
@@ -236,5 +615,40 @@ namespace amigadrive
 			bool isReadable(const char *filename);
 			bool isPresent(const char *filename);
 	};
+
+	/*!
+	*	Charges the lifetime of a copy operation to the device's copy time, and the
+	*	device and file I/O done meanwhile to its I/O time, when statistics are on.
+	*	For use by the Device's own copy operations.
+	*/
+	class CopyTimer
+	{
+		private:
+			Device *m_device;
+			std::chrono::steady_clock::time_point m_t0;
+			u64 m_io0;
+
+		public:
+			CopyTimer(Device *device)
+			{
+				m_device = device->m_statsEnabled ? device : nullptr;
+				m_io0 = 0;
+				if (m_device)
+				{
+					m_t0 = std::chrono::steady_clock::now();
+					m_io0 = m_device->ioNanos();
+				}
+			}
+
+			~CopyTimer()
+			{
+				if (m_device)
+				{
+					m_device->m_copyNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_t0).count();
+					m_device->m_copyIONanos += m_device->ioNanos() - m_io0;
+				}
+			}
+	};
+
 };
 #endif // AMIGADRIVE_H_INCLUDED
@@ -7,11 +7,17 @@ namespace amigadrive
 {
 	/*!
 	* 	This class implements basic file io for dealing with Amiga drive dump files.
+	*	It works equally on block devices - hard drives, card readers and loop
+	*	devices - whose size and sector sizes are read from the kernel.
 	*/
 	class ADFIO: public DeviceIO
 	{
 		protected:
-			FILE *m_filePtr;
+			int m_fd;
+			int m_directFd;
+			bool m_direct;
+			u64 m_fileBytes;
+			u32 m_align;
 
 			/*!
 			*	Initialises the driver. This function is called internally.
@@ -32,8 +38,46 @@ namespace amigadrive
 			*/
 			virtual bool readBlock(Block* readBuffer, u64 blockNum);
 
+			/*!
+			* 	Reads count consecutive 512 byte blocks with a single positioned read.
+			*/
+			virtual bool readBlocks(Block* readBuffer, u64 blockNum, u64 count);
+
+			/*!
+			* 	Writes count consecutive 512 byte blocks with a single positioned write.
+			*/
+			virtual bool writeBlocks(Block* writeBuffer, u64 blockNum, u64 count);
+
+			/*!
+			* 	Hints to the kernel that a range is about to be read or written in order.
+			*	Only applies to buffered I/O.
+			*/
+			virtual void adviseSequential(u64 blockNum, u64 count);
+
+			/*!
+			* 	Drops a range that a bulk copy is finished with from the page cache, writing
+			*	it back first if it was written. Only applies to buffered I/O.
+			*/
+			virtual void adviseDone(u64 blockNum, u64 count, bool written);
+
+			/*!
+			* 	Copies a range into a file with copy_file_range, a run of data at a time as
+			*	SEEK_DATA and SEEK_HOLE find them. Only for dump files, not block devices,
+			*	and not with direct IO.
+			*/
+			virtual s64 copyToFile(int fd, u64 fileOffset, u64 blockNum, u64 count);
+
+			void discoverGeometry(void);
+			bool transfer(bool write, u8 *buffer, u64 offset, u64 len);
+			bool directTransfer(bool write, u8 *buffer, u64 offset, u64 len);
+
 		public:
-			ADFIO();
+			/*!
+			*	\param directIO - if true, the dump file is also opened with O_DIRECT and transfers
+			*	bypass the page cache where the file system allows it. Unaligned requests
+			*	are bounced through aligned buffers.
+			*/
+			ADFIO(bool directIO = false);
 			~ADFIO();
 
 	};
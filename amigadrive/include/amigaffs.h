@@ -0,0 +1,143 @@
+#ifndef AMIGAFFS_H_INCLUDED
+#define AMIGAFFS_H_INCLUDED
+
+#include "amigafs.h"
+
+// block types and secondary types of the original and fast file systems
+#define FFS_T_HEADER 2
+#define FFS_T_DATA 8
+#define FFS_T_LIST 16
+#define FFS_T_DIRCACHE 33
+#define FFS_ST_ROOT 1
+#define FFS_ST_USERDIR 2
+#define FFS_ST_SOFTLINK 3
+#define FFS_ST_LINKDIR 4
+#define FFS_ST_FILE -3
+#define FFS_ST_LINKFILE -4
+
+// where the fields of header and extension blocks lie, counting back from the end of the block
+#define FFS_SECTYPE 4
+#define FFS_EXTENSION 8
+#define FFS_PARENT 12
+#define FFS_HASHCHAIN 16
+#define FFS_REAL 44
+#define FFS_NAME 80
+#define FFS_DAYS 92
+#define FFS_COMMENT 184
+#define FFS_BYTESIZE 188
+#define FFS_PROTECT 192
+// the root block's list of bitmap blocks
+#define FFS_BITMAP 196
+// the hash table, and the data block lists of file headers and extension blocks, start at longword 6
+#define FFS_TABLE 24
+
+// the header of an OFS data block: type, header key, sequence number, data size, next data block, checksum
+#define OFS_DATA_HEADER 24
+// OFS data blocks read, checked and gathered in one go
+#define OFS_BATCH 128
+
+namespace amigadrive
+{
+	class FFSFile;
+	class Undelete;
+
+	/*!
+	*	Reads the original (DOS\0) and fast (DOS\1) file systems and their variants:
+	*	international (DOS\2, DOS\3), directory cache (DOS\4, DOS\5) and long file
+	*	name (DOS\6, DOS\7). Every header, directory and extension block is checked for
+	*	its type and checksum before it's used.
+	*/
+	class FFSFileSystem: public FileSystem
+	{
+		friend class FFSFile;
+		friend class Undelete;
+		public:
+			FFSFileSystem(Volume *volume, UI *messenger, u32 dosType);
+
+			/*!
+			*	Returns true for the dos types this reads.
+			*/
+			static bool isFFS(u32 dosType);
+
+			/*!
+			*	Finds and checks the root block. Returns false if it isn't there.
+			*/
+			bool init(void);
+
+			virtual const char *fsName(void);
+			virtual u32 dataOffset(void);
+
+		protected:
+			virtual bool rootInfo(FileInfo &info);
+			virtual bool lookup(const FileInfo &dir, const char *name, FileInfo &info);
+			virtual bool list(const FileInfo &dir, std::vector<FileInfo> &entries);
+			virtual File *openFile(const FileInfo &info);
+
+			/*!
+			*	Decodes the data block list of a file, from its header and extension blocks.
+			*/
+			virtual std::shared_ptr<const ExtentMap> mapFile(const FileInfo &info);
+
+		private:
+			u32 m_dosType;
+			bool m_ofs;
+			bool m_intl;
+			bool m_dirCache;
+			bool m_longNames;
+			u32 m_hashSize;
+			u64 m_blocks;
+			u64 m_root;
+
+			/*!
+			*	Reads a block and checks it's a sound block of the given type.
+			*/
+			bool readChecked(u64 block, u8 *buffer, u32 type);
+
+			/*!
+			*	Fills in info from a header block, following hard links to what they
+			*	link to but keeping the link's name.
+			*/
+			bool headerInfo(u64 block, u8 *buffer, FileInfo &info);
+
+			/*!
+			*	Lists a directory from its directory cache blocks. Returns false, having
+			*	listed nothing, if the cache isn't there or isn't sound.
+			*/
+			bool listCached(const FileInfo &dir, std::vector<FileInfo> &entries);
+
+			/*!
+			*	Returns the name of an entry, as a BCPL string. Long name volumes keep
+			*	it where others keep the comment.
+			*/
+			const u8 *entryName(const u8 *buffer);
+
+			u32 hashName(const char *name);
+			bool sameName(const char *a, const u8 *bcpl);
+			u8 upper(u8 c);
+	};
+
+	/*!
+	*	A file of an FFS or OFS volume. Its data block list is decoded from the header
+	*	and extension blocks when it's opened, unless the file system still has it from
+	*	an earlier open, so a read anywhere in the file costs a search of the map and
+	*	no walk of the extension chain.
+	*/
+	class FFSFile: public MappedFile
+	{
+		public:
+			FFSFile(FFSFileSystem *fs, const FileInfo &info, const std::shared_ptr<const ExtentMap> &map);
+			~FFSFile();
+
+		protected:
+			virtual bool readAt(u8 *buffer, u64 bytes, u64 offset);
+
+		private:
+			FFSFileSystem *m_ffs;
+			// where OFS data blocks are read to, headers and all
+			u8 *m_stage;
+
+			bool readOFS(u8 *buffer, u64 bytes, u64 offset);
+	};
+}
+
+#endif // AMIGAFFS_H_INCLUDED
@@ -0,0 +1,75 @@
+#ifndef AMIGAFLOPPY_H_INCLUDED
+#define AMIGAFLOPPY_H_INCLUDED
+
+#include "amigadrive.h"
+
+// the two sizes of ADF image: 80 cylinders of 2 tracks of 11 or 22 sectors
+#define ADF_DD_BYTES 901120
+#define ADF_HD_BYTES 1802240
+#define ADF_CYLINDERS 80
+#define ADF_HEADS 2
+#define ADF_DD_SECTORS 11
+#define ADF_HD_SECTORS 22
+#define ADF_BOOTBLOCK_BYTES 1024
+
+namespace amigadrive
+{
+	/*!
+	*	Classifies the 1024 byte boot block of a diskette. BOOT_DOS disks carry an
+	*	AmigaDOS file system but won't boot - their boot block checksum is wrong;
+	*	BOOT_BOOTABLE ones will. BOOT_KICKSTART is a Kickstart disk for the A1000,
+	*	and BOOT_NDOS is anything else, usually a game with its own track loader.
+	*/
+	BootClass classifyBootBlock(const u8 *bootBlock);
+
+	/*!
+	*	Returns a short name for a boot block class, as used in scan records.
+	*/
+	const char *bootClassName(BootClass bootClass);
+
+	/*!
+	*	Returns the diskette type for an image of the given size: DD_DISKETTE,
+	*	HD_DISKETTE, or HARD_DRIVE for anything else.
+	*/
+	DriveType floppyType(u64 bytes);
+
+	/*!
+	*	FloppyIO holds a whole diskette image in memory. It's loaded from another
+	*	driver with a single read, after which reads are served from memory; writes
+	*	go through to the other driver as well as updating the copy in memory.
+	*/
+	class FloppyIO: public DeviceIO
+	{
+		public:
+			FloppyIO(DeviceIO *backing);
+			~FloppyIO();
+
+			/*!
+			*	Reads the whole image from the backing driver. Returns false if it
+			*	can't be read, in which case the backing driver should be used as before.
+			*/
+			bool load(void);
+
+			/*!
+			*	Returns the image.
+			*/
+			const u8 *image(void);
+
+			/*!
+			*	Returns the size of the image in bytes.
+			*/
+			u64 imageBytes(void);
+
+		protected:
+			DeviceIO *m_backing;
+			Block *m_image;
+
+			virtual void initDriver(UI *messenger, const char *devName, bool readOnly);
+			virtual bool readBlock(Block *readBuffer, u64 blockNumber);
+			virtual bool writeBlock(Block *writeBuffer, u64 blockNumber);
+			virtual bool readBlocks(Block *readBuffer, u64 blockNumber, u64 count);
+			virtual bool writeBlocks(Block *writeBuffer, u64 blockNumber, u64 count);
+	};
+}
+
+#endif // AMIGAFLOPPY_H_INCLUDED
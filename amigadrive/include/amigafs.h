@@ -0,0 +1,327 @@
+#ifndef AMIGAFS_H_INCLUDED
+#define AMIGAFS_H_INCLUDED
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "amigadrive.h"
+
+// file system blocks of metadata - headers, directories, extension blocks - kept cached
+#define FS_CACHE_BLOCKS 1024
+// bytes a file reads at once when it's read in small pieces
+#define FS_READAHEAD (64 * 1024)
+// files whose decoded block lists are kept, so opening them again costs nothing
+#define FS_MAP_CACHE 256
+// directories deep a walk goes before it takes the tree to be looped
+#define FS_MAX_DEPTH 64
+
+namespace amigadrive
+{
+	/*!
+	*	What a directory entry is. Hard links are followed, so they show up as
+	*	whatever they link to; soft links aren't.
+	*/
+	enum FileType
+	{
+		FT_FILE,
+		FT_DIR,
+		FT_SOFTLINK
+	};
+
+	/*!
+	*	What stat and readDir tell about a file or directory.
+	*/
+	struct FileInfo
+	{
+		// where the file system keeps the entry - for FFS, its header block
+		u64 key;
+		FileType type;
+		u64 size;
+		u32 protect;
+		// the date, as AmigaDOS keeps it: days since 1978, minutes and ticks of 1/50s
+		u32 days;
+		u32 mins;
+		u32 ticks;
+		std::string name;
+		std::string comment;
+	};
+
+	/*!
+	*	Where a file's blocks lie on the volume, as runs of consecutive blocks. Blocks
+	*	are added in file order and each one which follows on from the last just
+	*	lengthens its run, so an unfragmented file is a single entry however long it is,
+	*	and finding any block of a file is a binary search of its runs.
+	*/
+	class ExtentMap
+	{
+		public:
+			struct Extent
+			{
+				u64 index;
+				u64 block;
+				u64 count;
+			};
+
+			/*!
+			*	Appends the volume block holding the file's next block.
+			*/
+			void add(u64 block);
+
+			/*!
+			*	Returns the number of the file's blocks mapped.
+			*/
+			u64 blockCount(void) const;
+
+			/*!
+			*	Returns the number of runs they make.
+			*/
+			u64 extentCount(void) const;
+
+			/*!
+			*	Returns how many of the file's blocks from index on lie one after another
+			*	on the volume, setting block to where the first one is. Returns 0 if index
+			*	is past the end of the map.
+			*/
+			u64 find(u64 index, u64 &block) const;
+
+			/*!
+			*	Returns the runs, in file order.
+			*/
+			const std::vector<Extent> &extents(void) const;
+
+		private:
+			std::vector<Extent> m_extents;
+	};
+
+	/*!
+	*	An open file. Reads may come from several threads at once: pread doesn't
+	*	touch the file position, and read and seek are serialised. Small reads are
+	*	served from a window of FS_READAHEAD bytes, so reading a file a few bytes at a
+	*	time costs one device request per window. The file system it came from has
+	*	to outlive it.
+	*/
+	class File
+	{
+		public:
+			virtual ~File();
+
+			/*!
+			*	Returns what stat would for the file.
+			*/
+			const FileInfo &fileInfo(void);
+
+			/*!
+			*	Reads up to bytes bytes from offset on into the buffer. Returns the
+			*	number read, which is short only at the end of the file, or -1 on error.
+			*/
+			s64 pread(void *buffer, u64 bytes, u64 offset);
+
+			/*!
+			*	Reads from the file position on, and moves it past what was read.
+			*/
+			s64 read(void *buffer, u64 bytes);
+
+			/*!
+			*	Moves the file position as lseek does, with SEEK_SET, SEEK_CUR or SEEK_END.
+			*	Returns the new position, or -1 if it would be negative.
+			*/
+			s64 seek(s64 offset, int whence);
+
+		protected:
+			FileInfo m_info;
+
+			File(const FileInfo &info);
+
+			/*!
+			*	Reads bytes bytes from offset on, all of them within the file.
+			*	Called with m_lock held.
+			*/
+			virtual bool readAt(u8 *buffer, u64 bytes, u64 offset) = 0;
+
+		private:
+			std::mutex m_lock;
+			u64 m_pos;
+			u8 *m_ahead;
+			u64 m_aheadOffset;
+			u64 m_aheadBytes;
+
+			s64 readLocked(void *buffer, u64 bytes, u64 offset);
+	};
+
+	class FileSystem;
+
+	/*!
+	*	A file whose data lies in whole blocks of the volume, as an extent map
+	*	describes. Whole blocks are read straight into the caller's buffer, a run of
+	*	consecutive ones at a time, and only a partial block at either end goes
+	*	through a bounce buffer. The map is shared, and never changed.
+	*/
+	class MappedFile: public File
+	{
+		public:
+			MappedFile(FileSystem *fs, const FileInfo &info, const std::shared_ptr<const ExtentMap> &map);
+
+		protected:
+			FileSystem *m_fs;
+			std::shared_ptr<const ExtentMap> m_map;
+			// bytes of the file each block holds
+			u32 m_payload;
+
+			virtual bool readAt(u8 *buffer, u64 bytes, u64 offset);
+
+			/*!
+			*	Returns true if the map reaches as far as the end of the read,
+			*	reporting a damaged block list otherwise.
+			*/
+			bool mapped(u64 bytes, u64 offset);
+	};
+
+	/*!
+	*	Reads the files of a volume without mounting it. Paths are AmigaDOS style,
+	*	with / between names and an optional volume name and colon in front, and names
+	*	match without regard to case as AmigaDOS does. Any number of threads may use a
+	*	file system and the files opened from it at once: metadata blocks are kept in a
+	*	shared cache of FS_CACHE_BLOCKS blocks, and requests to the device are serialised.
+	*/
+	class FileSystem
+	{
+		friend class MappedFile;
+		public:
+			/*!
+			*	Returns a reader for the file system on the volume, or null if there's
+			*	none that can be read. The volume has to outlive it.
+			*/
+			static FileSystem *mount(Volume *volume, UI *messenger);
+
+			virtual ~FileSystem();
+
+			/*!
+			*	Returns the name of the kind of file system, such as "FFS".
+			*/
+			virtual const char *fsName(void) = 0;
+
+			/*!
+			*	Looks up a path. The empty path and / are the root directory.
+			*/
+			bool stat(const char *path, FileInfo &info);
+
+			/*!
+			*	Lists a directory, in the order the file system keeps it.
+			*/
+			bool readDir(const char *path, std::vector<FileInfo> &entries);
+
+			/*!
+			*	Opens a file for reading. Returns null if the path isn't a file. The
+			*	caller deletes the file when done.
+			*/
+			File *open(const char *path);
+
+			/*!
+			*	Calls visit for every file below the root, with its path and where its
+			*	data lies. A directory is visited once however many links lead to it, and
+			*	directories which can't be read are skipped. Returns false if the root
+			*	can't be read.
+			*/
+			bool walk(const std::function<void(const std::string &path, const FileInfo &info, const ExtentMap &map)> &visit);
+
+			/*!
+			*	Returns the size of the file system's blocks, which extent maps count.
+			*/
+			u32 blockBytes(void);
+
+			/*!
+			*	Returns the bytes at the start of each data block which aren't the file's:
+			*	OFS data block headers. 0 for everything else.
+			*/
+			virtual u32 dataOffset(void);
+
+		protected:
+			Volume *m_volume;
+			UI *m_messenger;
+			u32 m_blockBytes;
+
+			/*!
+			*	\param blockBytes - the size of the file system's blocks, which block
+			*	numbers count. A multiple of 512, and not necessarily the volume's.
+			*/
+			FileSystem(Volume *volume, UI *messenger, u32 blockBytes);
+
+			/*!
+			*	The implementation's half: the root directory, the entry of a directory
+			*	with a given name, all of a directory's entries and opening a file. The
+			*	default lookup lists the directory and compares names as AmigaDOS does,
+			*	without regard to case.
+			*/
+			virtual bool rootInfo(FileInfo &info) = 0;
+			virtual bool lookup(const FileInfo &dir, const char *name, FileInfo &info);
+			virtual bool list(const FileInfo &dir, std::vector<FileInfo> &entries) = 0;
+			virtual File *openFile(const FileInfo &info) = 0;
+
+			/*!
+			*	Decodes where a file's data lies. The map stops short of the whole file
+			*	if what it's decoded from is damaged.
+			*/
+			virtual std::shared_ptr<const ExtentMap> mapFile(const FileInfo &info) = 0;
+
+			/*!
+			*	Reads one of the file system's blocks through the metadata cache into
+			*	a buffer of m_blockBytes.
+			*/
+			bool readMeta(u64 block, u8 *buffer);
+
+			/*!
+			*	Reads count of the file system's blocks straight from the device.
+			*/
+			bool readData(void *buffer, u64 block, u64 count);
+
+			/*!
+			*	Returns the block map cached for the file with the given key, or null.
+			*	Maps are never changed once cached, so they can be shared.
+			*/
+			std::shared_ptr<const ExtentMap> cachedMap(u64 key);
+
+			/*!
+			*	Keeps a file's block map, dropping the least recently used one when
+			*	FS_MAP_CACHE are already kept.
+			*/
+			void cacheMap(u64 key, const std::shared_ptr<const ExtentMap> &map);
+
+			/*!
+			*	Returns a file's map from the cache, decoding and caching it if it
+			*	isn't there.
+			*/
+			std::shared_ptr<const ExtentMap> fileMap(const FileInfo &info);
+
+		private:
+			struct CacheEntry
+			{
+				u8 *data;
+				std::list<u64>::iterator age;
+			};
+
+			struct MapEntry
+			{
+				std::shared_ptr<const ExtentMap> map;
+				std::list<u64>::iterator age;
+			};
+
+			std::mutex m_cacheLock;
+			std::mutex m_ioLock;
+			std::unordered_map<u64, CacheEntry> m_cache;
+			// most recently used first
+			std::list<u64> m_ages;
+			std::unordered_map<u64, MapEntry> m_maps;
+			std::list<u64> m_mapAges;
+
+			bool resolve(const char *path, FileInfo &info);
+			void walkDir(const FileInfo &dir, const std::string &path, int depth, std::unordered_set<u64> &seen,
+				const std::function<void(const std::string &path, const FileInfo &info, const ExtentMap &map)> &visit);
+	};
+}
+
+#endif // AMIGAFS_H_INCLUDED
@@ -0,0 +1,120 @@
+#ifndef AMIGAGREP_H_INCLUDED
+#define AMIGAGREP_H_INCLUDED
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "amigadrive.h"
+
+// the blocks (4MB) each worker searches at once
+#define GREP_CHUNK 8192
+// the longest pattern searched for
+#define GREP_MAX_PATTERN 4096
+// patterns may start with up to this many different bytes and still be prefiltered a word at a time
+#define GREP_WORD_BYTES 4
+
+namespace amigadrive
+{
+	/*!
+	*	Where a pattern was found. Blocks count 512 byte device blocks from the start
+	*	of the image. The partition is 0, and the file empty, where there's none.
+	*/
+	struct GrepMatch
+	{
+		u64 block;
+		u32 offset;
+		u32 pattern;
+		int partition;
+		std::string file;
+		// the match's offset in the file, or -1 if it lies outside the file's data
+		s64 fileOffset;
+	};
+
+	/*!
+	*	Finds any number of byte patterns at once in one pass over a buffer. A bitmap
+	*	of the first two bytes of every pattern picks out the places worth comparing,
+	*	so the cost hardly grows with the number of patterns. Where the patterns start
+	*	with GREP_WORD_BYTES different bytes or fewer, the buffer is first tested eight
+	*	bytes at a time for any of them, and most of it is passed over without looking
+	*	at single bytes at all.
+	*/
+	class PatternSet
+	{
+		public:
+			PatternSet();
+
+			/*!
+			*	Adds a pattern of the bytes of a string.
+			*/
+			bool addLiteral(const char *text);
+
+			/*!
+			*	Adds a pattern written in hex, e.g. DEADBEEF or "de ad be ef". Returns false
+			*	if it isn't whole bytes of hex.
+			*/
+			bool addHex(const char *hex);
+
+			u32 patternCount(void);
+
+			/*!
+			*	Returns the length of the longest pattern.
+			*/
+			u32 maxLength(void);
+
+			/*!
+			*	Returns a pattern as it was given, quoted if it's a string.
+			*/
+			const char *label(u32 pattern);
+
+			/*!
+			*	Finds every match starting in the first scan bytes of data, which holds
+			*	bytes bytes so that matches may run on past scan. Matches are added to
+			*	found in order, with block and offset counted from base, a block number.
+			*	May be called from several threads at once.
+			*/
+			void search(const u8 *data, u64 scan, u64 bytes, u64 base, std::vector<GrepMatch> &found) const;
+
+		private:
+			std::vector<std::string> m_patterns;
+			std::vector<std::string> m_labels;
+			u32 m_maxLength;
+			std::vector<u32> m_byFirst[256];
+			u64 m_bigrams[65536 / 64];
+			std::vector<u64> m_words;
+
+			bool add(const std::string &pattern, const std::string &label);
+			void check(const u8 *data, u64 at, u64 bytes, u64 base, std::vector<GrepMatch> &found) const;
+	};
+
+	/*!
+	*	Searches device images for patterns, sharding each image into chunks of
+	*	GREP_CHUNK blocks which a pool of workers read and search. Chunks are read
+	*	with overlaps of the longest pattern, so nothing is missed where they meet.
+	*	Matches are put down to the partition they're in and, where it has a file
+	*	system which can be read, to the file whose data holds them.
+	*/
+	class Grep
+	{
+		public:
+			/*!
+			*	\param workers - the number of chunks searched at once, 0 for one per hardware thread.
+			*/
+			Grep(UI *messenger, PatternSet *patterns, unsigned workers = 0);
+
+			/*!
+			*	Searches an image, or only one of its partitions if partition isn't 0,
+			*	and writes a line per match to out, in the order they lie on the image.
+			*	Returns the number of matches, or -1 if the image couldn't all be searched.
+			*/
+			s64 run(const char *image, int partition, FILE *out);
+
+		private:
+			UI *m_messenger;
+			PatternSet *m_patterns;
+			unsigned m_workers;
+
+			void attribute(Device *device, std::vector<GrepMatch> &matches);
+	};
+}
+
+#endif // AMIGAGREP_H_INCLUDED
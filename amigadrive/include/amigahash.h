@@ -0,0 +1,49 @@
+#ifndef AMIGAHASH_H_INCLUDED
+#define AMIGAHASH_H_INCLUDED
+
+#include "amigatypes.h"
+
+namespace amigadrive
+{
+	/*!
+	*	Continues a CRC-32 (the zlib/PKZIP polynomial) over len more bytes. Start with a
+	*	crc of 0; the value returned after the last piece is the CRC of the whole.
+	*/
+	u32 crc32Update(u32 crc, const void *data, u64 len);
+
+	/*!
+	*	Incremental SHA-1, as used by the preservation databases to identify images.
+	*/
+	class SHA1
+	{
+		public:
+			SHA1();
+
+			/*!
+			*	Hashes len more bytes.
+			*/
+			void update(const void *data, u64 len);
+
+			/*!
+			*	Finishes the hash and writes the 20 byte digest. The object may not be
+			*	updated afterwards.
+			*/
+			void final(u8 digest[20]);
+
+		private:
+			u32 m_h[5];
+			u8 m_buffer[64];
+			u32 m_used;
+			u64 m_bytes;
+
+			void block(const u8 *data);
+	};
+
+	/*!
+	*	Writes len bytes as lower case hex, followed by a null, into a buffer of at
+	*	least 2 * len + 1 characters.
+	*/
+	void hexString(char *out, const u8 *data, int len);
+}
+
+#endif // AMIGAHASH_H_INCLUDED
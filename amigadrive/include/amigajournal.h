@@ -0,0 +1,75 @@
+#ifndef AMIGAJOURNAL_H_INCLUDED
+#define AMIGAJOURNAL_H_INCLUDED
+
+#include <stdio.h>
+#include <vector>
+#include "amigatypes.h"
+#include "amigaui.h"
+
+// a copy is journalled in chunks of this many blocks (8MB)
+#define JOURNAL_CHUNK 16384
+
+namespace amigadrive
+{
+	/*!
+	*	A checkpoint journal for a long copy. It's a text file: a header line naming
+	*	the copy - its direction and block range - then one line per chunk copied,
+	*	giving the chunk's number and the CRC-32 of its data. Each line is flushed
+	*	once the chunk's data has been handed to the target, so an interrupted copy
+	*	leaves a record of how far it got. When the copy is started again with the
+	*	same journal, the recorded chunks are checked against the target and the
+	*	copy resumes after the last one which matches.
+	*/
+	class CopyJournal
+	{
+		public:
+			CopyJournal(UI *messenger);
+			~CopyJournal();
+
+			/*!
+			*	Opens the journal for a copy, loading the chunks recorded by an earlier
+			*	run of the same copy. Returns false if the journal can't be read, or is
+			*	for a different copy.
+			*
+			*	\param kind - "out" or "in", the direction of the copy.
+			*	\param begin - the first device block of the copy.
+			*	\param size - the number of blocks in the copy.
+			*/
+			bool open(const char *fileName, const char *kind, s64 begin, s64 size);
+
+			/*!
+			*	Returns the number of chunks an earlier run recorded.
+			*/
+			u64 recordedChunks(void);
+
+			/*!
+			*	Returns the CRC-32 an earlier run recorded for a chunk.
+			*/
+			u32 chunkHash(u64 chunk);
+
+			/*!
+			*	Starts recording, keeping the first keep chunks of those loaded and
+			*	dropping the rest. Returns false if the journal can't be written.
+			*/
+			bool start(u64 keep);
+
+			/*!
+			*	Records the next chunk as copied.
+			*/
+			bool record(u32 crc);
+
+			/*!
+			*	The copy is complete: the journal is deleted.
+			*/
+			void finish(void);
+
+		private:
+			UI *m_messenger;
+			FILE *m_file;
+			char m_fileName[4096];
+			char m_header[128];
+			std::vector<u32> m_hashes;
+	};
+}
+
+#endif // AMIGAJOURNAL_H_INCLUDED
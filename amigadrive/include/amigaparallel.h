@@ -0,0 +1,30 @@
+#ifndef AMIGAPARALLEL_H_INCLUDED
+#define AMIGAPARALLEL_H_INCLUDED
+
+#include <functional>
+#include "amigatypes.h"
+
+namespace amigadrive
+{
+	/*!
+	*	Returns the number of worker threads to use when the caller doesn't ask for a
+	*	specific count - one per hardware thread, or one if that can't be determined.
+	*/
+	unsigned defaultWorkerCount(void);
+
+	/*!
+	*	Calls job(index, worker) for every index in [0, count) on a pool of worker threads.
+	*	Indices are handed out one at a time as workers become free, so jobs of uneven
+	*	cost still balance across the pool. The worker argument is a zero-based id below
+	*	the pool size, which jobs may use to index per-worker scratch space.
+	*
+	*	Returns once every job has completed. Jobs must not let exceptions escape.
+	*
+	*	\param count - the number of jobs.
+	*	\param workers - the pool size, 0 for defaultWorkerCount().
+	*	\param job - the function to run for each index.
+	*/
+	void parallelFor(u64 count, unsigned workers, const std::function<void(u64, unsigned)> &job);
+}
+
+#endif // AMIGAPARALLEL_H_INCLUDED
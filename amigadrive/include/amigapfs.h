@@ -0,0 +1,110 @@
+#ifndef AMIGAPFS_H_INCLUDED
+#define AMIGAPFS_H_INCLUDED
+
+#include "amigafs.h"
+
+// the ids of PFS3 reserved blocks
+#define PFS_ID_DB 0x4442
+#define PFS_ID_AB 0x4142
+#define PFS_ID_IB 0x4942
+#define PFS_ID_SB 0x5342
+#define PFS_ID_EX 0x4558
+
+// the root block is the third block of the volume, and says how big reserved blocks are and where the index is
+#define PFS_ROOTBLOCK 2
+#define PFS_ROOT_OPTIONS 4
+#define PFS_ROOT_DAYS 12
+#define PFS_ROOT_NAME 20
+#define PFS_ROOT_LASTRESERVED 52
+#define PFS_ROOT_FIRSTRESERVED 56
+#define PFS_ROOT_RESERVEDBYTES 64
+#define PFS_ROOT_DISKSIZE 84
+#define PFS_ROOT_EXTENSION 88
+#define PFS_ROOT_INDEX 116
+#define PFS_ROOT_INDEXES 99
+
+// the options of a PFS3 volume which change how it's read
+#define PFS_MODE_SPLITTED_ANODES 2
+#define PFS_MODE_EXTENSION 32
+#define PFS_MODE_SUPERINDEX 128
+
+// the anode of the root directory
+#define PFS_ANODE_ROOTDIR 5
+
+namespace amigadrive
+{
+	/*!
+	*	Reads the Professional File System (PFS\1 to PFS\3, and PDS). Every file and
+	*	directory is a chain of anodes, each a run of blocks, and anodes are found
+	*	through index blocks, and superindex blocks on big volumes. The block the
+	*	anodes of each sequence number live in is remembered once found, so looking
+	*	up an anode costs one cached read rather than a walk of the index. Reserved
+	*	blocks come through the shared metadata cache, and decoded anode chains are
+	*	cached as extent maps.
+	*/
+	class PFSFileSystem: public FileSystem
+	{
+		public:
+			PFSFileSystem(Volume *volume, UI *messenger);
+
+			/*!
+			*	Returns true for the dos types this reads.
+			*/
+			static bool isPFS(u32 dosType);
+
+			/*!
+			*	Checks the root block. Returns false if it isn't sound.
+			*/
+			bool init(void);
+
+			virtual const char *fsName(void);
+
+		protected:
+			virtual bool rootInfo(FileInfo &info);
+			virtual bool list(const FileInfo &dir, std::vector<FileInfo> &entries);
+			virtual File *openFile(const FileInfo &info);
+			virtual std::shared_ptr<const ExtentMap> mapFile(const FileInfo &info);
+
+		private:
+			struct Anode
+			{
+				u32 clusterSize;
+				u32 block;
+				u32 next;
+			};
+
+			u64 m_blocks;
+			u32 m_options;
+			// bytes of a reserved block, and volume blocks it covers
+			u32 m_reservedBytes;
+			u32 m_cluster;
+			u32 m_firstReserved;
+			u32 m_lastReserved;
+			u32 m_anodesPerBlock;
+			u32 m_indexPerBlock;
+			std::vector<u32> m_index;
+			std::mutex m_anodeLock;
+			std::unordered_map<u32, u32> m_anodeBlocks;
+			FileInfo m_root;
+
+			/*!
+			*	Reads a reserved block, into a buffer of m_reservedBytes, and checks its id.
+			*/
+			bool readReserved(u32 block, u8 *buffer, u32 id);
+
+			/*!
+			*	Returns the block holding the anodes of a sequence number, from the
+			*	index blocks.
+			*/
+			u32 anodeBlock(u32 seqnr, u8 *buffer);
+
+			bool readAnode(u32 number, Anode &anode);
+
+			/*!
+			*	Fills in info from a directory entry. Returns false if it isn't sound.
+			*/
+			bool entryInfo(const u8 *entry, u32 room, FileInfo &info);
+	};
+}
+
+#endif // AMIGAPFS_H_INCLUDED
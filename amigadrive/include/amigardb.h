@@ -0,0 +1,101 @@
+#ifndef AMIGARDB_H_INCLUDED
+#define AMIGARDB_H_INCLUDED
+
+#include <unordered_set>
+#include <vector>
+#include "amigadrive.h"
+
+// RDB blocks read at once when a chain leads out of what's cached
+#define RDB_PREFETCH 16
+
+namespace amigadrive
+{
+	/*!
+	*	A cache of the blocks of a drive's RDB area. Blocks in the header the device
+	*	read at open are used where they lie; any others are read RDB_PREFETCH at a
+	*	time, since the rest of a chain usually follows on. Blocks are handed out as
+	*	views into the cache, which stay valid as long as it does.
+	*/
+	class RDBBlocks
+	{
+		public:
+			/*!
+			*	\param header - the first headerBlocks device blocks, already read. They
+			*	aren't copied, so they have to outlive the cache.
+			*/
+			RDBBlocks(DeviceIO *io, struct rigidDiskBlock *rdb, u32 blockBytes, Block *header, int headerBlocks);
+			~RDBBlocks();
+
+			/*!
+			*	Returns RDB block number block, or null if it's outside the RDB area or
+			*	can't be read.
+			*/
+			u8 *get(u32 block);
+
+			/*!
+			*	Returns the size of the RDB's blocks.
+			*/
+			u32 blockBytes(void);
+
+		private:
+			struct Window
+			{
+				u32 first;
+				u32 count;
+				Block *data;
+			};
+
+			DeviceIO *m_io;
+			struct rigidDiskBlock *m_rdb;
+			u32 m_blockBytes;
+			u32 m_perBlock;
+			Block *m_header;
+			u32 m_headerBlocks;
+			std::vector<Window> m_windows;
+
+			bool inArea(u32 block);
+	};
+
+	/*!
+	*	Walks one of the linked lists of the RDB - PART, FSHD, LSEG, BADB or BOOT. Each
+	*	block returned has the expected id and a good checksum. The walk stops at the
+	*	end of the list, at the first block which isn't right, or where the list loops
+	*	back on itself; broken() tells the first apart from the others.
+	*/
+	class RDBChain
+	{
+		public:
+			/*!
+			*	\param first - the first block of the list, 0xFFFFFFFF for an empty one.
+			*	\param id - the id the list's blocks carry, such as AMIGA_ID_PART.
+			*/
+			RDBChain(RDBBlocks *blocks, u32 first, u32 id);
+
+			/*!
+			*	Returns a view of the next block of the list, or null when there are
+			*	no more. The view belongs to the cache.
+			*/
+			u8 *next(void);
+
+			/*!
+			*	Returns the number of the block next() last returned, or of the block
+			*	which stopped the walk.
+			*/
+			u32 block(void);
+
+			/*!
+			*	Returns true if the walk stopped anywhere but the end of the list.
+			*/
+			bool broken(void);
+
+		private:
+			RDBBlocks *m_blocks;
+			u32 m_next;
+			u32 m_block;
+			u32 m_id;
+			bool m_broken;
+			std::unordered_set<u32> m_seen;
+	};
+}
+
+#endif // AMIGARDB_H_INCLUDED
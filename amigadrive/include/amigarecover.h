@@ -0,0 +1,173 @@
+#ifndef AMIGARECOVER_H_INCLUDED
+#define AMIGARECOVER_H_INCLUDED
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "amigadrive.h"
+
+// the device blocks (4MB) each worker sweeps at once
+#define RECOVER_CHUNK 8192
+// chunks are read this much longer, so a block of any size which starts in one is whole
+#define RECOVER_OVERLAP (MAX_BLOCKBYTES / BLOCKSIZE)
+// DOS boot blocks before a root block which are tried as the start of its file system
+#define RECOVER_MAX_BOOTS 64
+
+namespace amigadrive
+{
+	/*!
+	*	A partition of a recovered layout. Its PART block's geometry counts from
+	*	the start of the device as it is now, which may not be where the RDB put it.
+	*/
+	struct RecoveredPartition
+	{
+		struct partitionBlock part;
+		// 512 byte device blocks
+		u64 start;
+		u64 count;
+		// whether a file system of its dos type starts where it does
+		bool found;
+	};
+
+	/*!
+	*	A partition table put together from what a sweep found. Offset is the device
+	*	block the RDB's block 0 is at - not 0 if blocks were lost from the start of the
+	*	image, or added to it.
+	*/
+	struct RecoveredLayout
+	{
+		enum Source
+		{
+			// an RDSK block and the PART blocks its list reaches
+			FROM_RDSK,
+			// PART blocks no RDSK block lists
+			FROM_PARTS,
+			// file systems found without PART blocks
+			FROM_FILESYSTEMS
+		};
+
+		Source source;
+		// the RDSK block's device block, for FROM_RDSK
+		u64 block;
+		s64 offset;
+		u32 rdbBlockBytes;
+		int score;
+		std::vector<RecoveredPartition> partitions;
+	};
+
+	/*!
+	*	Rebuilds the partition table of a device whose RDB is damaged or isn't where
+	*	it should be. Every block of the device is swept, in chunks of RECOVER_CHUNK
+	*	blocks which a pool of workers read and look through, for sound RDSK, PART
+	*	and FSHD blocks, and for the first blocks of file systems: DOS boot and root
+	*	blocks, and SFS and PFS root blocks. What's found is put together into every
+	*	layout it could make - each RDSK block with the PART blocks it reaches, the
+	*	PART blocks no RDSK block reaches, and the file systems on their own - and
+	*	each layout is scored by how many of its partitions have a file system of
+	*	their type where they start, best first.
+	*/
+	class PartitionRecovery
+	{
+		public:
+			/*!
+			*	\param workers - the number of chunks swept at once, 0 for one per hardware thread.
+			*/
+			PartitionRecovery(Device *device, UI *messenger, unsigned workers = 0);
+
+			/*!
+			*	Sweeps the device and works out the layouts. Returns false if nothing
+			*	was found which a layout could be made of.
+			*/
+			bool sweep(void);
+
+			/*!
+			*	Returns the layouts, best first.
+			*/
+			const std::vector<RecoveredLayout> &layouts(void);
+
+			/*!
+			*	Writes a layout to the device as a new RDB: an RDSK block and a chain of
+			*	PART blocks, in the first blocks before the first partition which hold
+			*	none of the file system drivers or other RDB blocks found there. Returns
+			*	false if there's no room for them, or the device can't be written.
+			*/
+			bool write(const RecoveredLayout &layout);
+
+		private:
+			// a block the sweep kept: an RDB block, with a copy of it, or a boot or root block
+			struct Signature
+			{
+				enum Kind
+				{
+					RDB,
+					BOOT,
+					ROOT
+				};
+
+				u64 block;
+				Kind kind;
+				// the id of an RDB block, the dos type of a boot block, the size of a root block
+				u32 value;
+				Block copy;
+			};
+
+			// a file system found from its first blocks, in 512 byte device blocks
+			struct FileSystemFound
+			{
+				u64 start;
+				u64 count;
+				u32 dosType;
+				u32 blockBytes;
+			};
+
+			Device *m_device;
+			UI *m_messenger;
+			unsigned m_workers;
+			std::map<u64, struct rigidDiskBlock> m_rdsks;
+			std::map<u64, struct partitionBlock> m_parts;
+			std::map<u64, struct fileSysHeaderBlock> m_fileSystems;
+			// FSHD, LSEG, BADB and BOOT blocks, by their ids
+			std::map<u64, u32> m_others;
+			// boot blocks by their dos types, root blocks by their sizes
+			std::map<u64, u32> m_boots;
+			std::map<u64, u32> m_roots;
+			std::vector<FileSystemFound> m_found;
+			std::vector<RecoveredLayout> m_layouts;
+
+			/*!
+			*	Checks one 512 byte block of a chunk, with room bytes of the chunk from it on.
+			*/
+			void sweepBlock(u64 block, const u8 *buffer, u32 room, std::vector<Signature> &found);
+
+			/*!
+			*	Finds the file systems the boot and root blocks the sweep found start.
+			*/
+			void findFileSystems(void);
+
+			/*!
+			*	Returns true if the root block of an FFS file system starting at start
+			*	points at blocks which are what it says they are.
+			*/
+			bool checkRoot(u64 start, u64 root, u32 blockBytes, u64 blocks);
+
+			/*!
+			*	Puts a PART block found at offset into a partition counted from the start
+			*	of the device. Returns false if it doesn't lie on the device.
+			*/
+			bool place(const struct partitionBlock &part, s64 offset, u32 rdbBlockBytes, RecoveredPartition &partition);
+
+			/*!
+			*	Follows a list of PART blocks from first, with the RDB's block 0 at offset,
+			*	through the PART blocks the sweep found. Returns their device blocks.
+			*/
+			std::vector<u64> partChain(u32 first, s64 offset, u32 perBlock);
+
+			void addRDSKLayouts(std::set<u64> &used);
+			void addPARTLayout(const std::set<u64> &used);
+			void addFileSystemLayout(void);
+			void score(RecoveredLayout &layout);
+	};
+}
+
+#endif // AMIGARECOVER_H_INCLUDED
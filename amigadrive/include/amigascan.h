@@ -0,0 +1,81 @@
+#ifndef AMIGASCAN_H_INCLUDED
+#define AMIGASCAN_H_INCLUDED
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "amigadrive.h"
+
+namespace amigadrive
+{
+	/*!
+	*	The Scanner class takes inventory of many device images at once. Each image is
+	*	opened in-process on a pool of worker threads and probed for its rigid disk block,
+	*	partition chain and boot code. One JSON record is written per image, on a line of
+	*	its own, in the order the probes complete:
+	*
+	*	{"image":"a.hdf","ok":true,"bytes":6553600,"type":"hard_drive","rdb":true,
+	*	 "blockBytes":512,"cylinders":200,"heads":2,"sectors":32,"bootable":true,
+	*	 "partitions":[{"name":"DH0","start":128,"count":3200,"dosType":"DOS\\3","bootPri":0}],
+	*	 "probeUsec":41}
+	*
+	*	ADF diskette images are read whole, in one request, and their records also
+	*	classify the boot block and give the CRC-32 and SHA-1 of the image:
+	*
+	*	{"image":"a.adf","ok":true,"bytes":901120,"type":"dd_diskette","rdb":false,
+	*	 "bootable":false,"bootblock":"bootable","crc32":"...","sha1":"...",
+	*	 "partitions":[{"name":"DF0","start":0,"count":1760,"dosType":"DOS\\0","bootPri":0}],
+	*	 "probeUsec":35}
+	*
+	*	Bare file system images, without an RDB, get "bare":true and a single partition.
+	*
+	*	Images that can't be opened get "ok":false and an "error" field instead.
+	*/
+	class Scanner
+	{
+		public:
+			/*!
+			*	\param messenger - UI used to report problems with the scan list itself.
+			*	\param workers - the number of images probed concurrently, 0 for one per hardware thread.
+			*/
+			Scanner(UI *messenger, unsigned workers = 0);
+			~Scanner();
+
+			/*!
+			*	Adds a single image to the scan list.
+			*/
+			void addImage(const char *fileName);
+
+			/*!
+			*	Adds every regular file below the named directory to the scan list.
+			*	Returns false if the directory can't be read.
+			*/
+			bool addDirectory(const char *dirName);
+
+			/*!
+			*	Adds the images named in a list file, one path per line. A name of "-"
+			*	reads the list from stdin. Returns false if the list can't be read.
+			*/
+			bool addList(const char *listName);
+
+			/*!
+			*	Returns the number of images on the scan list.
+			*/
+			u64 imageCount(void);
+
+			/*!
+			*	Probes every image on the list, writing one record per image to the
+			*	given stream. Returns the number of images which couldn't be probed.
+			*/
+			u64 run(FILE *out);
+
+		private:
+			UI *m_messenger;
+			unsigned m_workers;
+			std::vector<std::string> m_images;
+
+			bool probe(const char *fileName, std::string &record);
+	};
+}
+
+#endif // AMIGASCAN_H_INCLUDED
@@ -0,0 +1,100 @@
+#ifndef AMIGASFS_H_INCLUDED
+#define AMIGASFS_H_INCLUDED
+
+#include "amigafs.h"
+
+// the ids of Smart File System blocks
+#define SFS_ID_ROOT 0x53465300
+#define SFS_ID_OBJC 0x4F424A43
+#define SFS_ID_BNDC 0x424E4443
+#define SFS_ID_NDC 0x4E444320
+
+// every block starts with its id, its checksum and its own block number, and the root block gives the layout
+#define SFS_OWNBLOCK 8
+#define SFS_ROOT_VERSION 12
+#define SFS_ROOT_TOTALBLOCKS 48
+#define SFS_ROOT_BLOCKSIZE 52
+#define SFS_ROOT_OBJECTCONTAINER 104
+#define SFS_ROOT_EXTENTROOT 108
+#define SFS_ROOT_NODEROOT 112
+
+// the type bits of an object
+#define SFS_OTYPE_HARDLINK 32
+#define SFS_OTYPE_LINK 64
+#define SFS_OTYPE_DIR 128
+
+// B-tree and node tree levels followed before a tree is taken to be looped
+#define SFS_MAX_DEPTH 32
+
+namespace amigadrive
+{
+	/*!
+	*	Reads the Smart File System (SFS\0 and SFS\2). Directories are chains of object
+	*	containers, and files are chains of extents kept in a B-tree, which is searched
+	*	from the root once per extent when a file is opened; the map that makes is then
+	*	cached as FFS maps are. Tree nodes come through the shared metadata cache, so the
+	*	upper levels of the extent and object node trees stay cached between searches.
+	*	Every block is checked for its id, checksum and own block number.
+	*/
+	class SFSFileSystem: public FileSystem
+	{
+		public:
+			/*!
+			*	\param blockBytes - the block size the root block gives.
+			*/
+			SFSFileSystem(Volume *volume, UI *messenger, u32 blockBytes);
+
+			/*!
+			*	Returns true for the dos types this reads.
+			*/
+			static bool isSFS(u32 dosType);
+
+			/*!
+			*	Checks the root block. Returns false if it isn't sound.
+			*/
+			bool init(void);
+
+			virtual const char *fsName(void);
+
+		protected:
+			virtual bool rootInfo(FileInfo &info);
+			virtual bool list(const FileInfo &dir, std::vector<FileInfo> &entries);
+			virtual File *openFile(const FileInfo &info);
+			virtual std::shared_ptr<const ExtentMap> mapFile(const FileInfo &info);
+
+		private:
+			u64 m_blocks;
+			u32 m_rootContainer;
+			u32 m_extentRoot;
+			u32 m_nodeRoot;
+			// log2 of the block size in 32 byte units
+			u32 m_nodeShift;
+
+			bool readChecked(u64 block, u8 *buffer, u32 id);
+
+			/*!
+			*	Fills in info from an object. A directory's key is its first object
+			*	container, and a file's its first extent. Hard links are followed.
+			*/
+			bool objectInfo(const u8 *object, FileInfo &info, int depth = 0);
+
+			/*!
+			*	Returns the size of the object at offset at of a container, or 0 if
+			*	there's no sound object there.
+			*/
+			u32 objectSize(const u8 *container, u32 at);
+
+			/*!
+			*	Finds an object by its node number, through the object node tree, and
+			*	copies it into object, which needs m_blockBytes.
+			*/
+			bool findObject(u32 node, u8 *object);
+
+			/*!
+			*	Finds the extent starting at block key in the extent B-tree.
+			*/
+			bool findExtent(u32 key, u32 &next, u32 &blocks);
+	};
+}
+
+#endif // AMIGASFS_H_INCLUDED
@@ -0,0 +1,101 @@
+#ifndef AMIGASTATS_H_INCLUDED
+#define AMIGASTATS_H_INCLUDED
+
+#include <atomic>
+#include <vector>
+#include "amigatypes.h"
+#include "amigaui.h"
+
+namespace amigadrive
+{
+	/*!
+	*	IOStats collects operation counts, byte counts, access pattern and a latency
+	*	histogram for a stream of block I/O. Every counter is atomic, so one IOStats
+	*	can be fed from several threads at once.
+	*
+	*	An IOStats may carry child IOStats covering block ranges - the device-wide
+	*	statistics have one child per volume - and each operation is also credited
+	*	to the child whose range holds its first block.
+	*/
+	class IOStats
+	{
+		public:
+			/*!
+			*	Latency bucket n counts operations taking [2^n, 2^(n+1)) nanoseconds.
+			*	The last bucket also takes everything slower.
+			*/
+			enum { BUCKETS = 40 };
+
+			typedef enum {READ, WRITE} Direction;
+
+			/*!
+			*	The counters kept for one direction of transfer.
+			*/
+			struct Counters
+			{
+				std::atomic<u64> ops;
+				std::atomic<u64> bytes;
+				std::atomic<u64> sequential;
+				std::atomic<u64> failed;
+				std::atomic<u64> nanos;
+				std::atomic<u64> histogram[BUCKETS];
+				std::atomic<u64> nextBlock;
+			};
+
+			IOStats();
+			~IOStats();
+
+			/*!
+			*	Records one completed operation.
+			*
+			*	\param dir - READ or WRITE.
+			*	\param block - the first block transferred.
+			*	\param count - the number of 512 byte blocks transferred.
+			*	\param nanos - how long the operation took.
+			*	\param ok - whether it succeeded.
+			*/
+			void record(Direction dir, u64 block, u64 count, u64 nanos, bool ok);
+
+			/*!
+			*	Credits operations starting in [start, start+count) to the given child as well.
+			*	Ranges must not overlap. The child isn't owned by this object.
+			*/
+			void addChild(u64 start, u64 count, IOStats *child);
+
+			/*!
+			*	Zeroes every counter, but keeps the children.
+			*/
+			void reset(void);
+
+			/*!
+			*	Returns the counters for the given direction.
+			*/
+			const Counters &counters(Direction dir);
+
+			/*!
+			*	Returns an estimate of the given latency percentile (0-100) in nanoseconds,
+			*	taken as the upper edge of the histogram bucket it falls in. 0 if no operations.
+			*/
+			u64 percentile(Direction dir, double pct);
+
+			/*!
+			*	Writes a summary of both directions, with histograms, through the UI.
+			*/
+			void dump(UI *msgr, const char *title);
+
+		private:
+			struct Child
+			{
+				u64 start;
+				u64 end;
+				IOStats *stats;
+			};
+
+			Counters m_counters[2];
+			std::vector<Child> m_children;
+
+			IOStats *childFor(u64 block);
+	};
+}
+
+#endif // AMIGASTATS_H_INCLUDED
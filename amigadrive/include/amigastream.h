@@ -0,0 +1,53 @@
+#ifndef AMIGASTREAM_H_INCLUDED
+#define AMIGASTREAM_H_INCLUDED
+
+#include "amigadrive.h"
+
+// a stream's first 8MB are kept, which covers the RDB area and its PART chain
+#define STREAM_HEAD_BYTES (8 * 1024 * 1024)
+// the block count a stream claims until its end is seen
+#define STREAM_UNBOUNDED ((u64)1 << 48)
+
+namespace amigadrive
+{
+	/*!
+	*	StreamIO reads a drive image from a pipe - standard input, or a file
+	*	descriptor which can't seek. The head of the stream is read into memory
+	*	when the driver is initialised, so the RDB and its partitions can be parsed
+	*	from there. Past the head the stream is read strictly forwards: a read
+	*	ahead of the current position discards what's in between, and a read behind
+	*	it fails.
+	*
+	*	If the whole stream fits in the head, its size is known and it behaves like
+	*	any other image. Otherwise blockCount() is only a bound, and the driver is
+	*	marked sequential so the device doesn't go looking for things in the middle.
+	*/
+	class StreamIO: public DeviceIO
+	{
+		public:
+			/*!
+			*	\param fd - the descriptor to read. The driver doesn't close it.
+			*/
+			StreamIO(int fd = 0);
+			~StreamIO();
+
+		protected:
+			int m_fd;
+			u8 *m_head;
+			u64 m_headBytes;
+			u64 m_pos;
+
+			/*!
+			*	Reads the head of the stream. The name is only used in messages; a
+			*	stream can't be opened for writing.
+			*/
+			virtual void initDriver(UI *messenger, const char *devName, bool readOnly);
+			virtual bool readBlock(Block *readBuffer, u64 blockNumber);
+			virtual bool writeBlock(Block *writeBuffer, u64 blockNumber);
+			virtual bool readBlocks(Block *readBuffer, u64 blockNumber, u64 count);
+
+			u64 fill(u8 *buffer, u64 bytes);
+	};
+}
+
+#endif // AMIGASTREAM_H_INCLUDED
@@ -10,6 +10,16 @@
 
 namespace amigadrive
 {
+	/*!
+	 * The common header shared by all of the RDB structures below.
+	 */
+	struct blockHeader
+	{
+		u32 id;
+		u32 summedLongs;
+		s32 chkSum;
+	};
+
 	/*!
 	 * Amiga disks have a very open structure. The head for the partition table information
 	 * is stored somewhere within the first 16 blocks on disk, and is called the
@@ -95,9 +105,83 @@ namespace amigadrive
 		u32   loadData[123];
 	};
 
+	/*!
+	 * The drive's bad blocks are listed in a chain of these. Each pair gives a bad
+	 * block and the one which stands in for it, both in RDB blocks. There are 61
+	 * pairs in a 512 byte block, and more in larger ones.
+	 */
+	struct badBlockEntry
+	{
+		u32 badBlock;
+		u32 goodBlock;
+	};
+
+	struct badBlockBlock
+	{
+		u32 id;
+		u32 summedLongs;
+		s32 chkSum;
+		u32 hostid;
+		u32 next;
+		u32 reserved;
+		struct badBlockEntry blockPairs[61];
+	};
+
+	/*!
+	 * A file system driver stored on the drive is described by one of these, in the
+	 * chain from fileSysHeaderList. Its code is in the chain of LSEG blocks from
+	 * segListBlocks. version holds the major version in the upper 16 bits.
+	 */
+	struct fileSysHeaderBlock
+	{
+		u32 id;
+		u32 summedLongs;
+		s32 chkSum;
+		u32 hostid;
+		u32 next;
+		u32 flags;
+		u32 reserved_1[2];
+		u32 dosType;
+		u32 version;
+		u32 patchFlags;
+		u32 type;
+		u32 task;
+		u32 lock;
+		u32 handler;
+		u32 stackSize;
+		s32 priority;
+		s32 startup;
+		u32 segListBlocks;
+		u32 globalVec;
+		u32 reserved_2[23];
+		u32 reserved_3[21];
+	};
+
+	/*!
+	 * A block of a file system driver's code. The loadData of the chain, in order,
+	 * make up a hunk format executable.
+	 */
+	struct loadSegBlock
+	{
+		u32 id;
+		u32 summedLongs;
+		s32 chkSum;
+		u32 hostid;
+		u32 next;
+		u32 loadData[123];
+	};
+
 	#define AMIGA_ID_RDISK                  0x5244534B
 	#define AMIGA_ID_PART                   0x50415254
 	#define AMIGA_ID_BOOT                   0x424f4f54
+	#define AMIGA_ID_BADB                   0x42414442
+	#define AMIGA_ID_FSHD                   0x46534844
+	#define AMIGA_ID_LSEG                   0x4C534547
+
+	// the RDSK block is in the first 16 blocks of the RDB's block size
+	#define AMIGA_BLOCK_LIMIT               16
+	// the largest RDB block size looked for
+	#define RDB_MAX_BLOCKBYTES              4096
 
 	/*!
 	 * The environment array in the partition block
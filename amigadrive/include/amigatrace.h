@@ -0,0 +1,96 @@
+#ifndef AMIGATRACE_H_INCLUDED
+#define AMIGATRACE_H_INCLUDED
+
+#include <atomic>
+#include "amigatypes.h"
+
+namespace amigadrive
+{
+	/*!
+	*	Tracer records timed spans and writes them as a Chrome trace-event JSON file,
+	*	which chrome://tracing and Perfetto display as a timeline with one track per thread.
+	*
+	*	Each thread appends to a buffer of its own, so recording takes no locks; a thread
+	*	takes the registry lock once, when it records its first span. The buffers are
+	*	written out by finish(), which must only be called once the threads that recorded
+	*	spans have stopped doing so.
+	*
+	*	Span names and categories are stored as pointers, so they must be string literals
+	*	or otherwise outlive the trace.
+	*/
+	class Tracer
+	{
+		public:
+			/*!
+			*	Starts tracing, to be written to the named file by finish().
+			*	Returns false if the file can't be created.
+			*/
+			static bool start(const char *fileName);
+
+			/*!
+			*	Writes the trace file and stops tracing. Does nothing if tracing wasn't started.
+			*/
+			static void finish(void);
+
+			/*!
+			*	True while tracing.
+			*/
+			static bool enabled(void)
+			{
+				return s_enabled.load(std::memory_order_relaxed);
+			}
+
+			/*!
+			*	Returns nanoseconds since tracing started.
+			*/
+			static u64 now(void);
+
+			/*!
+			*	Records a completed span for the calling thread.
+			*
+			*	\param name - the span name, e.g. "read".
+			*	\param category - the span category, e.g. "chunk".
+			*	\param start - the start time as returned by now().
+			*	\param arg - a value shown with the span, such as a block number, or -1 for none.
+			*/
+			static void record(const char *name, const char *category, u64 start, s64 arg);
+
+		private:
+			static std::atomic<bool> s_enabled;
+	};
+
+	/*!
+	*	Records a span covering its own lifetime when tracing is on, and costs one
+	*	test of Tracer::enabled() when it isn't.
+	*/
+	class TraceSpan
+	{
+		private:
+			const char *m_name;
+			const char *m_category;
+			s64 m_arg;
+			u64 m_start;
+			bool m_on;
+
+		public:
+			TraceSpan(const char *name, const char *category, s64 arg = -1)
+			{
+				m_on = Tracer::enabled();
+				if (m_on)
+				{
+					m_name = name;
+					m_category = category;
+					m_arg = arg;
+					m_start = Tracer::now();
+				}
+			}
+
+			~TraceSpan()
+			{
+				if (m_on)
+					Tracer::record(m_name, m_category, m_start, m_arg);
+			}
+	};
+}
+
+#endif // AMIGATRACE_H_INCLUDED
@@ -1,6 +1,7 @@
 #ifndef AMIGAUI_H_INCLUDED
 #define AMIGAUI_H_INCLUDED
 
+#include <stdio.h>
 #include "amigautils.h"
 
 namespace amigadrive
@@ -53,11 +54,18 @@ namespace amigadrive
 	{
 		private:
 			stringStore *m_listOfStrings;
+			FILE *m_infoStream;
 
 		public:
 			ConsoleUI();
 			~ConsoleUI();
 
+			/*!
+			*	Sends info messages and the progress bar to the given stream rather than
+			*	stdout - stderr, when stdout is carrying data.
+			*/
+			void setInfoStream(FILE *stream);
+
 			/*!
 			*	A progress bar function - this implementation merely writes a , o the screen for
 			*	every percent increment.
@@ -90,6 +98,30 @@ namespace amigadrive
 			*/
 			virtual void textInfo(const char *format, ...);
 	};
+
+	/*!
+	*	A UI that discards everything except the most recent error message. Use it where
+	*	many devices are worked on concurrently and console chatter would interleave.
+	*/
+	class SilentUI: public UI
+	{
+		private:
+			char m_lastError[256];
+
+		public:
+			SilentUI();
+			~SilentUI();
+
+			virtual void progressBar(int percent);
+			virtual void textError(const char *format, ...);
+			virtual void textWarning(const char *format, ...);
+			virtual void textInfo(const char *format, ...);
+
+			/*!
+			*	Returns the text of the last error reported, or an empty string if there was none.
+			*/
+			const char *lastError(void);
+	};
 };
 
 #endif // AMIGAUI_H_INCLUDED
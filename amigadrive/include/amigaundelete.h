@@ -0,0 +1,115 @@
+#ifndef AMIGAUNDELETE_H_INCLUDED
+#define AMIGAUNDELETE_H_INCLUDED
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "amigaffs.h"
+
+// the device blocks (4MB) each worker sweeps at once
+#define UNDELETE_CHUNK 8192
+// bytes of a recovered file copied at a time, so a damaged block costs no more than this
+#define UNDELETE_COPY (64 * 1024)
+
+namespace amigadrive
+{
+	/*!
+	*	A file whose header was found on a volume, but which can't be reached from
+	*	its root directory: deleted, or in a directory which was.
+	*/
+	struct LostFile
+	{
+		// the file's header block is its key
+		FileInfo info;
+		// where it was, as far as the headers of the directories above it are still there
+		std::string path;
+		std::shared_ptr<const ExtentMap> map;
+		// whether the map covers the whole file
+		bool complete;
+		// data blocks of the file which live files use now
+		u64 reused;
+	};
+
+	/*!
+	*	Finds the lost files of an OFS or FFS volume. Every block of the volume is
+	*	swept, in chunks of UNDELETE_CHUNK blocks which a pool of workers read and
+	*	look through, for sound file, directory and extension blocks: ones of the
+	*	right type which name themselves and whose checksums come to zero. Deleting
+	*	a file only takes its header off its directory's hash chain and frees its
+	*	blocks, so the header and the chain of extension blocks hung off it are still
+	*	there until they're written over. The file headers which the walk from the
+	*	root doesn't reach are the lost files; their block lists are rebuilt from
+	*	the extension blocks found, taking only those which belong to them.
+	*/
+	class Undelete
+	{
+		public:
+			/*!
+			*	\param workers - the number of chunks swept at once, 0 for one per hardware thread.
+			*/
+			Undelete(Volume *volume, UI *messenger, unsigned workers = 0);
+			~Undelete();
+
+			/*!
+			*	Sweeps the volume for lost files. Blocks which can't be read are skipped,
+			*	with a warning. Returns false if it doesn't hold an OFS or FFS file system.
+			*/
+			bool scan(void);
+
+			/*!
+			*	Returns the lost files scan found, in the order their headers lie.
+			*/
+			const std::vector<LostFile> &files(void);
+
+			/*!
+			*	Copies a lost file to a host file, as much of it as its map reaches.
+			*	Blocks which can't be read are written as zeroes, and their bytes counted
+			*	in bad. Returns false if the host file couldn't be written.
+			*/
+			bool recover(const LostFile &file, const char *fileName, u64 &bad);
+
+			/*!
+			*	Copies every lost file into a directory, each named after its header
+			*	block and its name, as several lost files may share a name.
+			*/
+			bool recoverAll(const char *dir);
+
+		private:
+			struct Header
+			{
+				FileInfo info;
+				s32 secType;
+				u64 parent;
+			};
+
+			struct Extension
+			{
+				u64 parent;
+			};
+
+			Volume *m_volume;
+			UI *m_messenger;
+			unsigned m_workers;
+			FFSFileSystem *m_fs;
+			std::unordered_map<u64, Header> m_headers;
+			std::unordered_map<u64, Extension> m_lists;
+			std::vector<LostFile> m_files;
+
+			/*!
+			*	Checks one block of a chunk, keeping it if it's a sound header or extension block.
+			*/
+			void sweepBlock(u64 block, u8 *buffer, std::vector<std::pair<u64, Header>> &headers,
+				std::vector<std::pair<u64, Extension>> &lists);
+
+			/*!
+			*	Rebuilds a file's block list from its header and the extension blocks the
+			*	sweep found for it.
+			*/
+			std::shared_ptr<const ExtentMap> rebuild(const FileInfo &info, bool &complete);
+
+			std::string lostPath(const Header &header);
+	};
+}
+
+#endif // AMIGAUNDELETE_H_INCLUDED
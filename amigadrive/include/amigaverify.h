@@ -0,0 +1,84 @@
+#ifndef AMIGAVERIFY_H_INCLUDED
+#define AMIGAVERIFY_H_INCLUDED
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "amigadrive.h"
+
+// at most this many written chunks wait to be read back
+#define VERIFY_DEPTH 4
+
+namespace amigadrive
+{
+	/*!
+	*	Verifies a copy after writing. Each chunk is hashed a block at a time as it's
+	*	submitted, then read back from the target on a thread of its own, so reading
+	*	back one chunk overlaps copying the next. Blocks which don't match, or which
+	*	can't be read back, are reported as ranges of device blocks.
+	*/
+	class CopyVerifier
+	{
+		public:
+			/*!
+			*	Reads count blocks back from the target, from block number block of
+			*	the copy. It has to get past any cache to the medium itself.
+			*/
+			typedef std::function<bool(Block *buffer, s64 block, s64 count)> Reader;
+
+			/*!
+			*	\param base - the device block the copy starts at, which reports are relative to.
+			*	\param reread - reads the written data back.
+			*/
+			CopyVerifier(UI *messenger, s64 base, const Reader &reread);
+			~CopyVerifier();
+
+			/*!
+			*	Queues a chunk which has just been written for reading back. The data is
+			*	hashed before this returns, so the caller can reuse its buffer. Waits if
+			*	VERIFY_DEPTH chunks are already queued.
+			*/
+			void submit(const Block *data, s64 block, s64 count);
+
+			/*!
+			*	Waits for everything submitted to be read back and reports any ranges
+			*	which didn't match. Returns true if they all did.
+			*/
+			bool finish(void);
+
+		private:
+			struct Pending
+			{
+				s64 block;
+				s64 count;
+				std::vector<u32> crcs;
+			};
+
+			struct Range
+			{
+				s64 first;
+				s64 last;
+				bool unreadable;
+			};
+
+			UI *m_messenger;
+			s64 m_base;
+			Reader m_reread;
+			std::mutex m_lock;
+			std::condition_variable m_queued;
+			std::condition_variable m_taken;
+			std::deque<Pending> m_queue;
+			std::vector<Range> m_bad;
+			bool m_done;
+			bool m_finished;
+			std::thread m_thread;
+
+			void run(void);
+			void mismatch(s64 block, bool unreadable);
+	};
+}
+
+#endif // AMIGAVERIFY_H_INCLUDED
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include "amigabadblock.h"
+
+namespace amigadrive
+{
+	void BadBlockMap::add(u64 bad, u64 good, u64 count)
+	{
+		if (count)
+			m_entries.push_back({bad, good, count});
+	}
+
+	/*
+	 * A stable sort keeps entries for the same block in the order they were added,
+	 * so the first one wins when overlaps are trimmed.
+	 */
+	void BadBlockMap::seal(void)
+	{
+		std::vector<Entry> merged;
+
+		std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b) { return a.bad < b.bad; });
+
+		for (Entry e : m_entries)
+		{
+			if (!merged.empty())
+			{
+				Entry &last = merged.back();
+				u64 end = last.bad + last.count;
+
+				// drop whatever part of this one is already remapped
+				if (e.bad < end)
+				{
+					if (e.bad + e.count <= end)
+						continue;
+					e.good += end - e.bad;
+					e.count -= end - e.bad;
+					e.bad = end;
+				}
+
+				if (e.bad == end && e.good == last.good + last.count)
+				{
+					last.count += e.count;
+					continue;
+				}
+			}
+			merged.push_back(e);
+		}
+
+		m_entries.swap(merged);
+	}
+
+	u64 BadBlockMap::blockCount(void)
+	{
+		u64 n = 0;
+
+		for (Entry &e : m_entries)
+			n += e.count;
+		return n;
+	}
+
+	u64 BadBlockMap::entryCount(void)
+	{
+		return m_entries.size();
+	}
+
+	/*
+	 * The index of the first entry which ends after the block - the one holding it,
+	 * if any does, or else the next one up.
+	 */
+	size_t BadBlockMap::find(u64 block)
+	{
+		size_t lo = 0, hi = m_entries.size();
+
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+
+			if (m_entries[mid].bad + m_entries[mid].count <= block)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	u64 BadBlockMap::lookup(u64 block)
+	{
+		size_t i = find(block);
+
+		if (i < m_entries.size() && m_entries[i].bad <= block)
+			return m_entries[i].good + (block - m_entries[i].bad);
+		return block;
+	}
+
+	u64 BadBlockMap::piece(u64 block, u64 count, u64 &target)
+	{
+		size_t i = find(block);
+		u64 n;
+
+		if (i == m_entries.size())
+		{
+			target = block;
+			return count;
+		}
+
+		Entry &e = m_entries[i];
+
+		if (e.bad <= block)
+		{
+			target = e.good + (block - e.bad);
+			n = e.bad + e.count - block;
+		}
+		else
+		{
+			target = block;
+			n = e.bad - block;
+		}
+		return (n < count) ? n : count;
+	}
+}
@@ -0,0 +1,59 @@
+#include "amigablock.h"
+
+namespace amigadrive
+{
+	static u32 sumBlockGeneric(const void *block, u32 bytes)
+	{
+		const u8 *p = (const u8 *)block;
+		u32 sum = 0;
+		u32 i;
+
+		for (i = 0; i < bytes; i += 4)
+			sum += be32(p + i);
+		return sum;
+	}
+
+	static bool zeroBlockGeneric(const void *block, u32 bytes)
+	{
+		const u64 *p = (const u64 *)block;
+		u64 acc = 0;
+		u32 i;
+
+		for (i = 0; i < bytes / sizeof(u64); i++)
+			acc |= p[i];
+		return acc == 0;
+	}
+
+	static void copyBlockGeneric(void *to, const void *from, u32 bytes)
+	{
+		memcpy(to, from, bytes);
+	}
+
+	#define KERNELS(n) {n, sumBlockKernel<n>, zeroBlockKernel<n>, copyBlockKernel<n>}
+
+	static const BlockKernels s_kernels[] =
+	{
+		KERNELS(512),
+		KERNELS(1024),
+		KERNELS(2048),
+		KERNELS(4096),
+	};
+
+	static const BlockKernels s_generic = {0, sumBlockGeneric, zeroBlockGeneric, copyBlockGeneric};
+
+	bool validBlockBytes(u32 bytes)
+	{
+		return bytes >= 512 && bytes <= MAX_BLOCKBYTES && (bytes & (bytes - 1)) == 0;
+	}
+
+	const BlockKernels *blockKernels(u32 bytes)
+	{
+		u32 i;
+
+		for (i = 0; i < sizeof(s_kernels) / sizeof(s_kernels[0]); i++)
+			if (s_kernels[i].bytes == bytes)
+				return &s_kernels[i];
+
+		return validBlockBytes(bytes) ? &s_generic : &s_kernels[0];
+	}
+}
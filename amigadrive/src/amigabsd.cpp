@@ -0,0 +1,180 @@
+#include <string.h>
+#include "amigabsd.h"
+#include "amigablock.h"
+
+namespace amigadrive
+{
+	/*
+	 * A disklabel, as NetBSD lays it out, in the byte order of the port which wrote
+	 * it: the magic, the geometry, the magic again, a checksum and the slices.
+	 */
+	#define BSD_SECSIZE 40
+	#define BSD_MAGIC2 132
+	#define BSD_NPARTITIONS 138
+	#define BSD_PARTITIONS 148
+	#define BSD_PARTITION_BYTES 16
+
+	static const char *s_fsTypes[] =
+	{
+		"unused", "swap", "Version 6", "Version 7", "System V", "4.1BSD", "Eighth Edition", "4.2BSD",
+		"MSDOS", "4.4LFS", "unknown", "HPFS", "ISO9660", "boot", "ADOS", "HFS", "FILECORE", "Linux Ext2",
+		"NTFS", "RAID", "ccd", "jfs", "Apple UFS", "vinum", "UDF", "SysV BFS", "Efs", "ZFS"
+	};
+
+	static u32 get32(const u8 *p, bool bigEndian)
+	{
+		return bigEndian ? be32(p) : (u32)p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+	}
+
+	static u32 get16(const u8 *p, bool bigEndian)
+	{
+		return bigEndian ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+	}
+
+	DiskLabel::DiskLabel(Volume *volume, UI *messenger)
+	{
+		m_volume = volume;
+		m_messenger = messenger;
+		m_label = false;
+	}
+
+	bool DiskLabel::isNetBSD(u32 dosType)
+	{
+		u32 base = dosType & NETBSD_DOST_MASK;
+
+		return base == NETBSD_DOST_ROOT || base == NETBSD_DOST_SWAP || base == NETBSD_DOST_USER ||
+			dosType == (NETBSD_DOST_OLD | 'R') || dosType == (NETBSD_DOST_OLD | 'S') || dosType == (NETBSD_DOST_OLD | 'U');
+	}
+
+	const char *DiskLabel::fsTypeName(u8 fsType)
+	{
+		if (fsType < sizeof(s_fsTypes) / sizeof(s_fsTypes[0]))
+			return s_fsTypes[fsType];
+		return "unknown";
+	}
+
+	bool DiskLabel::hasLabel(void)
+	{
+		return m_label;
+	}
+
+	const std::vector<BSDSlice> &DiskLabel::slices(void)
+	{
+		return m_slices;
+	}
+
+	const BSDSlice *DiskLabel::slice(char letter)
+	{
+		for (BSDSlice &s : m_slices)
+			if (s.letter == letter)
+				return &s;
+		return nullptr;
+	}
+
+	/*
+	 * A label is only taken if both its magic numbers are there and its words xor to
+	 * zero, which they do in either byte order. Slice offsets are relative to the
+	 * disk the label was written for: that's the volume for a label written inside a
+	 * partition, but the whole drive for one written by NetBSD/amiga itself, so a
+	 * slice which only fits the volume once its start is taken off is moved.
+	 */
+	bool DiskLabel::parse(const u8 *label, u32 room, bool bigEndian)
+	{
+		u64 volStart = m_volume->volStartBlock();
+		u64 volCount = m_volume->volBlockCount();
+		u32 slices, secSize, bytes, i;
+		u16 sum = 0;
+
+		if (room < BSD_PARTITIONS || get32(label + BSD_MAGIC2, bigEndian) != BSD_DISKMAGIC)
+			return false;
+
+		slices = get16(label + BSD_NPARTITIONS, bigEndian);
+		bytes = BSD_PARTITIONS + slices * BSD_PARTITION_BYTES;
+		if (slices > BSD_MAXSLICES || bytes > room)
+			return false;
+
+		for (i = 0; i < bytes; i += 2)
+			sum ^= get16(label + i, true);
+		if (sum)
+			return false;
+
+		secSize = get32(label + BSD_SECSIZE, bigEndian);
+		if (secSize == 0)
+			secSize = BLOCKSIZE;
+		if (secSize % BLOCKSIZE)
+			return false;
+
+		for (i = 0; i < slices; i++)
+		{
+			const u8 *p = label + BSD_PARTITIONS + i * BSD_PARTITION_BYTES;
+			BSDSlice s;
+
+			s.letter = 'a' + i;
+			s.count = (u64)get32(p, bigEndian) * (secSize / BLOCKSIZE);
+			s.start = (u64)get32(p + 4, bigEndian) * (secSize / BLOCKSIZE);
+			s.fsType = p[12];
+			if (s.count == 0)
+				continue;
+
+			if (s.start + s.count > volCount && s.start >= volStart && s.start - volStart + s.count <= volCount)
+				s.start -= volStart;
+			if (s.start + s.count > volCount)
+			{
+				m_messenger->textWarning("Slice %c of volume %s lies outside it\n", s.letter, m_volume->volName());
+				continue;
+			}
+			m_slices.push_back(s);
+		}
+		return true;
+	}
+
+	bool DiskLabel::read(void)
+	{
+		u64 sectors = m_volume->volBlockCount();
+		u32 dosType = m_volume->volDosType();
+		u8 *buffer;
+		u32 bytes, at;
+
+		m_slices.clear();
+		m_label = false;
+
+		if (sectors > BSD_LABEL_SECTORS)
+			sectors = BSD_LABEL_SECTORS;
+		bytes = sectors * BLOCKSIZE;
+		buffer = new u8[bytes];
+
+		if (sectors && m_volume->volReadDevice(buffer, 0, sectors))
+			for (at = 0; at + 4 <= bytes && !m_label; at += 4)
+			{
+				if (be32(buffer + at) == BSD_DISKMAGIC)
+					m_label = parse(buffer + at, bytes - at, true);
+				else if (get32(buffer + at, false) == BSD_DISKMAGIC)
+					m_label = parse(buffer + at, bytes - at, false);
+			}
+		delete [] buffer;
+
+		if (!m_label && isNetBSD(dosType))
+		{
+			BSDSlice s;
+			u32 base = dosType & NETBSD_DOST_MASK;
+			bool old = base == NETBSD_DOST_OLD;
+			char kind = old ? (char)(dosType & 0xFF) : 0;
+
+			s.start = 0;
+			s.count = m_volume->volBlockCount();
+			if (base == NETBSD_DOST_ROOT || kind == 'R')
+				s.letter = 'a';
+			else if (base == NETBSD_DOST_SWAP || kind == 'S')
+				s.letter = 'b';
+			else
+				s.letter = 'd';
+			if (old)
+				s.fsType = kind == 'S' ? BSD_FS_SWAP : BSD_FS_BSDFFS;
+			else
+				s.fsType = dosType & 0xFF;
+			m_slices.push_back(s);
+		}
+
+		return !m_slices.empty();
+	}
+}
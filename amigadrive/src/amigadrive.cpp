@@ -5,34 +5,50 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <chrono>
 #include "amigadrive.h"
 #include "amigastruct.h"
+#include "amigabadblock.h"
+#include "amigardb.h"
+#include "amigafloppy.h"
+#include "amigahash.h"
+#include "amigajournal.h"
+#include "amigaverify.h"
+#include "amigatrace.h"
+#include "amigabsd.h"
 #include "endianness.h"
 
-#define AMIGA_BLOCK_LIMIT 16
+// the header area read at open holds the first AMIGA_BLOCK_LIMIT blocks of the largest size
+#define AMIGA_HEADER_SECTORS (AMIGA_BLOCK_LIMIT * RDB_MAX_BLOCKBYTES / BLOCKSIZE)
+#define COPY_CHUNK 256
+// copies at least this long (16MB) keep their data out of the page cache
+#define LARGE_COPY (16 * 2048)
+// and drop output file pages once they are this far (8MB) behind the write position
+#define CACHE_WINDOW (8 * 1024 * 1024)
+// copies inside the kernel go this many blocks (16MB) between progress reports
+#define RANGE_CHUNK (16 * 2048)
 namespace amigadrive
 {
-	bool g_littleEndian;
-
-	struct blockHeader
-	{
-		u32 id;
-		u32 summedLongs;
-		s32 chkSum;
-	};
+	bool g_littleEndian = isLittleEndian();
 
 	/*
 	 * Sum a block. The checksum of a block must end up at zero
 	 * to be valid. The chk_sum field is selected so that adding
 	 * it yields zero.
 	 */
-	int sumBlock(struct blockHeader *header)
+	int sumBlock(struct blockHeader *header, u32 blockBytes)
 	{
 		u32 summedLongs = fe32(header->summedLongs);
 		s32 *block = (s32 *)header;
 		u32 i;
 		s32 sum = 0;
 
+		// a corrupt count mustn't walk us off the end of the block
+		if (summedLongs > blockBytes / sizeof(u32))
+			return 1;
+
 		for (i = 0; i < summedLongs; i++)
 		{
 			sum += (s32)fe32(*block++);
@@ -41,84 +57,213 @@ namespace amigadrive
 		return (sum != 0);
 	}
 
+	void setChecksum(struct blockHeader *header)
+	{
+		u32 summedLongs = fe32(header->summedLongs);
+		u32 *block = (u32 *)header;
+		u32 sum = 0;
+		u32 i;
+
+		header->chkSum = 0;
+		for (i = 0; i < summedLongs; i++)
+			sum += fe32(block[i]);
+		header->chkSum = fe32(-sum);
+	}
+
+	bool DeviceIO::readBlocks(Block *readBuffer, u64 blockNumber, u64 count)
+	{
+		u64 i;
+
+		for (i = 0; i < count; i++)
+			if (!readBlock(&readBuffer[i], blockNumber + i))
+				return false;
+		return true;
+	}
+
+	bool DeviceIO::timedIO(IOStats::Direction dir, Block *buffer, u64 blockNumber, u64 count)
+	{
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		bool ok;
+
+		if (dir == IOStats::READ)
+			ok = (count == 1) ? readBlock(buffer, blockNumber) : readBlocks(buffer, blockNumber, count);
+		else
+			ok = (count == 1) ? writeBlock(buffer, blockNumber) : writeBlocks(buffer, blockNumber, count);
+
+		m_stats->record(dir, blockNumber, count,
+			std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count(), ok);
+		return ok;
+	}
+
+	/*
+	 * Split a transfer where the bad block map says to, and hand each piece to the
+	 * driver, timing it if statistics are on. A range which misses every bad block
+	 * goes through whole.
+	 */
+	bool DeviceIO::remappedIO(IOStats::Direction dir, Block *buffer, u64 blockNumber, u64 count)
+	{
+		while (count)
+		{
+			u64 target;
+			u64 n = m_remap->piece(blockNumber, count, target);
+			bool ok;
+
+			if (m_stats)
+				ok = timedIO(dir, buffer, target, n);
+			else if (dir == IOStats::READ)
+				ok = (n == 1) ? readBlock(buffer, target) : readBlocks(buffer, target, n);
+			else
+				ok = (n == 1) ? writeBlock(buffer, target) : writeBlocks(buffer, target, n);
+
+			if (!ok)
+				return false;
+			buffer += n;
+			blockNumber += n;
+			count -= n;
+		}
+		return true;
+	}
+
+	bool DeviceIO::writeBlocks(Block *writeBuffer, u64 blockNumber, u64 count)
+	{
+		u64 i;
+
+		for (i = 0; i < count; i++)
+			if (!writeBlock(&writeBuffer[i], blockNumber + i))
+				return false;
+		return true;
+	}
+
+	s64 DeviceIO::ioCopyToFile(int fd, u64 fileOffset, u64 blockNumber, u64 count)
+	{
+		std::chrono::steady_clock::time_point t0;
+		s64 n;
+
+		if (m_remap)
+			return -1;
+		if (!m_stats)
+			return copyToFile(fd, fileOffset, blockNumber, count);
+
+		t0 = std::chrono::steady_clock::now();
+		n = copyToFile(fd, fileOffset, blockNumber, count);
+		if (n >= 0)
+			m_stats->record(IOStats::READ, blockNumber, count,
+				std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count(), n == (s64)count);
+		return n;
+	}
+
+	/*
+	 * Read the header area of the device - the first AMIGA_BLOCK_LIMIT blocks of
+	 * the largest RDB block size we support - in one go. Every probe that looks
+	 * for structures in the header area works from this copy, so opening a device
+	 * costs one request rather than one per block per probe. Returns the number of
+	 * 512 byte blocks read, which is less than the limit for tiny images.
+	 */
+	int Device::readHeader(void)
+	{
+		int i;
+
+		if (m_io->ioReadBlocks(m_header, 0, AMIGA_HEADER_SECTORS))
+			return AMIGA_HEADER_SECTORS;
+
+		for (i = 0; i < AMIGA_HEADER_SECTORS; i++)
+			if (!m_io->ioRead(&m_header[i], i))
+				break;
+		return i;
+	}
+
+	/*
+	 * The block size an RDSK block found at the given 512 byte block of the
+	 * header claims for the RDB, or 0 if it can't be right: the RDB is required
+	 * to be within the first 16 of its own blocks, and must start on one.
+	 * Old tools left blockBytes zero, which means 512.
+	 */
+	static u32 rdbBlockBytes(struct rigidDiskBlock *rdb, int sector)
+	{
+		u32 bytes = fe32(rdb->blockBytes);
+		u32 perBlock;
+
+		if (!validBlockBytes(bytes) || bytes > RDB_MAX_BLOCKBYTES)
+			bytes = BLOCKSIZE;
+
+		perBlock = bytes / BLOCKSIZE;
+		if (sector % perBlock != 0 || sector / perBlock >= AMIGA_BLOCK_LIMIT)
+			return 0;
+		return bytes;
+	}
+
 	/*
 	 * Search for the Rigid Disk Block. The rigid disk block is required
 	 * to be within the first 16 blocks of a drive, needs to have
 	 * the ID AMIGA_ID_RDISK ('RDSK') and needs to have a valid
-	 * sum-to-zero checksum
+	 * sum-to-zero checksum. Its blocks may be larger than 512 bytes,
+	 * in which case it's somewhere within the first 16 of those.
 	 */
 	struct rigidDiskBlock *Device::getRDB(void)
 	{
 		struct rigidDiskBlock *rdb;
-		Block blockBuffer;
-		bool res;
 		int i;
 
-		rdb = new struct rigidDiskBlock;
-
-		memset(rdb, 0, sizeof(struct rigidDiskBlock));
-
-		for (i=0; i< AMIGA_BLOCK_LIMIT; i++)
+		for (i=0; i < m_headerBlocks; i++)
 		{
-			res = m_io->readBlock(&blockBuffer, i);
-
-			if (res)
+			struct rigidDiskBlock *trdb = (struct rigidDiskBlock *)m_header[i];
+			// m_messenger->textInfo("Checking %08x against %08x\n",fe32(trdb->id), AMIGA_ID_RDISK);
+			if (fe32(trdb->id) == AMIGA_ID_RDISK)
 			{
-				struct rigidDiskBlock *trdb = (struct rigidDiskBlock *)blockBuffer;
-				// m_messenger->textInfo("Checking %08x against %08x\n",fe32(trdb->id), AMIGA_ID_RDISK);
-				if (fe32(trdb->id) == AMIGA_ID_RDISK)
+				u32 bytes = rdbBlockBytes(trdb, i);
+
+				// m_messenger->textInfo("Rigid disk block suspect at %d, checking checksum\n",i);
+				if (bytes && i + (int)(bytes / BLOCKSIZE) <= m_headerBlocks && sumBlock((struct blockHeader *)trdb, bytes) == 0)
 				{
-					// m_messenger->textInfo("Rigid disk block suspect at %d, checking checksum\n",i);
-					if (sumBlock((struct blockHeader *)blockBuffer) == 0)
-					{
-						// m_messenger->textInfo("FOUND");
-						memcpy(rdb, trdb, sizeof(struct rigidDiskBlock));
-						return rdb;
-					}
+					m_blockBytes = bytes;
+					m_kernels = blockKernels(bytes);
+					// m_messenger->textInfo("FOUND");
+					rdb = new struct rigidDiskBlock;
+					memcpy(rdb, trdb, sizeof(struct rigidDiskBlock));
+					return rdb;
 				}
 			}
 		}
 
-		if (rdb)
-			delete rdb;
-
 		// m_messenger->textInfo("Done scanning, no RDB found");
 		return nullptr;
 	}
 
+	/*
+	 * Boot code is in the chain of BOOT blocks from the RDB's bootCodeBlock. Some
+	 * tools left that unset and put a BOOT block in the first 16 blocks regardless,
+	 * so those are searched if the chain is empty. Either way the block returned is
+	 * a view, of the RDB cache or of the header.
+	 */
 	struct bootcodeBlock *Device::getBootCode(void)
 	{
-		struct bootcodeBlock *bootcode;
-		Block blockBuffer;
-		bool res;
+		int perBlock = m_blockBytes / BLOCKSIZE;
 		int i;
 
-		bootcode = new struct bootcodeBlock;
-		memset(bootcode, 0, sizeof(struct bootcodeBlock));
+		if (m_rdbBlocks)
+		{
+			RDBChain chain(m_rdbBlocks, fe32(m_rdb->bootCodeBlock), AMIGA_ID_BOOT);
+			u8 *boot = chain.next();
+
+			if (boot)
+				return (struct bootcodeBlock *)boot;
+		}
 
 		// m_messenger->textInfo("Scanning for BOOT from 0 to %d\n", AMIGA_BLOCK_LIMIT);
-		for (i = 0; i < AMIGA_BLOCK_LIMIT; i++)
+		for (i = 0; i < AMIGA_BLOCK_LIMIT * perBlock && i + perBlock <= m_headerBlocks; i += perBlock)
 		{
-			res = m_io->readBlock(&blockBuffer, i);
-			if (res)
+			struct bootcodeBlock *boot = (struct bootcodeBlock *)m_header[i];
+			if (fe32(boot->id) == AMIGA_ID_BOOT)
 			{
-				struct bootcodeBlock *boot = (struct bootcodeBlock *)&blockBuffer;
-				if (fe32(boot->id) == AMIGA_ID_BOOT)
+				// m_messenger->textInfo("BOOT block at %d, checking checksum\n", i);
+				if (sumBlock((struct blockHeader *)boot, m_blockBytes) == 0)
 				{
-					// m_messenger->textInfo("BOOT block at %d, checking checksum\n", i);
-					if (sumBlock((struct blockHeader *)blockBuffer) == 0)
-					{
-						// m_messenger->textInfo("Found valid bootcode block\n");
-						memcpy(bootcode, boot, sizeof(struct bootcodeBlock));
-						return bootcode;
-					}
+					// m_messenger->textInfo("Found valid bootcode block\n");
+					return boot;
 				}
 			}
 		}
 
-		if (bootcode)
-			delete bootcode;
-
 		// m_messenger->textInfo("No boot code found on disk\n");
 		return nullptr;
 	}
@@ -162,13 +307,15 @@ namespace amigadrive
 	static void printPartInfo(UI* msgr, struct partitionBlock *p)
 	{
 		struct amigaPartGeometry *g;
+		u64 cylBlocks;
 
 		g = (struct amigaPartGeometry *)&(p->environment);
+		cylBlocks = (u64)fe32(g->blockPerTrack) * fe32(g->surfaces);
 
 		bstrPrint(msgr, p->driveName);
-		msgr->textInfo("%6d\t%6d\t",
-			   fe32(g->lowCyl) * fe32(g->blockPerTrack) * fe32(g->surfaces) ,
-			   (fe32(g->highCyl) - fe32(g->lowCyl) + 1) * fe32(g->blockPerTrack) * fe32(g->surfaces) - 1);
+		msgr->textInfo("%6lu\t%6lu\t",
+			   fe32(g->lowCyl) * cylBlocks,
+			   ((u64)fe32(g->highCyl) - fe32(g->lowCyl) + 1) * cylBlocks);
 		printDiskType(msgr, fe32(g->dosType));
 		msgr->textInfo("\t%5d\n", fe32(g->bootPriority));
 	}
@@ -179,7 +326,6 @@ namespace amigadrive
 		struct rigidDiskBlock *rdb = m_rdb;
 		struct bootcodeBlock *boot;
 		struct partitionBlock *p;
-		Block blockBuffer;
 		u32 block;
 		int i = 1;
 
@@ -204,32 +350,18 @@ namespace amigadrive
 		m_messenger->textInfo("                 First   Num. \n"
 			   "Nr.  Part. Name  Block   Block  Type        Boot Priority\n");
 
-		while (block != 0xFFFFFFFF)
-		{
-			bool res;
-
-			m_messenger->textInfo("Trying to load block #0x%X\n", block);
+		RDBChain chain(m_rdbBlocks, block, AMIGA_ID_PART);
 
-			res = m_io->readBlock(&blockBuffer, block);
-			if (res)
-			{
-				p = (struct partitionBlock *)blockBuffer;
-				if (fe32(p->id) == AMIGA_ID_PART)
-				{
-					m_messenger->textInfo("PART block suspect at 0x%x, checking checksum\n",block);
-					if (sumBlock((struct blockHeader *)p) == 0)
-					{
-						m_messenger->textInfo("%-4d ", i);
-						i++;
-						printPartInfo(m_messenger, p);
-						block = fe32(p->next);
-					}
-				}
-				else block = 0xFFFFFFFF;
-			}
-			else block = 0xFFFFFFFF;
+		while ((p = (struct partitionBlock *)chain.next()) != nullptr)
+		{
+			m_messenger->textInfo("%-4d ", i);
+			i++;
+			printPartInfo(m_messenger, p);
 		}
 
+		if (chain.broken())
+			m_messenger->textInfo("PART block at 0x%x is missing, or isn't valid\n", chain.block());
+
 		boot = m_bootcode;
 		if (boot)
 		{
@@ -267,35 +399,57 @@ namespace amigadrive
 
 	s64 Volume::volStartBlock(void)
 	{
-		struct amigaPartGeometry *g = (struct amigaPartGeometry *)&(m_partBlock->environment);
-
-		if (g)
-			return fe32(g->lowCyl) * fe32(g->blockPerTrack) * fe32(g->surfaces);
-		return -1;
+		return m_partBlock ? (s64)m_startBlock : -1;
 	}
 
 	s64 Volume::volBlockCount(void)
 	{
-		struct amigaPartGeometry *g = (struct amigaPartGeometry *)&(m_partBlock->environment);
-
-		if (g)
-			return (fe32(g->highCyl) - fe32(g->lowCyl) + 1) * fe32(g->blockPerTrack) * fe32(g->surfaces) - 1;
-		return -1;
+		return m_partBlock ? (s64)m_blockCount : -1;
 	}
 
 	s64 Volume::volBytesPerBlock(void)
 	{
-		struct amigaPartGeometry *g = (struct amigaPartGeometry *)&(m_partBlock->environment);
+		return m_blockBytes;
+	}
 
-		if (g)
-			return g->sizeBlocks;
-		return -1;
+	u32 Volume::volSectorBytes(void)
+	{
+		return m_sectorBytes;
 	}
 
-	static char *strDiskType(stringStore *s, u32 diskType)
+	const BlockKernels *Volume::volKernels(void)
 	{
-		char *buffer = s->makeString(6);
-		char *b = buffer;
+		return m_kernels;
+	}
+
+	bool Volume::volRead(void *buffer, u64 block, u64 count)
+	{
+		u64 perBlock = m_blockBytes / BLOCKSIZE;
+
+		if ((block + count) * perBlock > m_blockCount)
+			return false;
+		return m_io->ioReadBlocks((Block *)buffer, m_startBlock + block * perBlock, count * perBlock);
+	}
+
+	bool Volume::volReadDevice(void *buffer, u64 block, u64 count)
+	{
+		if (block + count > m_blockCount)
+			return false;
+		return m_io->ioReadBlocks((Block *)buffer, m_startBlock + block, count);
+	}
+
+	bool Volume::volWrite(void *buffer, u64 block, u64 count)
+	{
+		u64 perBlock = m_blockBytes / BLOCKSIZE;
+
+		if (m_ro || (block + count) * perBlock > m_blockCount)
+			return false;
+		return m_io->ioWriteBlocks((Block *)buffer, m_startBlock + block * perBlock, count * perBlock);
+	}
+
+	void dosTypeString(char *out, u32 diskType)
+	{
+		char *b = out;
 
 		*b++ = (diskType & 0xFF000000)>>24;
 		*b++ = (diskType & 0x00FF0000)>>16;
@@ -303,7 +457,13 @@ namespace amigadrive
 		*b++ = '\\';
 		*b++ = (diskType & 0x000000FF) + '0';
 		*b = 0;
+	}
+
+	static char *strDiskType(stringStore *s, u32 diskType)
+	{
+		char *buffer = s->makeString(6);
 
+		dosTypeString(buffer, diskType);
 		return buffer;
 	}
 
@@ -316,59 +476,109 @@ namespace amigadrive
 		return nullptr;
 	}
 
-	Volume::Volume(DeviceIO *io, UI *messenger, bool ro, struct rigidDiskBlock *rdb, u32 block)
+	s32 Volume::volBootPriority(void)
+	{
+		struct amigaPartGeometry *g = (struct amigaPartGeometry *)&(m_partBlock->environment);
+
+		return (s32)fe32(g->bootPriority);
+	}
+
+	u32 Volume::volDosType(void)
+	{
+		struct amigaPartGeometry *g = (struct amigaPartGeometry *)&(m_partBlock->environment);
+
+		return fe32(g->dosType);
+	}
+
+	u32 Volume::volReserved(void)
+	{
+		struct amigaPartGeometry *g = (struct amigaPartGeometry *)&(m_partBlock->environment);
+
+		return fe32(g->reserved);
+	}
+
+	IOStats *Volume::volStats(void)
+	{
+		return &m_stats;
+	}
+
+	/*
+	 * Work out where the partition is. Its geometry counts sectors of sizeBlocks
+	 * longwords, and its file system blocks are sectorPerBlock of those. The
+	 * products are taken in 64 bits: cylinders, heads and sectors are each 32
+	 * bit, and large media overflow 32 bits well before any of them does.
+	 */
+	void Volume::setGeometry(u32 rdbBlockBytes)
+	{
+		struct amigaPartGeometry *g = (struct amigaPartGeometry *)&(m_partBlock->environment);
+		u32 sectorBytes = fe32(g->sizeBlocks) * 4;
+		u32 perBlock = fe32(g->sectorPerBlock);
+		u64 lowCyl = fe32(g->lowCyl);
+		u64 highCyl = fe32(g->highCyl);
+		u64 cylSectors = (u64)fe32(g->blockPerTrack) * fe32(g->surfaces);
+
+		m_sectorBytes = validBlockBytes(sectorBytes) ? sectorBytes : rdbBlockBytes;
+		m_blockBytes = m_sectorBytes;
+		if (perBlock > 1 && validBlockBytes(m_sectorBytes * perBlock))
+			m_blockBytes = m_sectorBytes * perBlock;
+		m_kernels = blockKernels(m_blockBytes);
+
+		m_startBlock = lowCyl * cylSectors * (m_sectorBytes / BLOCKSIZE);
+		m_blockCount = (highCyl >= lowCyl) ? (highCyl - lowCyl + 1) * cylSectors * (m_sectorBytes / BLOCKSIZE) : 0;
+	}
+
+	/*
+	 * A volume for one PART block of the RDB's chain. The block is a view into the
+	 * device's cache of RDB blocks, which outlives its volumes, so it isn't copied.
+	 */
+	Volume::Volume(DeviceIO *io, UI *messenger, bool ro, struct partitionBlock *part, u32 rdbBlockBytes)
 	{
-		struct partitionBlock *p;
 		m_messenger = messenger;
-		m_partBlock = nullptr;
-		// m_partGeom = nullptr;
 		m_nextVol = nullptr;
-		Block blockBuffer;
 		m_ro = ro;
 		m_io = io;
-
+		m_partBlock = part;
+		m_ownPart = false;
 		m_strings = new stringStore();
+		setGeometry(rdbBlockBytes);
+	}
 
-		if (block != 0xFFFFFFFF)
-		{
-			bool res;
+	Volume::Volume(DeviceIO *io, UI *messenger, bool ro, const char *name, u32 dosType, u32 heads, u32 sectors, u32 lowCyl, u32 highCyl,
+		u32 sectorBytes)
+	{
+		struct amigaPartGeometry *g;
+		size_t len = strlen(name);
 
-			res = m_io->readBlock(&blockBuffer, block);
-			if (res)
-			{
-				p = (struct partitionBlock *)blockBuffer;
-				if (fe32(p->id) == AMIGA_ID_PART)
-				{
-					if (sumBlock((struct blockHeader *)p) == 0)
-					{
-						// m_messenger->textInfo("Creating a new volume structure to describe partition\n");
-
-						m_partBlock = new struct partitionBlock;
-
-						if (!m_partBlock)
-							throw 0xFFFFFFFF;
-
-						memcpy(m_partBlock, p, sizeof(struct partitionBlock));
-						block = fe32(p->next);
-
-						try
-						{
-							m_nextVol = new Volume(io, messenger, ro, rdb, block);
-						}
-						catch(u32 E)
-						{
-							if (m_nextVol)
-							{
-								delete m_nextVol;
-								m_nextVol = nullptr;
-							}
-						}
-						return;
-					}
-				}
-			}
-		}
-		throw (u32)0xFFFFFFFF;
+		m_messenger = messenger;
+		m_nextVol = nullptr;
+		m_ro = ro;
+		m_io = io;
+
+		m_partBlock = new struct partitionBlock;
+		m_ownPart = true;
+		memset(m_partBlock, 0, sizeof(struct partitionBlock));
+		m_partBlock->id = fe32(AMIGA_ID_PART);
+		m_partBlock->summedLongs = fe32(sizeof(struct partitionBlock) / 4);
+		m_partBlock->next = 0xFFFFFFFF;
+
+		if (len > sizeof(m_partBlock->driveName) - 1)
+			len = sizeof(m_partBlock->driveName) - 1;
+		m_partBlock->driveName[0] = len;
+		memcpy(&m_partBlock->driveName[1], name, len);
+
+		g = (struct amigaPartGeometry *)&(m_partBlock->environment);
+		g->tableSize = fe32(16);
+		g->sizeBlocks = fe32(sectorBytes / 4);
+		g->surfaces = fe32(heads);
+		g->sectorPerBlock = fe32(1);
+		g->blockPerTrack = fe32(sectors);
+		g->reserved = fe32(2);
+		g->lowCyl = fe32(lowCyl);
+		g->highCyl = fe32(highCyl);
+		g->dosType = fe32(dosType);
+
+		m_strings = new stringStore();
+		setGeometry(sectorBytes);
 	}
 
 	Volume::~Volume()
@@ -379,11 +589,9 @@ namespace amigadrive
 			m_nextVol = nullptr;
 		}
 
-		if (m_partBlock)
-		{
+		if (m_partBlock && m_ownPart)
 			delete m_partBlock;
-			m_partBlock = nullptr;
-		}
+		m_partBlock = nullptr;
 
 		if (m_strings)
 		{
@@ -410,13 +618,9 @@ namespace amigadrive
 		Volume *V;
 		int I;
 
-		if (m_rdb)
-		{
-			for (I=0, V=m_firstVol; V; V=V->m_nextVol)
-				I++;
-			return I;
-		}
-		return 0;
+		for (I=0, V=m_firstVol; V; V=V->m_nextVol)
+			I++;
+		return I;
 	}
 
 	Volume *Device::volumeNumber(int partition)
@@ -439,7 +643,7 @@ namespace amigadrive
 
 	Device::Device(DeviceIO *io, UI *messenger, const char *devName, bool readOnly)
 	{
-		g_littleEndian = isLittleEndian();
+		TraceSpan span("open", "device");
 
 		m_strings = new stringStore();
 
@@ -447,33 +651,67 @@ namespace amigadrive
 		assert(io);
 		m_rdb = nullptr;
 		m_bootcode = nullptr;
+		m_floppy = nullptr;
+		m_badBlocks = nullptr;
+		m_rdbBlocks = nullptr;
+		m_blockBytes = BLOCKSIZE;
+		m_kernels = blockKernels(BLOCKSIZE);
 		m_firstVol = nullptr;
+		m_recovered = false;
+		m_header = nullptr;
+		m_headerBlocks = 0;
+		m_statsEnabled = false;
+		m_journal = nullptr;
+		m_verify = false;
+		m_copyNanos = 0;
+		m_copyIONanos = 0;
 		m_messenger = messenger;
 		m_io = io;
 		m_ro = readOnly;
-		m_io->initDriver(messenger, devName, readOnly);
+		{
+			TraceSpan span("initDriver", "device");
+			m_io->initDriver(messenger, devName, readOnly);
+		}
+
+		// diskette images are small enough to hold in memory, and are read in one go
+		m_drvType = floppyType(blockCount() * BLOCKSIZE);
+		if (m_drvType != HARD_DRIVE)
+			loadFloppy();
+
+		{
+			TraceSpan span("rdb probe", "device");
+
+			m_header = new Block[AMIGA_HEADER_SECTORS];
+			m_headerBlocks = readHeader();
+
+			// look for a rigid disk block - returns null if not found
+			m_rdb = getRDB();
+			if (m_rdb)
+				m_rdbBlocks = new RDBBlocks(m_io, m_rdb, m_blockBytes, m_header, m_headerBlocks);
+		}
 
-		// look for a rigid disk block - returns null if not found
-		m_rdb = getRDB();
 		if (m_rdb)
 		{
-			u32 block;
+			TraceSpan span("partition chain", "device");
+			RDBChain chain(m_rdbBlocks, fe32(m_rdb->partitionList), AMIGA_ID_PART);
+			Volume **link = &m_firstVol;
+			u8 *part;
 
 			m_drvType = HARD_DRIVE;
-			block = fe32(m_rdb->partitionList);
-			try
-			{
-				m_firstVol = new Volume(m_io, m_messenger, m_ro, m_rdb, block);
-			}
-			catch(u32 E)
+			loadBadBlocks();
+
+			while ((part = chain.next()) != nullptr)
 			{
-				if (m_firstVol)
-				{
-					delete m_firstVol;
-					m_firstVol = nullptr;
-				}
+				*link = new Volume(m_io, m_messenger, m_ro, (struct partitionBlock *)part, m_blockBytes);
+				link = &(*link)->m_nextVol;
 			}
+
+			loadFileSystems();
 		}
+		else if (m_drvType != HARD_DRIVE)
+			makeFloppyVolume();
+		else
+			makeBareVolume();
 
 		// look for bootcode - returns null if not found
 		m_bootcode = getBootCode();
@@ -483,12 +721,40 @@ namespace amigadrive
 
 	Device::~Device()
 	{
+		if (m_badBlocks)
+		{
+			m_io->m_remap = nullptr;
+			delete m_badBlocks;
+			m_badBlocks = nullptr;
+		}
+
 		m_io = nullptr;
 		m_messenger = nullptr;
-		if (m_bootcode)
+		if (m_firstVol)
 		{
-			delete m_bootcode;
-			m_bootcode = nullptr;
+			delete m_firstVol;
+			m_firstVol = nullptr;
+		}
+
+		if (m_floppy)
+		{
+			delete m_floppy;
+			m_floppy = nullptr;
+		}
+
+		// the volumes and the boot code are views into these
+		m_bootcode = nullptr;
+		m_fileSystems.clear();
+		if (m_rdbBlocks)
+		{
+			delete m_rdbBlocks;
+			m_rdbBlocks = nullptr;
+		}
+
+		if (m_header)
+		{
+			delete [] m_header;
+			m_header = nullptr;
 		}
 
 		if (m_rdb)
@@ -504,112 +770,903 @@ namespace amigadrive
 		}
 	}
 
-	bool Device::blockCopyOut(const char *outfile, s64 begin, s64 size)
+	/*
+	 * Walk the RDB's chain of BADB blocks and hand the remappings they list to the
+	 * driver. A broken chain keeps what was read before the break. The BADB blocks
+	 * themselves are read before the map is in place, as they have to be.
+	 */
+	void Device::loadBadBlocks(void)
 	{
-		s64 onepercent = size / 100;
-		Block copyBuffer;
-		s64 blocks = size;
-		s64 i = begin;
-		FILE *o;
+		RDBChain chain(m_rdbBlocks, fe32(m_rdb->badBlockList), AMIGA_ID_BADB);
+		u32 perBlock = m_blockBytes / BLOCKSIZE;
+		BadBlockMap *map = new BadBlockMap();
+		u8 *p;
 
-		if (isPresent(outfile))
-			if (!isWriteable(outfile))
-				return false;
+		while ((p = chain.next()) != nullptr)
+		{
+			struct badBlockBlock *b = (struct badBlockBlock *)p;
+			struct badBlockEntry *e = b->blockPairs;
+			u32 longs = fe32(b->summedLongs);
+			u32 pairs = (longs > 6) ? (longs - 6) / 2 : 0;
+			u32 i;
+
+			for (i = 0; i < pairs; i++)
+				map->add((u64)fe32(e[i].badBlock) * perBlock, (u64)fe32(e[i].goodBlock) * perBlock, perBlock);
+		}
 
-		o=fopen(outfile, "w");
+		if (chain.broken())
+			m_messenger->textWarning("The bad block list is broken at block %u\n", chain.block());
 
-		while (blocks--)
+		map->seal();
+		if (map->entryCount())
 		{
-			m_io->readBlock(&copyBuffer, i++);
-			if (fwrite(&copyBuffer, sizeof(copyBuffer), 1, o) != 1)
-			{
-				fclose(o);
-				return false;
-			}
-			m_messenger->progressBar((size - blocks) / onepercent);
+			m_badBlocks = map;
+			m_io->m_remap = map;
 		}
-		fclose(o);
-		return true;
+		else
+			delete map;
 	}
 
-	bool Device::blockCopyIn(const char *infile, s64 begin, s64 size)
+	/*
+	 * Read the whole diskette image into memory with one request. From then on the
+	 * device works from the copy in memory, writing through to the image.
+	 */
+	void Device::loadFloppy(void)
 	{
-		s64 onepercent = size / 100;
-		Block copyBuffer;
-		s64 blocks = size;
-		s64 i = begin;
-		FILE *in;
-
-		if (isPresent(infile))
-			if (!isReadable(infile))
-				return false;
-
-		in=fopen(infile, "r");
+		TraceSpan span("floppy load", "device");
+		FloppyIO *floppy = new FloppyIO(m_io);
 
-		while (blocks--)
+		if (floppy->load())
 		{
-			if (fread(&copyBuffer, sizeof(copyBuffer), 1, in) != 1)
-			{
-				fclose(in);
-				return false;
-			}
-			m_io->writeBlock(&copyBuffer, i++);
-			m_messenger->progressBar((size - blocks) / onepercent);
+			m_floppy = floppy;
+			m_io = floppy;
 		}
-		fclose(in);
-		return true;
+		else
+			delete floppy;
 	}
 
-	bool Device::partCopyOut(const char *outfile, int partition)
+	/*
+	 * A diskette has no partition table: it's one volume filling the disk, with
+	 * its file system type in the boot block.
+	 */
+	void Device::makeFloppyVolume(void)
 	{
-		s64 onepercent;
-		Block copyBuffer;
-		s64 blocks, size;
-		Volume *V;
-		s64 i;
-		FILE *o;
+		u32 sectors = (m_drvType == DD_DISKETTE) ? ADF_DD_SECTORS : ADF_HD_SECTORS;
 
-		if (isPresent(outfile))
-			if (!isWriteable(outfile))
-			{
-				m_messenger->textError("Can't write to [%s]\n", outfile);
-				return false;
-			}
+		if (m_headerBlocks < 1)
+			return;
+		m_firstVol = new Volume(m_io, m_messenger, m_ro, "DF0", be32(m_header[0]), ADF_HEADS, sectors, 0, ADF_CYLINDERS - 1);
+	}
 
-		V = volumeNumber(partition);
+	/*
+	 * The root block of an AmigaDOS file system is in the middle of it. It's a
+	 * header block (type 2) of secondary type root (1), with a hash table filling
+	 * all but 56 longwords of the block, and the whole block sums to zero.
+	 */
+	static bool isRootBlock(const u8 *block, u32 blockBytes)
+	{
+		return be32(block) == 2 && be32(block + blockBytes - 4) == 1 && be32(block + 12) == blockBytes / 4 - 56 &&
+			blockKernels(blockBytes)->sum(block, blockBytes) == 0;
+	}
 
-		if (!V)
-		{
-			return false;
-		}
+	/*
+	 * With neither an RDB nor a diskette's size, the device may be a bare file system
+	 * - a partition dumped on its own, as emulators use for hardfiles. Those start with
+	 * a DOS\x boot block and have their root block in the middle. Each file system
+	 * block size puts the middle somewhere else, so the check costs one read per size
+	 * tried, and the first size with a root block there wins. Nothing else is scanned.
+	 * A stream of unknown size has no middle to look in, so it's never taken for one.
+	 */
+	bool Device::makeBareVolume(void)
+	{
+		u32 dosType, bytes, perBlock, heads, sectors;
+		u64 blocks, root;
+		bool found = false;
+		Block *buffer;
 
-		size = blocks = V->volBlockCount();
-		i = V->volStartBlock();
-		onepercent = blocks / 100;
+		if (m_headerBlocks < 1 || m_io->m_sequential)
+			return false;
 
-		o=fopen(outfile, "w");
+		dosType = be32(m_header[0]);
+		if ((dosType & 0xFFFFFF00) != 0x444F5300 || (dosType & 0xFF) > 7)
+			return false;
 
-		while (blocks--)
+		buffer = new Block[MAX_BLOCKBYTES / BLOCKSIZE];
+		for (bytes = BLOCKSIZE; bytes <= MAX_BLOCKBYTES; bytes *= 2)
 		{
-			m_io->readBlock(&copyBuffer, i++);
-			if (fwrite(&copyBuffer, sizeof(copyBuffer), 1, o) != 1)
+			perBlock = bytes / BLOCKSIZE;
+			blocks = blockCount() / perBlock;
+			if (blocks < 3)
+				break;
+
+			// the two boot blocks are reserved, and the root is midway through the rest
+			root = (blocks - 1 + 2) / 2;
+			if (m_io->ioReadBlocks(buffer, root * perBlock, perBlock) && isRootBlock((u8 *)buffer, bytes))
 			{
-				fclose(o);
-				return false;
+				found = true;
+				break;
 			}
-			m_messenger->progressBar((size - blocks) / onepercent);
 		}
-		fclose(o);
+		delete [] buffer;
+
+		if (!found)
+			return false;
+
+		// hardfiles have no geometry of their own; emulators use one head of 32 sectors
+		if (blocks % 32 == 0 && blocks / 32 <= 0xFFFFFFFF)
+		{
+			heads = 1;
+			sectors = 32;
+		}
+		else if (blocks <= 0xFFFFFFFF)
+		{
+			heads = 1;
+			sectors = blocks;
+		}
+		else
+			return false;
+
+		m_firstVol = new Volume(m_io, m_messenger, m_ro, "DH0", dosType, heads, sectors, 0, blocks / heads / sectors - 1, bytes);
 		return true;
 	}
 
-	// Checks whether the given file exist/is writeable/is a regular file
-	bool Device::isReadable(const char *fileName)
+	bool Device::isBareVolume(void)
 	{
-		struct stat s;
-		int rc, e;
+		return !m_rdb && m_drvType == HARD_DRIVE && m_firstVol;
+	}
 
-		assert(fileName);
+	DriveType Device::driveType(void)
+	{
+		return m_drvType;
+	}
+
+	BootClass Device::bootBlockClass(void)
+	{
+		if (m_headerBlocks < ADF_BOOTBLOCK_BYTES / BLOCKSIZE)
+			return BOOT_NDOS;
+		return classifyBootBlock(m_header[0]);
+	}
+
+	/*
+	 * Moves count blocks between a copy buffer and an input or output file,
+	 * timing the transfer if statistics are being collected.
+	 */
+	bool Device::fileTransfer(IOStats::Direction dir, FILE *f, Block *buffer, u64 fileBlock, u64 count)
+	{
+		std::chrono::steady_clock::time_point t0;
+		bool ok;
+
+		if (m_statsEnabled)
+			t0 = std::chrono::steady_clock::now();
+
+		if (dir == IOStats::READ)
+			ok = fread(buffer, sizeof(Block), count, f) == count;
+		else
+			ok = fwrite(buffer, sizeof(Block), count, f) == count;
+
+		if (m_statsEnabled)
+			m_fileStats.record(dir, fileBlock, count,
+				std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count(), ok);
+		return ok;
+	}
+
+	u64 Device::ioNanos(void)
+	{
+		return m_ioStats.counters(IOStats::READ).nanos + m_ioStats.counters(IOStats::WRITE).nanos +
+			m_fileStats.counters(IOStats::READ).nanos + m_fileStats.counters(IOStats::WRITE).nanos;
+	}
+
+	u64 Device::blockCount(void)
+	{
+		return m_io->m_sectorCount;
+	}
+
+	bool Device::readBlocks(Block *readBuffer, u64 blockNumber, u64 count)
+	{
+		if (!rangeValid(blockNumber, count))
+			return false;
+		return m_io->ioReadBlocks(readBuffer, blockNumber, count);
+	}
+
+	bool Device::writeBlocks(Block *writeBuffer, u64 blockNumber, u64 count)
+	{
+		if (m_ro)
+		{
+			m_messenger->textError("The device was opened read-only\n");
+			return false;
+		}
+		if (!rangeValid(blockNumber, count))
+			return false;
+		return m_io->ioWriteBlocks(writeBuffer, blockNumber, count);
+	}
+
+	/*
+	 * The volumes own their copies of the PART blocks, as there are no RDB blocks
+	 * cached for them to be views of.
+	 */
+	void Device::usePartitions(const std::vector<struct partitionBlock> &parts)
+	{
+		Volume **link;
+
+		if (m_firstVol)
+		{
+			delete m_firstVol;
+			m_firstVol = nullptr;
+		}
+
+		link = &m_firstVol;
+		for (const struct partitionBlock &p : parts)
+		{
+			struct partitionBlock *part = new struct partitionBlock;
+
+			memcpy(part, &p, sizeof(struct partitionBlock));
+			*link = new Volume(m_io, m_messenger, m_ro, part, BLOCKSIZE);
+			(*link)->m_ownPart = true;
+			link = &(*link)->m_nextVol;
+		}
+		m_drvType = HARD_DRIVE;
+		m_recovered = true;
+	}
+
+	u32 Device::sectorBytes(void)
+	{
+		return m_io->m_sectorBytes;
+	}
+
+	u32 Device::physicalSectorBytes(void)
+	{
+		return m_io->m_physSectorBytes;
+	}
+
+	u32 Device::blockBytes(void)
+	{
+		return m_blockBytes;
+	}
+
+	void Device::enableStats(void)
+	{
+		Volume *V;
+
+		if (m_statsEnabled)
+			return;
+
+		for (V = m_firstVol; V; V = V->m_nextVol)
+			m_ioStats.addChild(V->volStartBlock(), V->volBlockCount(), &V->m_stats);
+
+		m_io->m_stats = &m_ioStats;
+		m_statsEnabled = true;
+	}
+
+	IOStats *Device::ioStats(void)
+	{
+		return &m_ioStats;
+	}
+
+	IOStats *Device::fileStats(void)
+	{
+		return &m_fileStats;
+	}
+
+	void Device::dumpStats(void)
+	{
+		Volume *V;
+		int I;
+
+		m_ioStats.dump(m_messenger, "device");
+
+		for (I = 1, V = m_firstVol; V; I++, V = V->m_nextVol)
+		{
+			char title[64];
+
+			snprintf(title, sizeof(title), "partition %d (%s)", I, V->volName());
+			V->m_stats.dump(m_messenger, title);
+		}
+
+		m_fileStats.dump(m_messenger, "copy input/output files");
+
+		if (m_copyNanos)
+			m_messenger->textInfo("Copy time %.3fs: %.3fs in device and file I/O, %.3fs (%.1f%%) elsewhere\n",
+				m_copyNanos / 1e9, m_copyIONanos / 1e9, (m_copyNanos - m_copyIONanos) / 1e9,
+				100.0 * (m_copyNanos - m_copyIONanos) / m_copyNanos);
+	}
+
+	/*
+	 * Copies refuse ranges which aren't on the device rather than quietly copying
+	 * whatever part of them is.
+	 */
+	bool Device::rangeValid(s64 begin, s64 count)
+	{
+		if (begin < 0 || count < 0 || (u64)begin > blockCount() || (u64)count > blockCount() - begin)
+		{
+			m_messenger->textError("Blocks %ld to %ld aren't on the device, which has %lu blocks\n", begin, begin + count - 1, blockCount());
+			return false;
+		}
+		return true;
+	}
+
+	void Device::progress(s64 done, s64 size)
+	{
+		m_messenger->progressBar(size > 0 ? (int)(done * 100 / size) : 100);
+	}
+
+	/*
+	 * Copy buffers are page aligned, so drivers doing direct I/O can use them as they are.
+	 */
+	static Block *newCopyBuffer(void)
+	{
+		void *p;
+
+		if (posix_memalign(&p, 4096, COPY_CHUNK * sizeof(Block)) != 0)
+			return nullptr;
+		return (Block *)p;
+	}
+
+	/*
+	 * Large copies shouldn't push the working set of everything else on the host
+	 * out of the page cache. For the file side of a copy: once a chunk is
+	 * processed, start writing it back if it was written, and drop whatever is
+	 * CACHE_WINDOW behind it, waiting for its writeback to finish if need be.
+	 */
+	static void releaseFileRange(int fd, u64 offset, u64 len, bool written)
+	{
+#if defined(POSIX_FADV_DONTNEED) && defined(SYNC_FILE_RANGE_WRITE)
+		if (written)
+			sync_file_range(fd, offset, len, SYNC_FILE_RANGE_WRITE);
+
+		if (offset < CACHE_WINDOW)
+			return;
+		offset -= CACHE_WINDOW;
+
+		if (written)
+			sync_file_range(fd, offset, len, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+		posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED);
+#endif
+	}
+
+	static void releaseFileRange(FILE *f, u64 offset, u64 len, bool written)
+	{
+		if (written)
+			fflush(f);
+		releaseFileRange(fileno(f), offset, len, written);
+	}
+
+	static void adviseFileSequential(int fd)
+	{
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	}
+
+	/*
+	 * An output file named "-" is standard output, which may well be a pipe. It's
+	 * flushed rather than closed when the copy is done.
+	 */
+	static bool isStdout(const char *fileName)
+	{
+		return !strcmp(fileName, "-");
+	}
+
+	static int closeOutput(FILE *f)
+	{
+		return (f == stdout) ? fflush(f) : fclose(f);
+	}
+
+	/*
+	 * Read part of an output file back from the disk rather than from the page cache:
+	 * it's written back and dropped from the cache first. Anything past the end of
+	 * the file reads as zeroes - it's a hole the copy's final truncate takes in.
+	 */
+	static bool rereadFile(int fd, Block *buffer, u64 offset, u64 len)
+	{
+		u8 *p = (u8 *)buffer;
+		u64 got = 0;
+		ssize_t r;
+
+#if defined(POSIX_FADV_DONTNEED) && defined(SYNC_FILE_RANGE_WRITE)
+		sync_file_range(fd, offset, len, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+		posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED);
+#endif
+
+		while (got < len && (r = pread(fd, p + got, len - got, offset + got)) != 0)
+		{
+			if (r < 0 && errno != EINTR)
+				return false;
+			if (r > 0)
+				got += r;
+		}
+		memset(p + got, 0, len - got);
+		return true;
+	}
+
+	/*
+	 * True if count blocks of a copy buffer are all zeroes. The test goes a block
+	 * of the given size at a time, so it runs the kernel specialised for that size.
+	 */
+	static bool zeroBlocks(const BlockKernels *kernels, u32 blockBytes, Block *buffer, s64 count)
+	{
+		const BlockKernels *small = blockKernels(BLOCKSIZE);
+		u8 *p = (u8 *)buffer;
+		u64 bytes = count * BLOCKSIZE;
+		u64 i;
+
+		for (i = 0; i + blockBytes <= bytes; i += blockBytes)
+			if (!kernels->isZero(p + i, blockBytes))
+				return false;
+
+		for (; i < bytes; i += BLOCKSIZE)
+			if (!small->isZero(p + i, BLOCKSIZE))
+				return false;
+		return true;
+	}
+
+	/*
+	 * Copy a range into a file inside the kernel, when the driver can. Journalled
+	 * and verified copies need the data in our hands, so they never come here.
+	 * Large copies get the same advice as the buffered ones. Returns 1 if the copy
+	 * was made, 0 if it failed and -1 if it can't be made this way. The buffered
+	 * copy then starts the file over.
+	 */
+	int Device::copyRangeOut(const char *outfile, s64 begin, s64 size)
+	{
+		TraceSpan span("copyRangeOut", "copy", begin);
+		bool large = size >= LARGE_COPY;
+		s64 done = 0;
+		bool ok = true;
+		int fd;
+
+		if (m_io->m_sequential || m_io->m_remap)
+			return -1;
+
+		fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fd < 0)
+		{
+			m_messenger->textError("Can't open [%s] for writing\n", outfile);
+			return 0;
+		}
+
+		if (large)
+		{
+			m_io->adviseSequential(begin, size);
+			adviseFileSequential(fd);
+		}
+
+		while (ok && done < size)
+		{
+			s64 n = (size - done < RANGE_CHUNK) ? size - done : RANGE_CHUNK;
+			s64 copied;
+
+			{
+				TraceSpan span("copy", "chunk", begin + done);
+				copied = m_io->ioCopyToFile(fd, done * BLOCKSIZE, begin + done, n);
+			}
+
+			if (copied < 0)
+			{
+				close(fd);
+				return -1;
+			}
+
+			ok = copied == n;
+			if (!ok)
+				m_messenger->textError("Couldn't copy blocks %ld to %ld to [%s]\n", begin + done, begin + done + n - 1, outfile);
+
+			if (ok && large)
+			{
+				m_io->adviseDone(begin + done, n, false);
+				releaseFileRange(fd, done * BLOCKSIZE, n * BLOCKSIZE, true);
+			}
+
+			done += n;
+			progress(done, size);
+		}
+
+		// holes at the end don't extend the file by themselves
+		if (ok)
+			ok = ftruncate(fd, size * BLOCKSIZE) == 0;
+		if (close(fd) != 0)
+			ok = false;
+		return ok ? 1 : 0;
+	}
+
+	/*
+	 * The copies move COPY_CHUNK blocks per request in each direction, and
+	 * stop at the first block which can't be read or written. Copies of
+	 * LARGE_COPY blocks or more advise the kernel that both sides are streamed
+	 * and drop the pages behind them from the cache as they go. Chunks which are
+	 * all zeroes are seeked over rather than written, leaving holes in the output.
+	 * Where the output can't seek - standard output to a pipe - they're written,
+	 * and so they are over what a resumed copy's output already held, which may
+	 * be stale data in the chunk the copy goes back to.
+	 *
+	 * With a journal set, each JOURNAL_CHUNK copied is recorded there with its
+	 * CRC, and a copy started again over a journal picks up where it left off.
+	 * With verify set, each chunk written is read back while the next is copied,
+	 * and any blocks which differ are reported.
+	 */
+	bool Device::blockCopyOut(const char *outfile, s64 begin, s64 size)
+	{
+		CopyTimer T(this);
+		TraceSpan span("blockCopyOut", "copy", begin);
+		bool large = size >= LARGE_COPY;
+		CopyJournal *J = nullptr;
+		CopyVerifier *V = nullptr;
+		Block *copyBuffer;
+		s64 done = 0;
+		u32 crc = 0;
+		bool ok = true;
+		bool hole = false;
+		FILE *o = nullptr;
+		// the blocks of the output a resumed copy finds there
+		s64 stale = 0;
+
+		if (!rangeValid(begin, size))
+			return false;
+
+		if (!isStdout(outfile) && isPresent(outfile))
+			if (!isWriteable(outfile))
+				return false;
+
+		if (m_verify && isStdout(outfile))
+		{
+			m_messenger->textError("A copy to stdout can't be read back, so it can't be verified\n");
+			return false;
+		}
+
+		if (!m_journal && !m_verify && !isStdout(outfile))
+		{
+			int copied = copyRangeOut(outfile, begin, size);
+
+			if (copied >= 0)
+				return copied == 1;
+		}
+
+		if (m_journal)
+		{
+			if (isStdout(outfile))
+			{
+				m_messenger->textError("A copy to stdout can't be resumed, so it can't have a journal\n");
+				return false;
+			}
+
+			J = new CopyJournal(m_messenger);
+			if (!J->open(m_journal, "out", begin, size))
+			{
+				delete J;
+				return false;
+			}
+
+			// resuming, so what's already there has to be kept
+			if (J->recordedChunks())
+			{
+				struct stat st;
+
+				o = fopen(outfile, "r+");
+				if (o)
+					stale = (fstat(fileno(o), &st) == 0) ? (st.st_size + BLOCKSIZE - 1) / BLOCKSIZE : size;
+			}
+		}
+
+		// verifying reads the file back, so it needs opening for reading as well
+		if (!o)
+			o = isStdout(outfile) ? stdout : fopen(outfile, m_verify ? "w+" : "w");
+		if (!o)
+		{
+			m_messenger->textError("Can't open [%s] for writing\n", outfile);
+			delete J;
+			return false;
+		}
+
+		copyBuffer = newCopyBuffer();
+		if (!copyBuffer)
+		{
+			closeOutput(o);
+			delete J;
+			return false;
+		}
+
+		if (J)
+		{
+			done = resumeCopy(J, o, begin, size, copyBuffer);
+			ok = J->start(done / JOURNAL_CHUNK) && fseeko(o, done * BLOCKSIZE, SEEK_SET) == 0;
+			progress(done, size);
+		}
+
+		if (m_verify)
+			V = new CopyVerifier(m_messenger, begin, [o](Block *buffer, s64 block, s64 count)
+			{
+				return rereadFile(fileno(o), buffer, block * BLOCKSIZE, count * BLOCKSIZE);
+			});
+
+		if (large)
+		{
+			m_io->adviseSequential(begin, size);
+			adviseFileSequential(fileno(o));
+		}
+
+		while (ok && done < size)
+		{
+			s64 n = (size - done < COPY_CHUNK) ? size - done : COPY_CHUNK;
+
+			{
+				TraceSpan span("read", "chunk", begin + done);
+				ok = m_io->ioReadBlocks(copyBuffer, begin + done, n);
+				if (!ok)
+					m_messenger->textError("Couldn't read blocks %ld to %ld\n", begin + done, begin + done + n - 1);
+			}
+
+			if (ok && J)
+				crc = crc32Update(crc, copyBuffer, n * BLOCKSIZE);
+
+			hole = ok && done >= stale && zeroBlocks(m_kernels, m_blockBytes, copyBuffer, n) &&
+				fseeko(o, n * BLOCKSIZE, SEEK_CUR) == 0;
+
+			if (ok && !hole)
+			{
+				TraceSpan span("write", "chunk", begin + done);
+				ok = fileTransfer(IOStats::WRITE, o, copyBuffer, done, n);
+				if (!ok)
+					m_messenger->textError("Couldn't write blocks %ld to %ld to [%s]\n", begin + done, begin + done + n - 1, outfile);
+			}
+
+			// the verifier reads the file itself, so the chunk has to be out of stdio
+			if (ok && V && (ok = fflush(o) == 0))
+				V->submit(copyBuffer, done, n);
+
+			if (ok && J && ((done + n) % JOURNAL_CHUNK == 0 || done + n == size))
+			{
+				ok = fflush(o) == 0 && J->record(crc);
+				crc = 0;
+			}
+
+			if (ok && large)
+			{
+				m_io->adviseDone(begin + done, n, false);
+				releaseFileRange(o, done * BLOCKSIZE, n * BLOCKSIZE, true);
+			}
+
+			done += n;
+			progress(done, size);
+		}
+
+		if (V)
+		{
+			if (!V->finish())
+				ok = false;
+			delete V;
+		}
+
+		{
+			TraceSpan span("flush", "copy");
+
+			// a hole at the end doesn't extend the file by itself, and a resumed
+			// copy may be over a longer file
+			if (ok && (hole || J))
+				ok = fflush(o) == 0 && ftruncate(fileno(o), size * BLOCKSIZE) == 0;
+			if (closeOutput(o) != 0)
+				ok = false;
+		}
+
+		finishJournal(J, ok);
+		free(copyBuffer);
+		return ok;
+	}
+
+	bool Device::blockCopyIn(const char *infile, s64 begin, s64 size)
+	{
+		CopyTimer T(this);
+		TraceSpan span("blockCopyIn", "copy", begin);
+		bool large = size >= LARGE_COPY;
+		CopyJournal *J = nullptr;
+		CopyVerifier *V = nullptr;
+		Block *copyBuffer;
+		s64 done = 0;
+		u32 crc = 0;
+		bool ok = true;
+		FILE *in;
+
+		if (!rangeValid(begin, size))
+			return false;
+
+		if (isPresent(infile))
+			if (!isReadable(infile))
+				return false;
+
+		in=fopen(infile, "r");
+		if (!in)
+		{
+			m_messenger->textError("Can't open [%s] for reading\n", infile);
+			return false;
+		}
+
+		copyBuffer = newCopyBuffer();
+		if (!copyBuffer)
+		{
+			fclose(in);
+			return false;
+		}
+
+		if (m_journal)
+		{
+			J = new CopyJournal(m_messenger);
+			if (!J->open(m_journal, "in", begin, size))
+			{
+				delete J;
+				fclose(in);
+				free(copyBuffer);
+				return false;
+			}
+
+			done = resumeCopy(J, nullptr, begin, size, copyBuffer);
+			ok = J->start(done / JOURNAL_CHUNK) && fseeko(in, done * BLOCKSIZE, SEEK_SET) == 0;
+			progress(done, size);
+		}
+
+		// the written range is pushed out of the cache, so it's read back from the medium
+		if (m_verify)
+			V = new CopyVerifier(m_messenger, begin, [this, begin](Block *buffer, s64 block, s64 count)
+			{
+				m_io->adviseDone(begin + block, count, true);
+				return m_io->ioReadBlocks(buffer, begin + block, count);
+			});
+
+		if (large)
+		{
+			m_io->adviseSequential(begin, size);
+			adviseFileSequential(fileno(in));
+		}
+
+		while (ok && done < size)
+		{
+			s64 n = (size - done < COPY_CHUNK) ? size - done : COPY_CHUNK;
+
+			{
+				TraceSpan span("read", "chunk", begin + done);
+				ok = fileTransfer(IOStats::READ, in, copyBuffer, done, n);
+				if (!ok)
+					m_messenger->textError("[%s] ends or can't be read at block %ld of %ld\n", infile, done, size);
+			}
+
+			if (ok)
+			{
+				TraceSpan span("write", "chunk", begin + done);
+				ok = m_io->ioWriteBlocks(copyBuffer, begin + done, n);
+				if (!ok)
+					m_messenger->textError("Couldn't write blocks %ld to %ld\n", begin + done, begin + done + n - 1);
+			}
+
+			if (ok && V)
+				V->submit(copyBuffer, done, n);
+
+			if (ok && J)
+			{
+				crc = crc32Update(crc, copyBuffer, n * BLOCKSIZE);
+				if ((done + n) % JOURNAL_CHUNK == 0 || done + n == size)
+				{
+					ok = J->record(crc);
+					crc = 0;
+				}
+			}
+
+			if (ok && large)
+			{
+				m_io->adviseDone(begin + done, n, true);
+				releaseFileRange(in, done * BLOCKSIZE, n * BLOCKSIZE, false);
+			}
+
+			done += n;
+			progress(done, size);
+		}
+		fclose(in);
+
+		if (V)
+		{
+			if (!V->finish())
+				ok = false;
+			delete V;
+		}
+
+		finishJournal(J, ok);
+		free(copyBuffer);
+		return ok;
+	}
+
+	/*
+	 * Check the chunks an earlier run of a copy recorded against what's on its target
+	 * now - the output file, or the device if there's no file - and return the number
+	 * of blocks which can be kept. It stops at the first chunk which doesn't match,
+	 * which is usually the last one recorded, cut short by whatever stopped the copy.
+	 */
+	s64 Device::resumeCopy(CopyJournal *J, FILE *file, s64 begin, s64 size, Block *buffer)
+	{
+		TraceSpan span("resume", "copy", begin);
+		u64 chunk, chunks = J->recordedChunks();
+		s64 pos = 0;
+
+		for (chunk = 0; chunk < chunks && pos < size; chunk++)
+		{
+			s64 end = (size - pos < JOURNAL_CHUNK) ? size : pos + JOURNAL_CHUNK;
+			u32 crc = 0;
+
+			while (pos < end)
+			{
+				s64 n = (end - pos < COPY_CHUNK) ? end - pos : COPY_CHUNK;
+
+				if (file)
+				{
+					// holes at the end of the file aren't there until the copy finishes
+					ssize_t got = pread(fileno(file), buffer, n * BLOCKSIZE, pos * BLOCKSIZE);
+
+					if (got < 0)
+						break;
+					memset((u8 *)buffer + got, 0, n * BLOCKSIZE - got);
+				}
+				else if (!m_io->ioReadBlocks(buffer, begin + pos, n))
+					break;
+
+				crc = crc32Update(crc, buffer, n * BLOCKSIZE);
+				pos += n;
+			}
+
+			if (pos < end || crc != J->chunkHash(chunk))
+				break;
+		}
+
+		pos = (chunk * JOURNAL_CHUNK < (u64)size) ? chunk * JOURNAL_CHUNK : size;
+		if (chunks)
+			m_messenger->textInfo("Resuming at block %ld, %lu of %lu journalled chunks verified\n", begin + pos, chunk, chunks);
+		return pos;
+	}
+
+	void Device::finishJournal(CopyJournal *J, bool ok)
+	{
+		if (!J)
+			return;
+
+		if (ok)
+			J->finish();
+		else
+			m_messenger->textError("Run the copy again with journal [%s] to resume it\n", m_journal);
+		delete J;
+	}
+
+	void Device::setJournal(const char *journalFile)
+	{
+		m_journal = journalFile;
+	}
+
+	void Device::setVerify(bool verify)
+	{
+		m_verify = verify;
+	}
+
+	bool Device::partCopyOut(const char *outfile, int partition)
+	{
+		Volume *V;
+
+		if (!isStdout(outfile) && isPresent(outfile))
+			if (!isWriteable(outfile))
+			{
+				m_messenger->textError("Can't write to [%s]\n", outfile);
+				return false;
+			}
+
+		V = volumeNumber(partition);
+
+		if (!V)
+		{
+			return false;
+		}
+
+		return blockCopyOut(outfile, V->volStartBlock(), V->volBlockCount());
+	}
+
+	// Checks whether the given file exist/is writeable/is a regular file
+	bool Device::isReadable(const char *fileName)
+	{
+		struct stat s;
+		int rc, e;
+
+		assert(fileName);
 
 		if (*fileName == '\0')
 		{
@@ -708,21 +1765,71 @@ namespace amigadrive
 		return false;
 	}
 
+	void Device::printVolumes(void)
+	{
+		Volume *V; int I;
+
+		for (I=1, V = m_firstVol; V; I++, V = V->m_nextVol)
+		{
+			m_messenger->textInfo("\t\t%d. %s partion, start [%ld], count [%ld], type [%s]...\n", I, V->volName(), V->volStartBlock(), V->volBlockCount(), V->volType());
+			if (V->volBytesPerBlock() != BLOCKSIZE || V->volSectorBytes() != BLOCKSIZE)
+				m_messenger->textInfo("\t\t   %ld byte blocks of %u byte sectors\n", V->volBytesPerBlock(), V->volSectorBytes());
+
+			DiskLabel L(V, m_messenger);
+
+			if (!m_io->m_sequential && L.read())
+				for (const BSDSlice &s : L.slices())
+					m_messenger->textInfo("\t\t   %s slice %c, start [%lu], count [%lu], %s\n", L.hasLabel() ? "disklabel" : "NetBSD",
+						s.letter, s.start, s.count, DiskLabel::fsTypeName(s.fsType));
+		}
+	}
+
 	void Device::About(void)
 	{
+		if (m_io->m_sequential)
+			m_messenger->textInfo("Device is a stream of unknown size, sectors %u bytes\n", sectorBytes());
+		else
+			m_messenger->textInfo("Device is %lu blocks, sectors %u bytes (%u physical)\n", blockCount(), sectorBytes(), physicalSectorBytes());
 		if (m_rdb)
 		{
 			m_messenger->textInfo("Device has:\n\ta rigid disk block\n");
+			if (m_recovered)
+				m_messenger->textInfo("\tpartitions recovered by a sweep of the device, not read from the RDB\n");
 			m_messenger->textInfo("\tblock size %d\n", fe32(m_rdb->blockBytes));
 			m_messenger->textInfo("\tphysical C/H/S %d, %d, %d\n", fe32(m_rdb->cylinders), fe32(m_rdb->heads), fe32(m_rdb->sectors));
 			m_messenger->textInfo("\t%d partitions\n", volumeCount());
+			printVolumes();
+			if (fe32(m_rdb->rdbBlocksHi))
+				m_messenger->textInfo("\tRDB area blocks %u to %u\n", fe32(m_rdb->rdbBlocksLo), fe32(m_rdb->rdbBlocksHi));
+			if (m_badBlocks)
+				m_messenger->textInfo("\t%lu bad blocks remapped\n", m_badBlocks->blockCount());
+			for (int I = 1; I <= fileSystemCount(); I++)
 			{
-				Volume *V; int I;
-
-				for (I=1, V = m_firstVol; V; I++, V = V->m_nextVol)
-					m_messenger->textInfo("\t\t%d. %s partion, start [%ld], count [%ld], type [%s]...\n", I, V->volName(), V->volStartBlock(), V->volBlockCount(), V->volType());
+				const struct fileSysHeaderBlock *fs = fileSystemHeader(I);
+				std::vector<u8> code;
+				char type[6];
+
+				dosTypeString(type, fe32(fs->dosType));
+				fileSystemCode(I, code);
+				m_messenger->textInfo("\tfile system %s version %u.%u, %lu bytes of code\n", type,
+					fe32(fs->version) >> 16, fe32(fs->version) & 0xFFFF, code.size());
 			}
-			// m_messenger->textInfo("\tblock count %ld\n", ((((u64)fixEndian32(m_rdb->rdbBlocksHi)) << 32) | ((u64)fixEndian32(m_rdb->rdbBlocksLo))));
+		}
+		else if (m_drvType != HARD_DRIVE)
+		{
+			m_messenger->textInfo("Device is %s diskette image\n", m_drvType == DD_DISKETTE ? "a DD (880KB)" : "an HD (1.76MB)");
+			m_messenger->textInfo("\tboot block: %s\n", bootClassName(bootBlockClass()));
+			printVolumes();
+		}
+		else if (m_recovered)
+		{
+			m_messenger->textInfo("Device has no rigid disk block, and these partitions were recovered by a sweep of it:\n");
+			printVolumes();
+		}
+		else if (isBareVolume())
+		{
+			m_messenger->textInfo("Device is a bare file system image, without a rigid disk block\n");
+			printVolumes();
 		}
 	}
 }
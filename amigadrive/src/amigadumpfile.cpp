@@ -2,62 +2,321 @@
 #include "amigadumpfile.h"
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#ifndef O_DIRECT
+#define O_DIRECT 0
+#endif
+
+// direct I/O offsets, lengths and buffers are kept to at least this alignment
+#define DIRECT_ALIGN 4096
+// unaligned direct requests are bounced through a buffer of this size
+#define DIRECT_BOUNCE (1024 * 1024)
+
+// byte offsets on images of 2TB and more don't fit a 32 bit off_t
+static_assert(sizeof(off_t) >= 8, "build with -D_FILE_OFFSET_BITS=64");
 
 namespace amigadrive
 {
-	ADFIO::ADFIO()
+	ADFIO::ADFIO(bool directIO)
 	{
-		;
+		m_fd = -1;
+		m_directFd = -1;
+		m_direct = directIO;
+		m_fileBytes = 0;
+		m_align = DIRECT_ALIGN;
+	}
+
+	/*
+	 * Work out the size and sector sizes of what we've opened. Block devices
+	 * - disks, card readers, loop devices - are asked; for anything else the
+	 * size is the file size and the sectors are taken to be 512 bytes.
+	 */
+	void ADFIO::discoverGeometry(void)
+	{
+		struct stat s;
+
+		if (fstat(m_fd, &s) != 0)
+			return;
+
+		m_fileBytes = s.st_size;
+
+#ifdef __linux__
+		if (S_ISBLK(s.st_mode))
+		{
+			u64 bytes;
+			int logical, physical;
+
+			if (ioctl(m_fd, BLKGETSIZE64, &bytes) == 0)
+				m_fileBytes = bytes;
+			if (ioctl(m_fd, BLKSSZGET, &logical) == 0 && logical >= BLOCKSIZE)
+				m_sectorBytes = logical;
+			if (ioctl(m_fd, BLKPBSZGET, &physical) == 0 && (u32)physical >= m_sectorBytes)
+				m_physSectorBytes = physical;
+			else
+				m_physSectorBytes = m_sectorBytes;
+		}
+#endif
+
+		m_sectorCount = m_fileBytes / BLOCKSIZE;
+		m_drvArch = (m_sectorCount >> 32) ? DRV_64 : DRV_32;
+
+		// direct transfers have to honour the logical sector size, and we keep to
+		// physical sectors as well so 4K media never has to read-modify-write
+		while (m_align < m_physSectorBytes || m_align < m_sectorBytes)
+			m_align <<= 1;
 	}
 
 	void ADFIO::initDriver(UI *messenger, const char *devName, bool readOnly)
 	{
 		assert(messenger);
-		assert(m_drvArch == DRV_32);
 
 		m_messenger = messenger;
 
 		if (readOnly)
 		{
-			m_filePtr = fopen(devName, "r");
-			if (m_filePtr == nullptr)
+			m_fd = open(devName, O_RDONLY);
+			if (m_fd < 0)
 			{
 				throw Exception(m_messenger, "NativeDevice: unable to open readonly");
 			}
 		}
 		else
 		{
-			m_filePtr = fopen(devName, "r+");
-			if (m_filePtr == nullptr)
+			m_fd = open(devName, O_RDWR);
+			if (m_fd < 0)
 			{
 				throw Exception(m_messenger, "NativeDevice: unable to open readwrite");
 			}
 		}
+
+		discoverGeometry();
+
+		if (m_direct)
+		{
+			m_directFd = O_DIRECT ? open(devName, (readOnly ? O_RDONLY : O_RDWR) | O_DIRECT) : -1;
+			if (m_directFd < 0)
+				m_messenger->textWarning("ADFIO: direct I/O isn't available for [%s], using buffered I/O\n", devName);
+		}
 	}
 
 	ADFIO::~ADFIO()
 	{
-		if (m_filePtr != nullptr)
+		if (m_directFd >= 0)
+		{
+			close(m_directFd);
+			m_directFd = -1;
+		}
+
+		if (m_fd >= 0)
 		{
-			fclose(m_filePtr);
-			m_filePtr = nullptr;
+			close(m_fd);
+			m_fd = -1;
 		}
 	}
 
-	bool ADFIO::writeBlock(Block* writeBuffer, u64 blockNum)
+	/*
+	 * Positioned read or write of the whole range, carrying on after short transfers.
+	 * A transfer which makes no progress - the end of the file, or a full medium -
+	 * fails with errno set.
+	 */
+	static bool rawTransfer(int fd, bool write, u8 *buffer, u64 offset, u64 len)
 	{
 		s64 r;
-		lseek(fileno(m_filePtr), BLOCKSIZE * blockNum, SEEK_SET);
-		r = write(fileno(m_filePtr), writeBuffer, sizeof(Block));
-		return (r == 512 ? true : false);
+
+		while (len)
+		{
+			r = write ? pwrite(fd, buffer, len, offset) : pread(fd, buffer, len, offset);
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r == 0)
+				errno = write ? ENOSPC : EIO;
+			if (r <= 0)
+				return false;
+			buffer += r;
+			offset += r;
+			len -= r;
+		}
+		return true;
+	}
+
+	/*
+	 * Transfer through the O_DIRECT descriptor. Requests which are already aligned go
+	 * straight through; anything else is widened to aligned pieces and bounced, with a
+	 * read-modify-write for partial pieces being written. Returns false without
+	 * transferring anything if the aligned range would run past the end of the file,
+	 * which direct I/O can't reach - the caller then uses the buffered descriptor.
+	 */
+	bool ADFIO::directTransfer(bool write, u8 *buffer, u64 offset, u64 len)
+	{
+		u64 start = offset & ~(u64)(m_align - 1);
+		u64 end = (offset + len + m_align - 1) & ~(u64)(m_align - 1);
+		u64 pos, piece;
+		void *bounce;
+		bool ok = true;
+
+		if (end > m_fileBytes)
+			return false;
+
+		if (start == offset && end == offset + len && ((uintptr_t)buffer & (m_align - 1)) == 0)
+			return rawTransfer(m_directFd, write, buffer, offset, len);
+
+		if (posix_memalign(&bounce, m_align, DIRECT_BOUNCE) != 0)
+			return false;
+
+		for (pos = start; ok && pos < end; pos += piece)
+		{
+			u64 lo, hi;
+
+			piece = (end - pos < DIRECT_BOUNCE) ? end - pos : DIRECT_BOUNCE;
+			lo = (pos > offset) ? pos : offset;
+			hi = (pos + piece < offset + len) ? pos + piece : offset + len;
+
+			if (!write || lo > pos || hi < pos + piece)
+				ok = rawTransfer(m_directFd, false, (u8 *)bounce, pos, piece);
+
+			if (ok && write)
+			{
+				memcpy((u8 *)bounce + (lo - pos), buffer + (lo - offset), hi - lo);
+				ok = rawTransfer(m_directFd, true, (u8 *)bounce, pos, piece);
+			}
+			else if (ok)
+				memcpy(buffer + (lo - offset), (u8 *)bounce + (lo - pos), hi - lo);
+		}
+
+		free(bounce);
+		return ok;
+	}
+
+	/*
+	 * Failed writes are reported, with where they failed: a short write on flaky media
+	 * would otherwise only show up as a failed copy.
+	 */
+	bool ADFIO::transfer(bool write, u8 *buffer, u64 offset, u64 len)
+	{
+		if (m_directFd >= 0 && directTransfer(write, buffer, offset, len))
+			return true;
+		if (rawTransfer(m_fd, write, buffer, offset, len))
+			return true;
+
+		if (write)
+			m_messenger->textError("ADFIO: write of %lu bytes at byte %lu failed - %s\n", len, offset, strerror(errno));
+		return false;
+	}
+
+	bool ADFIO::writeBlock(Block* writeBuffer, u64 blockNum)
+	{
+		return transfer(true, (u8 *)writeBuffer, blockNum * BLOCKSIZE, sizeof(Block));
 	}
 
 	bool ADFIO::readBlock(Block* readBuffer, u64 blockNum)
 	{
-		s64 r;
-		lseek(fileno(m_filePtr), BLOCKSIZE * blockNum, SEEK_SET);
-		r = read(fileno(m_filePtr), readBuffer, sizeof(Block));
-		return (r == 512 ? true : false);
+		return transfer(false, (u8 *)readBuffer, blockNum * BLOCKSIZE, sizeof(Block));
+	}
+
+	bool ADFIO::readBlocks(Block* readBuffer, u64 blockNum, u64 count)
+	{
+		return transfer(false, (u8 *)readBuffer, blockNum * BLOCKSIZE, count * sizeof(Block));
+	}
+
+	bool ADFIO::writeBlocks(Block* writeBuffer, u64 blockNum, u64 count)
+	{
+		return transfer(true, (u8 *)writeBuffer, blockNum * BLOCKSIZE, count * sizeof(Block));
+	}
+
+	void ADFIO::adviseSequential(u64 blockNum, u64 count)
+	{
+#ifdef POSIX_FADV_SEQUENTIAL
+		if (m_directFd < 0)
+			posix_fadvise(m_fd, blockNum * BLOCKSIZE, count * BLOCKSIZE, POSIX_FADV_SEQUENTIAL);
+#endif
+	}
+
+	void ADFIO::adviseDone(u64 blockNum, u64 count, bool written)
+	{
+#ifdef POSIX_FADV_DONTNEED
+		if (m_directFd >= 0)
+			return;
+
+		// dirty pages can't be dropped - get them onto the disk first
+#ifdef SYNC_FILE_RANGE_WRITE
+		if (written)
+			sync_file_range(m_fd, blockNum * BLOCKSIZE, count * BLOCKSIZE,
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+		posix_fadvise(m_fd, blockNum * BLOCKSIZE, count * BLOCKSIZE, POSIX_FADV_DONTNEED);
+#endif
+	}
+
+	/*
+	 * The kernel may turn the copy into a reflink, or copy on the server for network
+	 * file systems. Failing before anything is copied, with an error that means the
+	 * copy can't be done this way, hands the range back to the buffered copy. So
+	 * does direct IO: copy_file_range reads through the page cache.
+	 */
+	s64 ADFIO::copyToFile(int fd, u64 fileOffset, u64 blockNum, u64 count)
+	{
+#if defined(__linux__) && defined(SEEK_DATA) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+		struct stat s;
+		off_t start = blockNum * BLOCKSIZE;
+		off_t end = start + count * BLOCKSIZE;
+		off_t pos = start;
+		bool copied = false;
+
+		if (m_directFd >= 0 || fstat(m_fd, &s) != 0 || !S_ISREG(s.st_mode))
+			return -1;
+
+		while (pos < end)
+		{
+			off_t data = lseek(m_fd, pos, SEEK_DATA);
+			off_t hole;
+
+			// past the last data, the rest of the file is a hole
+			if (data < 0 && errno == ENXIO)
+				break;
+			if (data < 0)
+				data = pos;
+			if (data >= end)
+				break;
+
+			hole = lseek(m_fd, data, SEEK_HOLE);
+			if (hole < 0 || hole > end)
+				hole = end;
+
+			while (data < hole)
+			{
+				loff_t in = data;
+				loff_t out = fileOffset + (data - start);
+				ssize_t n = copy_file_range(m_fd, &in, fd, &out, hole - data, 0);
+
+				if (n < 0 && errno == EINTR)
+					continue;
+				if (n <= 0)
+				{
+					if (!copied && n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP || errno == EBADF))
+						return -1;
+					m_messenger->textError("ADFIO: copy of %lu bytes at byte %lu failed - %s\n", (u64)(hole - data), (u64)data,
+						n < 0 ? strerror(errno) : "end of file");
+					return (data - start) / BLOCKSIZE;
+				}
+				copied = true;
+				data += n;
+			}
+			pos = hole;
+		}
+		return count;
+#else
+		return -1;
+#endif
 	}
 }
@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "amigadrive.h"
+#include "amigaparallel.h"
+#include "amigatrace.h"
+
+// the export pass reads this many blocks (4MB) per request
+#define EXPORT_CHUNK 8192
+// and has at most this many chunks in memory at once
+#define EXPORT_BUFFERS 8
+
+namespace amigadrive
+{
+	/*
+	 * A chunk of the device read by the export pass. It's handed to the writer of
+	 * every partition it overlaps, and goes back on the free list once the last of
+	 * them is done with it.
+	 */
+	struct ExportChunk
+	{
+		Block *data = nullptr;
+		u64 first;
+		u64 count;
+		std::atomic<int> users;
+	};
+
+	/*
+	 * The part of a chunk one partition's writer is to write, and where in its file
+	 */
+	struct ExportJob
+	{
+		ExportChunk *chunk;
+		u64 offset;
+		u64 count;
+		u64 fileBlock;
+	};
+
+	struct ExportTarget
+	{
+		Volume *volume;
+		u64 start;
+		u64 end;
+		int fd;
+		std::deque<ExportJob> queue;
+	};
+
+	/*
+	 * The reader and the writers share one lock. Chunks are large, so it's taken
+	 * a few times per 4MB, and contention on it doesn't show.
+	 */
+	class ExportPass
+	{
+		public:
+			std::mutex m_lock;
+			std::condition_variable m_work;
+			std::condition_variable m_freed;
+			std::vector<ExportChunk *> m_free;
+			bool m_done;
+			std::atomic<bool> m_failed;
+
+			ExportPass() : m_done(false), m_failed(false) {;};
+
+			ExportChunk *take(void)
+			{
+				std::unique_lock<std::mutex> lock(m_lock);
+				ExportChunk *c;
+
+				m_freed.wait(lock, [this]() { return !m_free.empty(); });
+				c = m_free.back();
+				m_free.pop_back();
+				return c;
+			}
+
+			void release(ExportChunk *c)
+			{
+				if (--c->users == 0)
+				{
+					std::lock_guard<std::mutex> lock(m_lock);
+					m_free.push_back(c);
+					m_freed.notify_one();
+				}
+			}
+	};
+
+	/*
+	 * Name a partition's file after its number and its drive name, keeping
+	 * anything which would be awkward in a file name out of it.
+	 */
+	static void exportName(char *out, size_t size, const char *dir, int partition, const char *name)
+	{
+		char clean[32];
+		int i;
+
+		for (i = 0; name && name[i] && i < (int)sizeof(clean) - 1; i++)
+			clean[i] = (name[i] == '/' || name[i] == '\\' || (u8)name[i] < 0x20) ? '_' : name[i];
+		clean[i] = 0;
+
+		snprintf(out, size, "%s/%d-%s.hdf", dir, partition, clean);
+	}
+
+	/*
+	 * Write one job out, seeking over runs of zero blocks so the file stays sparse.
+	 */
+	static bool writeJob(ExportTarget &T, ExportJob &J, const BlockKernels *zero, u32 zeroBytes)
+	{
+		u8 *p = (u8 *)&J.chunk->data[J.offset];
+		u64 bytes = J.count * BLOCKSIZE;
+		u64 pos = J.fileBlock * BLOCKSIZE;
+		u64 run = 0;
+		u64 i;
+
+		for (i = 0; i < bytes; i += zeroBytes)
+		{
+			u64 n = (bytes - i < zeroBytes) ? bytes - i : zeroBytes;
+
+			if (n == zeroBytes && zero->isZero(p + i, zeroBytes))
+			{
+				if (run && pwrite(T.fd, p + i - run, run, pos + i - run) != (ssize_t)run)
+					return false;
+				run = 0;
+				continue;
+			}
+			run += n;
+		}
+
+		return !run || pwrite(T.fd, p + bytes - run, run, pos + bytes - run) == (ssize_t)run;
+	}
+
+	/*
+	 * One pass over the device, from the start of the first partition to the end of
+	 * the last, in EXPORT_CHUNK requests. Chunks wholly outside every partition are
+	 * skipped. Each chunk is queued for the writers of the partitions it overlaps,
+	 * which run on threads of their own, so the device is read strictly in order
+	 * while every partition file is written at once.
+	 */
+	bool Device::exportAllPartitions(const char *dir)
+	{
+		CopyTimer T(this);
+		TraceSpan span("exportAllPartitions", "copy");
+		std::vector<ExportTarget> targets(volumeCount());
+		std::vector<ExportChunk> chunks(EXPORT_BUFFERS);
+		const BlockKernels *zero = blockKernels(4096);
+		ExportPass pass;
+		u64 lo = ~(u64)0, hi = 0, total = 0, done = 0;
+		bool ok = true;
+		Volume *V;
+		size_t i;
+		int I;
+
+		if (targets.empty())
+		{
+			m_messenger->textError("There are no partitions to export\n");
+			return false;
+		}
+
+		if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+		{
+			m_messenger->textError("Can't create directory [%s] - %s\n", dir, strerror(errno));
+			return false;
+		}
+
+		for (I = 1, V = m_firstVol; V; I++, V = V->m_nextVol)
+		{
+			ExportTarget &t = targets[I - 1];
+			char name[4096];
+
+			exportName(name, sizeof(name), dir, I, V->volName());
+			t.volume = V;
+			t.start = V->volStartBlock();
+			t.end = t.start + V->volBlockCount();
+			t.fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+			if (t.fd < 0)
+			{
+				m_messenger->textError("Can't open [%s] for writing - %s\n", name, strerror(errno));
+				ok = false;
+			}
+			else
+				m_messenger->textInfo("Partition %d -> [%s]\n", I, name);
+
+			if (t.end > blockCount())
+			{
+				m_messenger->textError("Partition %d runs past the end of the device\n", I);
+				ok = false;
+			}
+
+			lo = (t.start < lo) ? t.start : lo;
+			hi = (t.end > hi) ? t.end : hi;
+			total += t.end - t.start;
+		}
+
+		for (i = 0; ok && i < chunks.size(); i++)
+		{
+			void *p;
+
+			if (posix_memalign(&p, 4096, EXPORT_CHUNK * sizeof(Block)) != 0)
+			{
+				ok = false;
+				break;
+			}
+			chunks[i].data = (Block *)p;
+			pass.m_free.push_back(&chunks[i]);
+		}
+
+		if (ok)
+		{
+			m_io->adviseSequential(lo, hi - lo);
+
+			// job 0 reads the device, the rest write one partition each
+			parallelFor(targets.size() + 1, targets.size() + 1, [&](u64 job, unsigned worker)
+			{
+				if (job == 0)
+				{
+					u64 pos = lo;
+
+					while (pos < hi && !pass.m_failed)
+					{
+						u64 n = (hi - pos < EXPORT_CHUNK) ? hi - pos : EXPORT_CHUNK;
+						u64 next = hi;
+						int users = 0;
+						ExportChunk *c;
+
+						for (ExportTarget &t : targets)
+							if (t.start < pos + n && t.end > pos)
+								users++;
+							else if (t.start >= pos + n && t.start < next)
+								next = t.start;
+
+						if (!users)
+						{
+							pos = next;
+							continue;
+						}
+
+						c = pass.take();
+						c->first = pos;
+						c->count = n;
+						c->users = users + 1;
+
+						{
+							TraceSpan span("read", "chunk", pos);
+							if (!m_io->ioReadBlocks(c->data, pos, n))
+							{
+								m_messenger->textError("Couldn't read blocks %lu to %lu\n", pos, pos + n - 1);
+								pass.m_failed = true;
+								pass.release(c);
+								break;
+							}
+						}
+
+						{
+							std::lock_guard<std::mutex> lock(pass.m_lock);
+
+							for (ExportTarget &t : targets)
+								if (t.start < pos + n && t.end > pos)
+								{
+									ExportJob J;
+									u64 from = (t.start > pos) ? t.start : pos;
+									u64 to = (t.end < pos + n) ? t.end : pos + n;
+
+									J.chunk = c;
+									J.offset = from - pos;
+									J.count = to - from;
+									J.fileBlock = from - t.start;
+									t.queue.push_back(J);
+									done += J.count;
+								}
+							pass.m_work.notify_all();
+						}
+						pass.release(c);
+
+						m_io->adviseDone(pos, n, false);
+						pos += n;
+						progress(done, total);
+					}
+
+					std::lock_guard<std::mutex> lock(pass.m_lock);
+					pass.m_done = true;
+					pass.m_work.notify_all();
+					return;
+				}
+
+				ExportTarget &t = targets[job - 1];
+
+				for (;;)
+				{
+					std::chrono::steady_clock::time_point t0;
+					ExportJob J;
+					bool written;
+
+					{
+						std::unique_lock<std::mutex> lock(pass.m_lock);
+
+						pass.m_work.wait(lock, [&]() { return !t.queue.empty() || pass.m_done; });
+						if (t.queue.empty())
+							break;
+						J = t.queue.front();
+						t.queue.pop_front();
+					}
+
+					if (m_statsEnabled)
+						t0 = std::chrono::steady_clock::now();
+					{
+						TraceSpan span("write", "export", job);
+						written = !pass.m_failed && writeJob(t, J, zero, 4096);
+					}
+					if (m_statsEnabled)
+						m_fileStats.record(IOStats::WRITE, J.fileBlock, J.count,
+							std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count(), written);
+
+					if (!written && !pass.m_failed)
+					{
+						m_messenger->textError("Couldn't write partition %lu\n", job);
+						pass.m_failed = true;
+					}
+					pass.release(J.chunk);
+				}
+			});
+
+			ok = !pass.m_failed;
+		}
+
+		for (ExportTarget &t : targets)
+		{
+			if (t.fd < 0)
+				continue;
+
+			// a hole at the end doesn't extend the file by itself
+			if (ok && ftruncate(t.fd, (t.end - t.start) * BLOCKSIZE) != 0)
+				ok = false;
+			if (close(t.fd) != 0)
+				ok = false;
+		}
+
+		for (ExportChunk &c : chunks)
+			free(c.data);
+
+		return ok;
+	}
+}
@@ -0,0 +1,480 @@
+#include <string.h>
+#include "amigaffs.h"
+#include "amigablock.h"
+#include "amigatrace.h"
+
+namespace amigadrive
+{
+	/*
+	 * Long name volumes keep the name and the comment together, in the space
+	 * from the comment to the end of the old name, and the date further on.
+	 */
+	#define FFS_LONGDAYS 60
+	#define FFS_NAMEAREA 112
+	#define FFS_MAXNAME 30
+	#define FFS_MAXLONGNAME 107
+
+	// a directory cache block: type, own key, parent, record count, next block, checksum, records
+	#define DIRC_PARENT 8
+	#define DIRC_RECORDS 12
+	#define DIRC_NEXT 16
+	#define DIRC_DATA 24
+
+	FFSFileSystem::FFSFileSystem(Volume *volume, UI *messenger, u32 dosType) : FileSystem(volume, messenger, volume->volBytesPerBlock())
+	{
+		m_dosType = dosType;
+		m_ofs = !(dosType & 1);
+		m_intl = (dosType & 0xFF) >= 2;
+		m_dirCache = (dosType & 0xFF) == 4 || (dosType & 0xFF) == 5;
+		m_longNames = (dosType & 0xFF) >= 6;
+		m_hashSize = m_blockBytes / 4 - 56;
+		m_blocks = (u64)volume->volBlockCount() * BLOCKSIZE / m_blockBytes;
+		m_root = 0;
+	}
+
+	bool FFSFileSystem::isFFS(u32 dosType)
+	{
+		return (dosType & 0xFFFFFF00) == 0x444F5300 && (dosType & 0xFF) <= 7;
+	}
+
+	/*
+	 * The root block is midway between the reserved blocks at the start and the
+	 * end of the volume. Finding something else there isn't worth a warning - the
+	 * volume may never have been formatted.
+	 */
+	bool FFSFileSystem::init(void)
+	{
+		u8 *root = new u8[m_blockBytes];
+		bool ok;
+
+		m_root = (m_blocks - 1 + m_volume->volReserved()) / 2;
+		ok = m_root < m_blocks && readMeta(m_root, root) && be32(root) == FFS_T_HEADER &&
+			(s32)be32(root + m_blockBytes - FFS_SECTYPE) == FFS_ST_ROOT && be32(root + 12) == m_hashSize &&
+			m_volume->volKernels()->sum(root, m_blockBytes) == 0;
+		delete [] root;
+		return ok;
+	}
+
+	const char *FFSFileSystem::fsName(void)
+	{
+		return m_ofs ? "OFS" : "FFS";
+	}
+
+	u32 FFSFileSystem::dataOffset(void)
+	{
+		return m_ofs ? OFS_DATA_HEADER : 0;
+	}
+
+	bool FFSFileSystem::readChecked(u64 block, u8 *buffer, u32 type)
+	{
+		if (block < 2 || block >= m_blocks || !readMeta(block, buffer))
+			return false;
+
+		if (be32(buffer) != type || m_volume->volKernels()->sum(buffer, m_blockBytes) != 0)
+		{
+			m_messenger->textWarning("Block %lu of volume %s is damaged\n", block, m_volume->volName());
+			return false;
+		}
+
+		// headers and extension blocks name themselves, bar the root
+		return block == m_root || be32(buffer + 4) == block;
+	}
+
+	static std::string bcplString(const u8 *s, u32 max)
+	{
+		return std::string((const char *)s + 1, (s[0] < max) ? s[0] : max);
+	}
+
+	const u8 *FFSFileSystem::entryName(const u8 *buffer)
+	{
+		if (m_longNames && (s32)be32(buffer + m_blockBytes - FFS_SECTYPE) != FFS_ST_ROOT)
+			return buffer + m_blockBytes - FFS_COMMENT;
+		return buffer + m_blockBytes - FFS_NAME;
+	}
+
+	bool FFSFileSystem::headerInfo(u64 block, u8 *buffer, FileInfo &info)
+	{
+		u8 *end = buffer + m_blockBytes;
+		s32 secType = be32(end - FFS_SECTYPE);
+		const u8 *name = entryName(buffer);
+		u32 days = FFS_DAYS;
+
+		info.name = bcplString(name, m_longNames ? FFS_MAXLONGNAME : FFS_MAXNAME);
+
+		// a hard link has its own name, and everything else from what it links to
+		if (secType == FFS_ST_LINKFILE || secType == FFS_ST_LINKDIR)
+		{
+			block = be32(end - FFS_REAL);
+			if (!readChecked(block, buffer, FFS_T_HEADER))
+				return false;
+			secType = be32(end - FFS_SECTYPE);
+			if (secType == FFS_ST_LINKFILE || secType == FFS_ST_LINKDIR)
+				return false;
+		}
+
+		info.key = block;
+		info.size = 0;
+		if (secType == FFS_ST_FILE)
+		{
+			info.type = FT_FILE;
+			info.size = be32(end - FFS_BYTESIZE);
+		}
+		else if (secType == FFS_ST_SOFTLINK)
+			info.type = FT_SOFTLINK;
+		else if (secType == FFS_ST_USERDIR || secType == FFS_ST_ROOT)
+			info.type = FT_DIR;
+		else
+			return false;
+
+		info.comment.clear();
+		if (secType != FFS_ST_ROOT && !m_longNames)
+			info.comment = bcplString(end - FFS_COMMENT, 79);
+		else if (secType != FFS_ST_ROOT)
+		{
+			// the comment follows the name, if there was room for it
+			const u8 *comment = name + 1 + name[0];
+
+			if (name[0] <= FFS_MAXLONGNAME && comment + 1 + comment[0] <= end - FFS_COMMENT + FFS_NAMEAREA)
+				info.comment = bcplString(comment, 79);
+			days = FFS_LONGDAYS;
+		}
+
+		info.protect = be32(end - FFS_PROTECT);
+		info.days = be32(end - days);
+		info.mins = be32(end - days + 4);
+		info.ticks = be32(end - days + 8);
+		return true;
+	}
+
+	/*
+	 * AmigaDOS folds case in names, for hashing and comparing alike. The international
+	 * variants fold accented Latin-1 letters as well.
+	 */
+	u8 FFSFileSystem::upper(u8 c)
+	{
+		if ((c >= 'a' && c <= 'z') || (m_intl && c >= 224 && c <= 254 && c != 247))
+			return c - 32;
+		return c;
+	}
+
+	u32 FFSFileSystem::hashName(const char *name)
+	{
+		u32 len = strlen(name);
+		u32 hash = len;
+		u32 i;
+
+		for (i = 0; i < len; i++)
+			hash = (hash * 13 + upper(name[i])) & 0x7FF;
+		return hash % m_hashSize;
+	}
+
+	bool FFSFileSystem::sameName(const char *a, const u8 *bcpl)
+	{
+		u32 len = strlen(a);
+		u32 i;
+
+		if (len != bcpl[0])
+			return false;
+		for (i = 0; i < len; i++)
+			if (upper(a[i]) != upper(bcpl[i + 1]))
+				return false;
+		return true;
+	}
+
+	bool FFSFileSystem::rootInfo(FileInfo &info)
+	{
+		u8 *buffer = new u8[m_blockBytes];
+		bool ok = readChecked(m_root, buffer, FFS_T_HEADER) && headerInfo(m_root, buffer, info);
+
+		delete [] buffer;
+		return ok;
+	}
+
+	/*
+	 * Only the chain the name hashes to has to be walked. Chains can't be longer than
+	 * the volume has blocks, which stops a looped one.
+	 */
+	bool FFSFileSystem::lookup(const FileInfo &dir, const char *name, FileInfo &info)
+	{
+		u8 *buffer = new u8[m_blockBytes];
+		bool found = false;
+		u64 block, steps;
+
+		if (readChecked(dir.key, buffer, FFS_T_HEADER))
+		{
+			block = be32(buffer + FFS_TABLE + hashName(name) * 4);
+			for (steps = 0; block && steps < m_blocks; steps++)
+			{
+				if (!readChecked(block, buffer, FFS_T_HEADER))
+					break;
+				if (sameName(name, entryName(buffer)))
+				{
+					found = headerInfo(block, buffer, info);
+					break;
+				}
+				block = be32(buffer + m_blockBytes - FFS_HASHCHAIN);
+			}
+		}
+
+		delete [] buffer;
+		return found;
+	}
+
+	/*
+	 * A directory cache holds a record for each entry, with everything readDir
+	 * needs, packed into a chain of blocks hung off the directory's extension field.
+	 * Listing from it reads those few blocks instead of every entry's header. Hard
+	 * links are the exception, as their records describe the link and not what it
+	 * links to.
+	 */
+	bool FFSFileSystem::listCached(const FileInfo &dir, std::vector<FileInfo> &entries)
+	{
+		TraceSpan span("dircache", "fs");
+		u8 *buffer = new u8[m_blockBytes];
+		u8 *header = new u8[m_blockBytes];
+		bool ok = readChecked(dir.key, buffer, FFS_T_HEADER);
+		u64 block = ok ? be32(buffer + m_blockBytes - FFS_EXTENSION) : 0;
+		u64 steps = 0;
+
+		if (!block)
+			ok = false;
+
+		while (ok && block)
+		{
+			u32 records, i, at = DIRC_DATA;
+
+			if (++steps > m_blocks || !readChecked(block, buffer, FFS_T_DIRCACHE) || be32(buffer + DIRC_PARENT) != dir.key)
+			{
+				ok = false;
+				break;
+			}
+
+			records = be32(buffer + DIRC_RECORDS);
+			for (i = 0; ok && i < records; i++)
+			{
+				const u8 *r = buffer + at;
+				FileInfo info;
+				s8 type;
+				u32 nameLen, commentLen;
+
+				// header, size, protection, owner, date, type, then the name and comment
+				if (at + 25 > m_blockBytes || at + 25 + r[23] > m_blockBytes)
+				{
+					ok = false;
+					break;
+				}
+				nameLen = r[23];
+				commentLen = r[24 + nameLen];
+				if (at + 25 + nameLen + commentLen > m_blockBytes)
+				{
+					ok = false;
+					break;
+				}
+				at += (25 + nameLen + commentLen + 1) & ~1;
+
+				type = r[22];
+				if (type == FFS_ST_LINKFILE || type == FFS_ST_LINKDIR)
+				{
+					ok = readChecked(be32(r), header, FFS_T_HEADER) && headerInfo(be32(r), header, info);
+					if (ok)
+						entries.push_back(info);
+					continue;
+				}
+
+				info.key = be32(r);
+				info.type = (type == FFS_ST_FILE) ? FT_FILE : (type == FFS_ST_SOFTLINK) ? FT_SOFTLINK : FT_DIR;
+				info.size = (type == FFS_ST_FILE) ? be32(r + 4) : 0;
+				info.protect = be32(r + 8);
+				info.days = (r[16] << 8) | r[17];
+				info.mins = (r[18] << 8) | r[19];
+				info.ticks = (r[20] << 8) | r[21];
+				info.name.assign((const char *)r + 24, nameLen);
+				info.comment.assign((const char *)r + 25 + nameLen, commentLen);
+				entries.push_back(info);
+			}
+
+			block = be32(buffer + DIRC_NEXT);
+		}
+
+		if (!ok)
+			entries.clear();
+		delete [] header;
+		delete [] buffer;
+		return ok;
+	}
+
+	bool FFSFileSystem::list(const FileInfo &dir, std::vector<FileInfo> &entries)
+	{
+		u8 *table = new u8[m_blockBytes];
+		u8 *buffer = new u8[m_blockBytes];
+		bool ok = true;
+		u64 steps = 0;
+		u32 i;
+
+		if (m_dirCache && listCached(dir, entries))
+		{
+			delete [] buffer;
+			delete [] table;
+			return true;
+		}
+
+		if (!readChecked(dir.key, table, FFS_T_HEADER))
+			ok = false;
+
+		for (i = 0; ok && i < m_hashSize; i++)
+		{
+			u64 block = be32(table + FFS_TABLE + i * 4);
+
+			while (block)
+			{
+				FileInfo info;
+				u64 next;
+
+				if (++steps > m_blocks || !readChecked(block, buffer, FFS_T_HEADER))
+				{
+					ok = false;
+					break;
+				}
+
+				// a hard link's target replaces it in the buffer, so take the chain first
+				next = be32(buffer + m_blockBytes - FFS_HASHCHAIN);
+				if (headerInfo(block, buffer, info))
+					entries.push_back(info);
+				block = next;
+			}
+		}
+
+		delete [] buffer;
+		delete [] table;
+		return ok;
+	}
+
+	/*
+	 * The header lists the first data blocks and each extension block the next lot,
+	 * highSeq of them, from the end of the table backwards. Only as many blocks as
+	 * the file's size needs are taken, which also stops a looped chain.
+	 */
+	std::shared_ptr<const ExtentMap> FFSFileSystem::mapFile(const FileInfo &info)
+	{
+		TraceSpan span("map file", "fs");
+		u32 payload = m_ofs ? m_blockBytes - OFS_DATA_HEADER : m_blockBytes;
+		u64 needed = (info.size + payload - 1) / payload;
+		ExtentMap *map = new ExtentMap;
+		u8 *buffer = new u8[m_blockBytes];
+		u64 list = info.key;
+
+		while (map->blockCount() < needed && list)
+		{
+			u32 type = (list == info.key) ? FFS_T_HEADER : FFS_T_LIST;
+			u32 count, i;
+
+			if (!readChecked(list, buffer, type))
+				break;
+
+			count = be32(buffer + 8);
+			if (count == 0 || count > m_hashSize)
+				break;
+			for (i = 0; i < count && map->blockCount() < needed; i++)
+				map->add(be32(buffer + FFS_TABLE + (m_hashSize - 1 - i) * 4));
+			list = be32(buffer + m_blockBytes - FFS_EXTENSION);
+		}
+
+		delete [] buffer;
+		return std::shared_ptr<const ExtentMap>(map);
+	}
+
+	File *FFSFileSystem::openFile(const FileInfo &info)
+	{
+		return new FFSFile(this, info, fileMap(info));
+	}
+
+	FFSFile::FFSFile(FFSFileSystem *fs, const FileInfo &info, const std::shared_ptr<const ExtentMap> &map) : MappedFile(fs, info, map)
+	{
+		m_ffs = fs;
+		m_stage = nullptr;
+	}
+
+	FFSFile::~FFSFile()
+	{
+		if (m_stage)
+		{
+			delete [] m_stage;
+			m_stage = nullptr;
+		}
+		m_ffs = nullptr;
+	}
+
+	bool FFSFile::readAt(u8 *buffer, u64 bytes, u64 offset)
+	{
+		if (!m_ffs->m_ofs)
+			return MappedFile::readAt(buffer, bytes, offset);
+		return mapped(bytes, offset) && readOFS(buffer, bytes, offset);
+	}
+
+	/*
+	 * OFS data blocks carry a header of their own, which has to agree with the
+	 * file header about whose block it is and where it goes. A run of consecutive
+	 * blocks is read OFS_BATCH blocks at a time into the staging buffer. The headers
+	 * of a whole batch are checked in one pass before anything is copied, then the
+	 * payloads are gathered into the caller's buffer with one copy per block.
+	 */
+	bool FFSFile::readOFS(u8 *buffer, u64 bytes, u64 offset)
+	{
+		u32 blockBytes = m_ffs->m_blockBytes;
+		const BlockKernels *kernels = m_ffs->m_volume->volKernels();
+		u64 index = offset / m_payload;
+		u32 within = offset % m_payload;
+
+		if (!m_stage)
+			m_stage = new u8[OFS_BATCH * blockBytes];
+
+		while (bytes)
+		{
+			u64 wanted = (within + bytes + m_payload - 1) / m_payload;
+			u64 block, n, i;
+
+			n = m_map->find(index, block);
+			if (n > wanted)
+				n = wanted;
+			if (n > OFS_BATCH)
+				n = OFS_BATCH;
+			if (!m_ffs->readData(m_stage, block, n))
+				return false;
+
+			for (i = 0; i < n; i++)
+			{
+				const u8 *b = m_stage + i * blockBytes;
+
+				if (be32(b) != FFS_T_DATA || be32(b + 4) != m_info.key || be32(b + 8) != index + i + 1 ||
+					be32(b + 12) > m_payload || kernels->sum(b, blockBytes) != 0)
+				{
+					m_ffs->m_messenger->textError("Data block %lu of %s is damaged\n", index + i + 1, m_info.name.c_str());
+					return false;
+				}
+			}
+
+			for (i = 0; i < n; i++)
+			{
+				const u8 *b = m_stage + i * blockBytes;
+				u64 take = m_payload - within;
+
+				if (take > bytes)
+					take = bytes;
+
+				// only the last block of a file may be short
+				if (be32(b + 12) < within + take)
+				{
+					m_ffs->m_messenger->textError("Data block %lu of %s is short\n", index + i + 1, m_info.name.c_str());
+					return false;
+				}
+
+				memcpy(buffer, b + OFS_DATA_HEADER + within, take);
+				buffer += take;
+				bytes -= take;
+				within = 0;
+			}
+			index += n;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,144 @@
+#include <string.h>
+#include "amigafloppy.h"
+#include "amigablock.h"
+
+#define ID_DOS 0x444F5300
+#define ID_KICK 0x4B49434B
+
+namespace amigadrive
+{
+	/*
+	 * The boot block checksum is a sum of all 256 longwords with the carries
+	 * added back in. The disk boots if the sum comes to 0xFFFFFFFF.
+	 */
+	static u32 bootBlockSum(const u8 *bootBlock)
+	{
+		u32 sum = 0, prev, i;
+
+		for (i = 0; i < ADF_BOOTBLOCK_BYTES; i += 4)
+		{
+			prev = sum;
+			sum += be32(bootBlock + i);
+			if (sum < prev)
+				sum++;
+		}
+		return sum;
+	}
+
+	BootClass classifyBootBlock(const u8 *bootBlock)
+	{
+		u32 id = be32(bootBlock);
+
+		if (id == ID_KICK)
+			return BOOT_KICKSTART;
+		if ((id & 0xFFFFFF00) != ID_DOS)
+			return BOOT_NDOS;
+		return bootBlockSum(bootBlock) == 0xFFFFFFFF ? BOOT_BOOTABLE : BOOT_DOS;
+	}
+
+	const char *bootClassName(BootClass bootClass)
+	{
+		switch (bootClass)
+		{
+			case BOOT_DOS:
+				return "dos";
+			case BOOT_BOOTABLE:
+				return "bootable";
+			case BOOT_KICKSTART:
+				return "kickstart";
+			default:
+				return "ndos";
+		}
+	}
+
+	DriveType floppyType(u64 bytes)
+	{
+		if (bytes == ADF_DD_BYTES)
+			return DD_DISKETTE;
+		if (bytes == ADF_HD_BYTES)
+			return HD_DISKETTE;
+		return HARD_DRIVE;
+	}
+
+	FloppyIO::FloppyIO(DeviceIO *backing)
+	{
+		m_backing = backing;
+		m_image = nullptr;
+		m_drvArch = backing->m_drvArch;
+		m_sectorCount = backing->m_sectorCount;
+		m_sectorBytes = backing->m_sectorBytes;
+		m_physSectorBytes = backing->m_physSectorBytes;
+		m_messenger = backing->m_messenger;
+	}
+
+	FloppyIO::~FloppyIO()
+	{
+		if (m_image)
+		{
+			delete [] m_image;
+			m_image = nullptr;
+		}
+		m_backing = nullptr;
+	}
+
+	bool FloppyIO::load(void)
+	{
+		m_image = new Block[m_sectorCount];
+
+		if (m_backing->ioReadBlocks(m_image, 0, m_sectorCount))
+			return true;
+
+		delete [] m_image;
+		m_image = nullptr;
+		return false;
+	}
+
+	const u8 *FloppyIO::image(void)
+	{
+		return (const u8 *)m_image;
+	}
+
+	u64 FloppyIO::imageBytes(void)
+	{
+		return m_sectorCount * BLOCKSIZE;
+	}
+
+	void FloppyIO::initDriver(UI *messenger, const char *devName, bool readOnly)
+	{
+		m_messenger = messenger;
+	}
+
+	bool FloppyIO::readBlock(Block *readBuffer, u64 blockNumber)
+	{
+		if (blockNumber >= m_sectorCount)
+			return false;
+		copyBlockKernel<BLOCKSIZE>(readBuffer, &m_image[blockNumber], BLOCKSIZE);
+		return true;
+	}
+
+	bool FloppyIO::readBlocks(Block *readBuffer, u64 blockNumber, u64 count)
+	{
+		if (blockNumber > m_sectorCount || count > m_sectorCount - blockNumber)
+			return false;
+		memcpy(readBuffer, &m_image[blockNumber], count * BLOCKSIZE);
+		return true;
+	}
+
+	bool FloppyIO::writeBlock(Block *writeBuffer, u64 blockNumber)
+	{
+		if (blockNumber >= m_sectorCount || !m_backing->ioWrite(writeBuffer, blockNumber))
+			return false;
+		copyBlockKernel<BLOCKSIZE>(&m_image[blockNumber], writeBuffer, BLOCKSIZE);
+		return true;
+	}
+
+	bool FloppyIO::writeBlocks(Block *writeBuffer, u64 blockNumber, u64 count)
+	{
+		if (blockNumber > m_sectorCount || count > m_sectorCount - blockNumber)
+			return false;
+		if (!m_backing->ioWriteBlocks(writeBuffer, blockNumber, count))
+			return false;
+		memcpy(&m_image[blockNumber], writeBuffer, count * BLOCKSIZE);
+		return true;
+	}
+}
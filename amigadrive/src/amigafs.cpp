@@ -0,0 +1,544 @@
+#include <stdio.h>
+#include <string.h>
+#include "amigafs.h"
+#include "amigaffs.h"
+#include "amigasfs.h"
+#include "amigapfs.h"
+#include "amigablock.h"
+#include "amigatrace.h"
+
+namespace amigadrive
+{
+	void ExtentMap::add(u64 block)
+	{
+		if (!m_extents.empty())
+		{
+			Extent &last = m_extents.back();
+
+			if (block == last.block + last.count)
+			{
+				last.count++;
+				return;
+			}
+		}
+		m_extents.push_back({blockCount(), block, 1});
+	}
+
+	u64 ExtentMap::blockCount(void) const
+	{
+		if (m_extents.empty())
+			return 0;
+		return m_extents.back().index + m_extents.back().count;
+	}
+
+	u64 ExtentMap::extentCount(void) const
+	{
+		return m_extents.size();
+	}
+
+	u64 ExtentMap::find(u64 index, u64 &block) const
+	{
+		size_t lo = 0, hi = m_extents.size();
+
+		// the first run which ends after the block
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+
+			if (m_extents[mid].index + m_extents[mid].count <= index)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo == m_extents.size())
+			return 0;
+		block = m_extents[lo].block + (index - m_extents[lo].index);
+		return m_extents[lo].index + m_extents[lo].count - index;
+	}
+
+	File::File(const FileInfo &info)
+	{
+		m_info = info;
+		m_pos = 0;
+		m_ahead = nullptr;
+		m_aheadOffset = 0;
+		m_aheadBytes = 0;
+	}
+
+	File::~File()
+	{
+		if (m_ahead)
+		{
+			delete [] m_ahead;
+			m_ahead = nullptr;
+		}
+	}
+
+	const FileInfo &File::fileInfo(void)
+	{
+		return m_info;
+	}
+
+	/*
+	 * Big reads go straight to the file system. Small ones come out of the readahead
+	 * window, which is refilled from the start of the read when it doesn't hold all
+	 * of it, so a run of small reads in either direction costs one fill per window.
+	 */
+	s64 File::readLocked(void *buffer, u64 bytes, u64 offset)
+	{
+		if (offset >= m_info.size)
+			return 0;
+		if (bytes > m_info.size - offset)
+			bytes = m_info.size - offset;
+		if (bytes == 0)
+			return 0;
+
+		if (m_ahead && offset >= m_aheadOffset && offset + bytes <= m_aheadOffset + m_aheadBytes)
+		{
+			memcpy(buffer, m_ahead + (offset - m_aheadOffset), bytes);
+			return bytes;
+		}
+
+		if (bytes >= FS_READAHEAD)
+			return readAt((u8 *)buffer, bytes, offset) ? (s64)bytes : -1;
+
+		if (!m_ahead)
+			m_ahead = new u8[FS_READAHEAD];
+		m_aheadOffset = offset;
+		m_aheadBytes = m_info.size - offset;
+		if (m_aheadBytes > FS_READAHEAD)
+			m_aheadBytes = FS_READAHEAD;
+		if (!readAt(m_ahead, m_aheadBytes, m_aheadOffset))
+		{
+			m_aheadBytes = 0;
+			return -1;
+		}
+
+		memcpy(buffer, m_ahead, bytes);
+		return bytes;
+	}
+
+	s64 File::pread(void *buffer, u64 bytes, u64 offset)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+
+		return readLocked(buffer, bytes, offset);
+	}
+
+	s64 File::read(void *buffer, u64 bytes)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		s64 n = readLocked(buffer, bytes, m_pos);
+
+		if (n > 0)
+			m_pos += n;
+		return n;
+	}
+
+	s64 File::seek(s64 offset, int whence)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		s64 base = 0;
+
+		if (whence == SEEK_CUR)
+			base = m_pos;
+		else if (whence == SEEK_END)
+			base = m_info.size;
+
+		if (base + offset < 0)
+			return -1;
+		m_pos = base + offset;
+		return m_pos;
+	}
+
+	const std::vector<ExtentMap::Extent> &ExtentMap::extents(void) const
+	{
+		return m_extents;
+	}
+
+	MappedFile::MappedFile(FileSystem *fs, const FileInfo &info, const std::shared_ptr<const ExtentMap> &map) : File(info)
+	{
+		m_fs = fs;
+		m_map = map;
+		m_payload = fs->m_blockBytes - fs->dataOffset();
+	}
+
+	bool MappedFile::mapped(u64 bytes, u64 offset)
+	{
+		u64 block;
+
+		if (m_map->find((offset + bytes - 1) / m_payload, block) == 0)
+		{
+			m_fs->m_messenger->textError("The block list of %s is damaged\n", m_info.name.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	bool MappedFile::readAt(u8 *buffer, u64 bytes, u64 offset)
+	{
+		u32 size = m_payload;
+		u64 index = offset / size;
+		u8 *bounce = nullptr;
+		bool ok;
+
+		ok = mapped(bytes, offset);
+		while (ok && bytes)
+		{
+			u32 within = offset % size;
+			u64 block;
+			u64 n = m_map->find(index, block);
+
+			if (within || bytes < size)
+			{
+				u64 take = size - within;
+
+				if (take > bytes)
+					take = bytes;
+				if (!bounce)
+					bounce = new u8[size];
+				ok = m_fs->readData(bounce, block, 1);
+				memcpy(buffer, bounce + within, take);
+				buffer += take;
+				offset += take;
+				bytes -= take;
+				index++;
+				continue;
+			}
+
+			if (n > bytes / size)
+				n = bytes / size;
+			ok = m_fs->readData(buffer, block, n);
+			buffer += n * size;
+			offset += n * size;
+			bytes -= n * size;
+			index += n;
+		}
+
+		if (bounce)
+			delete [] bounce;
+		return ok;
+	}
+
+	FileSystem::FileSystem(Volume *volume, UI *messenger, u32 blockBytes)
+	{
+		m_volume = volume;
+		m_messenger = messenger;
+		m_blockBytes = blockBytes;
+	}
+
+	FileSystem::~FileSystem()
+	{
+		for (auto &e : m_cache)
+			delete [] e.second.data;
+		m_cache.clear();
+		m_ages.clear();
+		m_maps.clear();
+		m_mapAges.clear();
+		m_volume = nullptr;
+		m_messenger = nullptr;
+	}
+
+	/*
+	 * The boot block says what the file system is. A volume whose boot block has
+	 * been lost still has its dos type in the partition table. SFS keeps its block
+	 * size in its root block, which is the first block.
+	 */
+	FileSystem *FileSystem::mount(Volume *volume, UI *messenger)
+	{
+		TraceSpan span("mount", "fs");
+		u8 *boot = new u8[volume->volBytesPerBlock()];
+		FileSystem *fs = nullptr;
+		u32 dosType = 0;
+		u32 sfsBytes = 0;
+
+		if (volume->volRead(boot, 0))
+		{
+			dosType = be32(boot);
+			sfsBytes = be32(boot + 52);
+		}
+		delete [] boot;
+
+		if (!FFSFileSystem::isFFS(dosType) && !SFSFileSystem::isSFS(dosType) && !PFSFileSystem::isPFS(dosType))
+			dosType = volume->volDosType();
+
+		if (FFSFileSystem::isFFS(dosType))
+		{
+			FFSFileSystem *ffs = new FFSFileSystem(volume, messenger, dosType);
+
+			if (ffs->init())
+				fs = ffs;
+			else
+				delete ffs;
+		}
+		else if (SFSFileSystem::isSFS(dosType) && validBlockBytes(sfsBytes))
+		{
+			SFSFileSystem *sfs = new SFSFileSystem(volume, messenger, sfsBytes);
+
+			if (sfs->init())
+				fs = sfs;
+			else
+				delete sfs;
+		}
+		else if (PFSFileSystem::isPFS(dosType))
+		{
+			PFSFileSystem *pfs = new PFSFileSystem(volume, messenger);
+
+			if (pfs->init())
+				fs = pfs;
+			else
+				delete pfs;
+		}
+
+		if (!fs)
+		{
+			char type[6];
+
+			dosTypeString(type, dosType);
+			messenger->textError("Volume %s has no file system that can be read (type %s)\n", volume->volName(), type);
+		}
+		return fs;
+	}
+
+	bool FileSystem::readMeta(u64 block, u8 *buffer)
+	{
+		u8 *data;
+
+		{
+			std::lock_guard<std::mutex> lock(m_cacheLock);
+			auto i = m_cache.find(block);
+
+			if (i != m_cache.end())
+			{
+				m_ages.splice(m_ages.begin(), m_ages, i->second.age);
+				memcpy(buffer, i->second.data, m_blockBytes);
+				return true;
+			}
+		}
+
+		if (!readData(buffer, block, 1))
+			return false;
+
+		data = new u8[m_blockBytes];
+		memcpy(data, buffer, m_blockBytes);
+
+		std::lock_guard<std::mutex> lock(m_cacheLock);
+
+		// another thread may have read it meanwhile
+		if (m_cache.count(block))
+		{
+			delete [] data;
+			return true;
+		}
+
+		if (m_cache.size() >= FS_CACHE_BLOCKS)
+		{
+			auto oldest = m_cache.find(m_ages.back());
+
+			delete [] oldest->second.data;
+			m_cache.erase(oldest);
+			m_ages.pop_back();
+		}
+
+		m_ages.push_front(block);
+		m_cache[block] = {data, m_ages.begin()};
+		return true;
+	}
+
+	bool FileSystem::readData(void *buffer, u64 block, u64 count)
+	{
+		std::lock_guard<std::mutex> lock(m_ioLock);
+		u64 perBlock = m_blockBytes / BLOCKSIZE;
+
+		return m_volume->volReadDevice(buffer, block * perBlock, count * perBlock);
+	}
+
+	std::shared_ptr<const ExtentMap> FileSystem::cachedMap(u64 key)
+	{
+		std::lock_guard<std::mutex> lock(m_cacheLock);
+		auto i = m_maps.find(key);
+
+		if (i == m_maps.end())
+			return nullptr;
+		m_mapAges.splice(m_mapAges.begin(), m_mapAges, i->second.age);
+		return i->second.map;
+	}
+
+	void FileSystem::cacheMap(u64 key, const std::shared_ptr<const ExtentMap> &map)
+	{
+		std::lock_guard<std::mutex> lock(m_cacheLock);
+
+		if (m_maps.count(key))
+			return;
+
+		if (m_maps.size() >= FS_MAP_CACHE)
+		{
+			m_maps.erase(m_mapAges.back());
+			m_mapAges.pop_back();
+		}
+
+		m_mapAges.push_front(key);
+		m_maps[key] = {map, m_mapAges.begin()};
+	}
+
+	std::shared_ptr<const ExtentMap> FileSystem::fileMap(const FileInfo &info)
+	{
+		std::shared_ptr<const ExtentMap> map = cachedMap(info.key);
+
+		if (!map)
+		{
+			map = mapFile(info);
+			cacheMap(info.key, map);
+		}
+		return map;
+	}
+
+	u32 FileSystem::blockBytes(void)
+	{
+		return m_blockBytes;
+	}
+
+	u32 FileSystem::dataOffset(void)
+	{
+		return 0;
+	}
+
+	/*
+	 * Names are Latin-1, and fold as the international AmigaDOS file systems fold them.
+	 */
+	static u8 upperLatin1(u8 c)
+	{
+		if ((c >= 'a' && c <= 'z') || (c >= 224 && c <= 254 && c != 247))
+			return c - 32;
+		return c;
+	}
+
+	bool FileSystem::lookup(const FileInfo &dir, const char *name, FileInfo &info)
+	{
+		std::vector<FileInfo> entries;
+		size_t len = strlen(name);
+
+		if (!list(dir, entries))
+			return false;
+
+		for (FileInfo &e : entries)
+		{
+			size_t i;
+
+			if (e.name.size() != len)
+				continue;
+			for (i = 0; i < len; i++)
+				if (upperLatin1(e.name[i]) != upperLatin1(name[i]))
+					break;
+			if (i == len)
+			{
+				info = e;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/*
+	 * Anything up to a colon is the volume's name, which is ignored. Empty names,
+	 * from doubled or trailing slashes, are skipped.
+	 */
+	bool FileSystem::resolve(const char *path, FileInfo &info)
+	{
+		const char *colon = strchr(path, ':');
+		const char *p = colon ? colon + 1 : path;
+		std::string name;
+
+		if (!rootInfo(info))
+			return false;
+
+		while (*p)
+		{
+			const char *slash = strchr(p, '/');
+			size_t len = slash ? (size_t)(slash - p) : strlen(p);
+
+			if (len)
+			{
+				FileInfo entry;
+
+				if (info.type != FT_DIR)
+					return false;
+				name.assign(p, len);
+				if (!lookup(info, name.c_str(), entry))
+					return false;
+				info = entry;
+			}
+			p += len;
+			if (*p == '/')
+				p++;
+		}
+		return true;
+	}
+
+	bool FileSystem::stat(const char *path, FileInfo &info)
+	{
+		TraceSpan span("stat", "fs");
+
+		return resolve(path, info);
+	}
+
+	bool FileSystem::readDir(const char *path, std::vector<FileInfo> &entries)
+	{
+		TraceSpan span("readdir", "fs");
+		FileInfo dir;
+
+		entries.clear();
+		if (!resolve(path, dir) || dir.type != FT_DIR)
+			return false;
+		return list(dir, entries);
+	}
+
+	/*
+	 * Hard links can lead back to a directory already seen, or into a loop, so the
+	 * keys of the directories walked are kept, as is a bound on the depth.
+	 */
+	void FileSystem::walkDir(const FileInfo &dir, const std::string &path, int depth, std::unordered_set<u64> &seen,
+		const std::function<void(const std::string &path, const FileInfo &info, const ExtentMap &map)> &visit)
+	{
+		std::vector<FileInfo> entries;
+
+		if (depth > FS_MAX_DEPTH || !seen.insert(dir.key).second)
+			return;
+
+		if (!list(dir, entries))
+			return;
+
+		for (FileInfo &e : entries)
+		{
+			std::string name = path.empty() ? e.name : path + "/" + e.name;
+
+			if (e.type == FT_DIR)
+				walkDir(e, name, depth + 1, seen, visit);
+			else if (e.type == FT_FILE)
+				visit(name, e, *fileMap(e));
+		}
+	}
+
+	bool FileSystem::walk(const std::function<void(const std::string &path, const FileInfo &info, const ExtentMap &map)> &visit)
+	{
+		TraceSpan span("walk", "fs");
+		std::unordered_set<u64> seen;
+		FileInfo root;
+
+		if (!rootInfo(root))
+			return false;
+		walkDir(root, "", 0, seen, visit);
+		return true;
+	}
+
+	File *FileSystem::open(const char *path)
+	{
+		TraceSpan span("open", "fs");
+		FileInfo info;
+
+		if (!resolve(path, info) || info.type != FT_FILE)
+			return nullptr;
+		return openFile(info);
+	}
+}
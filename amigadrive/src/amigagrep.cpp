@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "amigagrep.h"
+#include "amigadumpfile.h"
+#include "amigafs.h"
+#include "amigaparallel.h"
+#include "amigatrace.h"
+
+// a byte of a word tests as zero in the high bit of the byte of (x - LOW) & ~x & HIGH
+#define SWAR_LOW 0x0101010101010101ULL
+#define SWAR_HIGH 0x8080808080808080ULL
+
+namespace amigadrive
+{
+	PatternSet::PatternSet()
+	{
+		m_maxLength = 0;
+		memset(m_bigrams, 0, sizeof(m_bigrams));
+	}
+
+	/*
+	 * Every pattern goes in the bucket of its first byte, and marks the bigrams it
+	 * can start with - all 256 of them for a single byte. The words which test for
+	 * first bytes are only kept while there are few enough to be worth it.
+	 */
+	bool PatternSet::add(const std::string &pattern, const std::string &label)
+	{
+		u8 first;
+		u32 second, b;
+
+		if (pattern.empty() || pattern.size() > GREP_MAX_PATTERN)
+			return false;
+
+		first = pattern[0];
+		for (second = 0; second < 256; second++)
+			if (pattern.size() == 1 || second == (u8)pattern[1])
+			{
+				u32 bigram = (first << 8) | second;
+
+				m_bigrams[bigram >> 6] |= 1ULL << (bigram & 63);
+			}
+
+		m_byFirst[first].push_back(m_patterns.size());
+		m_words.clear();
+		for (b = 0; b < 256; b++)
+			if (!m_byFirst[b].empty())
+				m_words.push_back(SWAR_LOW * b);
+		if (m_words.size() > GREP_WORD_BYTES)
+			m_words.clear();
+
+		m_patterns.push_back(pattern);
+		m_labels.push_back(label);
+		if (pattern.size() > m_maxLength)
+			m_maxLength = pattern.size();
+		return true;
+	}
+
+	bool PatternSet::addLiteral(const char *text)
+	{
+		std::string label = "\"";
+		char esc[8];
+
+		for (const char *p = text; *p; p++)
+			if ((u8)*p < 0x20 || (u8)*p > 0x7e || *p == '"' || *p == '\\')
+			{
+				snprintf(esc, sizeof(esc), "\\x%02x", (u8)*p);
+				label += esc;
+			}
+			else
+				label += *p;
+		label += '"';
+
+		return add(text, label);
+	}
+
+	bool PatternSet::addHex(const char *hex)
+	{
+		std::string pattern, label = "hex:";
+		const char *p = hex;
+		int digits = 0;
+		u8 byte = 0;
+
+		if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+			p += 2;
+
+		for (; *p; p++)
+		{
+			char c = *p;
+
+			if (c == ' ' || c == ':')
+				continue;
+			if (c >= '0' && c <= '9')
+				byte = (byte << 4) | (c - '0');
+			else if (c >= 'a' && c <= 'f')
+				byte = (byte << 4) | (c - 'a' + 10);
+			else if (c >= 'A' && c <= 'F')
+				byte = (byte << 4) | (c - 'A' + 10);
+			else
+				return false;
+
+			if (++digits % 2 == 0)
+			{
+				char text[4];
+
+				pattern += (char)byte;
+				snprintf(text, sizeof(text), "%02x", byte);
+				label += text;
+				byte = 0;
+			}
+		}
+
+		return digits % 2 == 0 && add(pattern, label);
+	}
+
+	u32 PatternSet::patternCount(void)
+	{
+		return m_patterns.size();
+	}
+
+	u32 PatternSet::maxLength(void)
+	{
+		return m_maxLength;
+	}
+
+	const char *PatternSet::label(u32 pattern)
+	{
+		return m_labels[pattern].c_str();
+	}
+
+	inline void PatternSet::check(const u8 *data, u64 at, u64 bytes, u64 base, std::vector<GrepMatch> &found) const
+	{
+		const std::vector<u32> &bucket = m_byFirst[data[at]];
+
+		if (bucket.empty())
+			return;
+
+		if (at + 1 < bytes)
+		{
+			u32 bigram = (data[at] << 8) | data[at + 1];
+
+			if (!((m_bigrams[bigram >> 6] >> (bigram & 63)) & 1))
+				return;
+		}
+
+		for (u32 p : bucket)
+		{
+			const std::string &s = m_patterns[p];
+
+			if (at + s.size() <= bytes && !memcmp(data + at, s.data(), s.size()))
+				found.push_back({base + at / BLOCKSIZE, (u32)(at % BLOCKSIZE), p, 0, std::string(), -1});
+		}
+	}
+
+	/*
+	 * A word with none of the first bytes in it can't start a match, and on most
+	 * data most words are like that. The words are tested without branching on
+	 * each byte, which the compiler keeps in registers and may vectorise.
+	 */
+	void PatternSet::search(const u8 *data, u64 scan, u64 bytes, u64 base, std::vector<GrepMatch> &found) const
+	{
+		u64 i = 0, j;
+
+		if (!m_words.empty())
+			for (; i + 8 <= scan; i += 8)
+			{
+				u64 w, hit = 0;
+
+				memcpy(&w, data + i, 8);
+				for (u64 first : m_words)
+				{
+					u64 x = w ^ first;
+
+					hit |= (x - SWAR_LOW) & ~x & SWAR_HIGH;
+				}
+				if (!hit)
+					continue;
+
+				for (j = i; j < i + 8; j++)
+					check(data, j, bytes, base, found);
+			}
+
+		for (; i < scan; i++)
+			check(data, i, bytes, base, found);
+	}
+
+	Grep::Grep(UI *messenger, PatternSet *patterns, unsigned workers)
+	{
+		m_messenger = messenger;
+		m_patterns = patterns;
+		m_workers = workers ? workers : defaultWorkerCount();
+	}
+
+	static bool beforeBlock(const GrepMatch &m, u64 block)
+	{
+		return m.block < block;
+	}
+
+	/*
+	 * Each partition with matches in it is mounted, if it can be, and its files'
+	 * extent maps are walked. Matches in the data of a file get its path, and their
+	 * offset in it.
+	 */
+	void Grep::attribute(Device *device, std::vector<GrepMatch> &matches)
+	{
+		TraceSpan span("attribute", "grep");
+		int I;
+
+		for (I = 1; I <= device->volumeCount(); I++)
+		{
+			Volume *V = device->volumeNumber(I);
+			u64 start = V->volStartBlock();
+			auto lo = std::lower_bound(matches.begin(), matches.end(), start, beforeBlock);
+			auto hi = std::lower_bound(lo, matches.end(), start + V->volBlockCount(), beforeBlock);
+			FileSystem *F;
+			SilentUI quiet;
+			u32 per, header, payload;
+
+			if (lo == hi)
+				continue;
+			for (auto i = lo; i != hi; ++i)
+				i->partition = I;
+
+			F = FileSystem::mount(V, &quiet);
+			if (!F)
+				continue;
+
+			per = F->blockBytes() / BLOCKSIZE;
+			header = F->dataOffset();
+			payload = F->blockBytes() - header;
+
+			F->walk([&](const std::string &path, const FileInfo &info, const ExtentMap &map)
+			{
+				for (const ExtentMap::Extent &e : map.extents())
+				{
+					u64 b0 = start + e.block * per;
+					u64 b1 = b0 + e.count * per;
+
+					for (auto i = std::lower_bound(lo, hi, b0, beforeBlock); i != hi && i->block < b1; ++i)
+					{
+						u64 within = (i->block - b0) % per * BLOCKSIZE + i->offset;
+						u64 index = e.index + (i->block - b0) / per;
+
+						i->file = path;
+						i->fileOffset = -1;
+						if (within >= header && index * payload + within - header < info.size)
+							i->fileOffset = index * payload + within - header;
+					}
+				}
+			});
+			delete F;
+		}
+	}
+
+	s64 Grep::run(const char *image, int partition, FILE *out)
+	{
+		TraceSpan span("grep", "grep");
+		std::vector<std::vector<GrepMatch>> found;
+		std::vector<GrepMatch> matches;
+		std::vector<const char *> names;
+		std::vector<Block *> buffers(m_workers, nullptr);
+		std::atomic<bool> failed(false);
+		ADFIO io;
+		Device *D = nullptr;
+		u64 first = 0, count, chunks, overlap, i;
+
+		try
+		{
+			D = new Device(&io, m_messenger, image, true);
+		}
+		catch (Exception E)
+		{
+			E.textMsg();
+		}
+		catch (u32 E)
+		{
+			;
+		}
+
+		if (!D)
+		{
+			m_messenger->textError("Couldn't open [%s]\n", image);
+			return -1;
+		}
+
+		count = D->blockCount();
+		if (partition)
+		{
+			if (partition < 0 || partition > D->volumeCount())
+			{
+				m_messenger->textError("[%s] has no partition %d\n", image, partition);
+				delete D;
+				return -1;
+			}
+			first = D->volumeNumber(partition)->volStartBlock();
+			count = D->volumeNumber(partition)->volBlockCount();
+		}
+
+		chunks = (count + GREP_CHUNK - 1) / GREP_CHUNK;
+		overlap = (m_patterns->maxLength() + BLOCKSIZE - 2) / BLOCKSIZE;
+		found.resize(chunks);
+
+		parallelFor(chunks, m_workers, [&](u64 c, unsigned w)
+		{
+			u64 start = first + c * GREP_CHUNK;
+			u64 left = first + count - start;
+			u64 n = (left < GREP_CHUNK) ? left : GREP_CHUNK;
+			u64 m = (left < n + overlap) ? left : n + overlap;
+
+			if (!buffers[w])
+				buffers[w] = new Block[GREP_CHUNK + overlap];
+
+			if (!D->readBlocks(buffers[w], start, m))
+			{
+				m_messenger->textError("Couldn't read blocks %lu to %lu of [%s]\n", start, start + m - 1, image);
+				failed = true;
+				return;
+			}
+			m_patterns->search((const u8 *)buffers[w], n * BLOCKSIZE, m * BLOCKSIZE, start, found[c]);
+		});
+
+		for (i = 0; i < m_workers; i++)
+			delete [] buffers[i];
+		for (i = 0; i < chunks; i++)
+			matches.insert(matches.end(), found[i].begin(), found[i].end());
+
+		attribute(D, matches);
+
+		// volName copies the name each time it's asked for
+		for (i = 1; i <= (u64)D->volumeCount(); i++)
+			names.push_back(D->volumeNumber(i)->volName());
+
+		for (GrepMatch &m : matches)
+		{
+			fprintf(out, "%s: block %lu +%u", image, m.block, m.offset);
+			if (m.partition)
+				fprintf(out, " partition %d (%s)", m.partition, names[m.partition - 1]);
+			if (!m.file.empty())
+			{
+				fprintf(out, " file %s", m.file.c_str());
+				if (m.fileOffset >= 0)
+					fprintf(out, " +%ld", m.fileOffset);
+			}
+			fprintf(out, ": %s\n", m_patterns->label(m.pattern));
+		}
+
+		delete D;
+		return failed ? -1 : (s64)matches.size();
+	}
+}
@@ -0,0 +1,170 @@
+#include <string.h>
+#include "amigahash.h"
+
+namespace amigadrive
+{
+	/*
+	 * Slicing-by-8 tables: s_crcTable[k][b] is the CRC of byte b followed by k zero
+	 * bytes, which lets the inner loop take eight bytes per step.
+	 */
+	static u32 s_crcTable[8][256];
+
+	static bool makeCRCTable(void)
+	{
+		u32 i, k, c;
+
+		for (i = 0; i < 256; i++)
+		{
+			c = i;
+			for (k = 0; k < 8; k++)
+				c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+			s_crcTable[0][i] = c;
+		}
+
+		for (i = 0; i < 256; i++)
+			for (k = 1; k < 8; k++)
+				s_crcTable[k][i] = (s_crcTable[k - 1][i] >> 8) ^ s_crcTable[0][s_crcTable[k - 1][i] & 0xFF];
+		return true;
+	}
+
+	static bool s_crcReady = makeCRCTable();
+
+	u32 crc32Update(u32 crc, const void *data, u64 len)
+	{
+		const u8 *p = (const u8 *)data;
+
+		crc = ~crc;
+
+		while (len >= 8)
+		{
+			u32 lo = crc ^ ((u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24));
+			u32 hi = (u32)p[4] | ((u32)p[5] << 8) | ((u32)p[6] << 16) | ((u32)p[7] << 24);
+
+			crc = s_crcTable[7][lo & 0xFF] ^ s_crcTable[6][(lo >> 8) & 0xFF] ^
+				s_crcTable[5][(lo >> 16) & 0xFF] ^ s_crcTable[4][lo >> 24] ^
+				s_crcTable[3][hi & 0xFF] ^ s_crcTable[2][(hi >> 8) & 0xFF] ^
+				s_crcTable[1][(hi >> 16) & 0xFF] ^ s_crcTable[0][hi >> 24];
+			p += 8;
+			len -= 8;
+		}
+
+		while (len--)
+			crc = (crc >> 8) ^ s_crcTable[0][(crc ^ *p++) & 0xFF];
+
+		return ~crc;
+	}
+
+	static inline u32 rol(u32 x, int n)
+	{
+		return (x << n) | (x >> (32 - n));
+	}
+
+	SHA1::SHA1()
+	{
+		m_h[0] = 0x67452301;
+		m_h[1] = 0xEFCDAB89;
+		m_h[2] = 0x98BADCFE;
+		m_h[3] = 0x10325476;
+		m_h[4] = 0xC3D2E1F0;
+		m_used = 0;
+		m_bytes = 0;
+	}
+
+	/*
+	 * One round of each kind. The schedule is kept as a ring of 16 words, which
+	 * stays in registers, and the four kinds of round get a loop each, so none of
+	 * them has a branch in it.
+	 */
+	#define SHA1_W(i) (w[(i) & 15] = rol(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^ w[((i) + 2) & 15] ^ w[(i) & 15], 1))
+	#define SHA1_ROUND(f, k, wi) \
+		{ \
+			u32 t = rol(a, 5) + (f) + e + (k) + (wi); \
+			e = d; d = c; c = rol(b, 30); b = a; a = t; \
+		}
+
+	void SHA1::block(const u8 *data)
+	{
+		u32 w[16];
+		u32 a, b, c, d, e;
+		int i;
+
+		for (i = 0; i < 16; i++)
+			w[i] = ((u32)data[4*i] << 24) | ((u32)data[4*i+1] << 16) | ((u32)data[4*i+2] << 8) | data[4*i+3];
+
+		a = m_h[0]; b = m_h[1]; c = m_h[2]; d = m_h[3]; e = m_h[4];
+
+		for (i = 0; i < 16; i++)
+			SHA1_ROUND(d ^ (b & (c ^ d)), 0x5A827999, w[i]);
+		for (; i < 20; i++)
+			SHA1_ROUND(d ^ (b & (c ^ d)), 0x5A827999, SHA1_W(i));
+		for (; i < 40; i++)
+			SHA1_ROUND(b ^ c ^ d, 0x6ED9EBA1, SHA1_W(i));
+		for (; i < 60; i++)
+			SHA1_ROUND((b & c) | (d & (b | c)), 0x8F1BBCDC, SHA1_W(i));
+		for (; i < 80; i++)
+			SHA1_ROUND(b ^ c ^ d, 0xCA62C1D6, SHA1_W(i));
+
+		m_h[0] += a; m_h[1] += b; m_h[2] += c; m_h[3] += d; m_h[4] += e;
+	}
+
+	void SHA1::update(const void *data, u64 len)
+	{
+		const u8 *p = (const u8 *)data;
+
+		m_bytes += len;
+
+		if (m_used)
+		{
+			u32 n = (len < 64 - m_used) ? len : 64 - m_used;
+
+			memcpy(m_buffer + m_used, p, n);
+			m_used += n;
+			p += n;
+			len -= n;
+			if (m_used < 64)
+				return;
+			block(m_buffer);
+			m_used = 0;
+		}
+
+		while (len >= 64)
+		{
+			block(p);
+			p += 64;
+			len -= 64;
+		}
+
+		memcpy(m_buffer, p, len);
+		m_used = len;
+	}
+
+	void SHA1::final(u8 digest[20])
+	{
+		u64 bits = m_bytes * 8;
+		u8 pad[72];
+		u32 n = (m_used < 56) ? 56 - m_used : 120 - m_used;
+		int i;
+
+		memset(pad, 0, sizeof(pad));
+		pad[0] = 0x80;
+		for (i = 0; i < 8; i++)
+			pad[n + i] = bits >> (56 - 8 * i);
+		update(pad, n + 8);
+
+		for (i = 0; i < 20; i++)
+			digest[i] = m_h[i / 4] >> (24 - 8 * (i % 4));
+	}
+
+	void hexString(char *out, const u8 *data, int len)
+	{
+		static const char digits[] = "0123456789abcdef";
+		int i;
+
+		for (i = 0; i < len; i++)
+		{
+			*out++ = digits[data[i] >> 4];
+			*out++ = digits[data[i] & 15];
+		}
+		*out = 0;
+	}
+}
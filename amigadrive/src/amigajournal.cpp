@@ -0,0 +1,119 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "amigajournal.h"
+
+namespace amigadrive
+{
+	CopyJournal::CopyJournal(UI *messenger)
+	{
+		m_messenger = messenger;
+		m_file = nullptr;
+		m_fileName[0] = 0;
+		m_header[0] = 0;
+	}
+
+	CopyJournal::~CopyJournal()
+	{
+		if (m_file)
+		{
+			fclose(m_file);
+			m_file = nullptr;
+		}
+		m_messenger = nullptr;
+	}
+
+	/*
+	 * The chunk lines have to run from 0 without a gap. Anything after the first
+	 * line which doesn't follow on - a line cut short by a crash, say - is ignored.
+	 */
+	bool CopyJournal::open(const char *fileName, const char *kind, s64 begin, s64 size)
+	{
+		char line[256];
+		FILE *f;
+
+		snprintf(m_fileName, sizeof(m_fileName), "%s", fileName);
+		snprintf(m_header, sizeof(m_header), "amigatool journal 1 %s %lld %lld %d\n", kind, (long long)begin, (long long)size, JOURNAL_CHUNK);
+		m_hashes.clear();
+
+		f = fopen(fileName, "r");
+		if (!f)
+		{
+			if (errno == ENOENT)
+				return true;
+			m_messenger->textError("Can't read journal [%s] - %s\n", fileName, strerror(errno));
+			return false;
+		}
+
+		if (!fgets(line, sizeof(line), f) || strcmp(line, m_header) != 0)
+		{
+			m_messenger->textError("Journal [%s] is for a different copy\n", fileName);
+			fclose(f);
+			return false;
+		}
+
+		while (fgets(line, sizeof(line), f))
+		{
+			unsigned long long chunk;
+			unsigned int crc;
+
+			if (!strchr(line, '\n') || sscanf(line, "%llu %x", &chunk, &crc) != 2 || chunk != m_hashes.size())
+				break;
+			m_hashes.push_back(crc);
+		}
+
+		fclose(f);
+		return true;
+	}
+
+	u64 CopyJournal::recordedChunks(void)
+	{
+		return m_hashes.size();
+	}
+
+	u32 CopyJournal::chunkHash(u64 chunk)
+	{
+		return chunk < m_hashes.size() ? m_hashes[chunk] : 0;
+	}
+
+	bool CopyJournal::start(u64 keep)
+	{
+		u64 i;
+
+		if (keep < m_hashes.size())
+			m_hashes.resize(keep);
+
+		// rewritten whole, so a torn last line from the run before is gone
+		m_file = fopen(m_fileName, "w");
+		if (!m_file)
+		{
+			m_messenger->textError("Can't write journal [%s] - %s\n", m_fileName, strerror(errno));
+			return false;
+		}
+
+		fputs(m_header, m_file);
+		for (i = 0; i < m_hashes.size(); i++)
+			fprintf(m_file, "%llu %08x\n", (unsigned long long)i, m_hashes[i]);
+		return fflush(m_file) == 0;
+	}
+
+	bool CopyJournal::record(u32 crc)
+	{
+		if (!m_file)
+			return false;
+
+		fprintf(m_file, "%llu %08x\n", (unsigned long long)m_hashes.size(), crc);
+		m_hashes.push_back(crc);
+		return fflush(m_file) == 0;
+	}
+
+	void CopyJournal::finish(void)
+	{
+		if (m_file)
+		{
+			fclose(m_file);
+			m_file = nullptr;
+		}
+		unlink(m_fileName);
+	}
+}
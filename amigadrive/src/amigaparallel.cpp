@@ -0,0 +1,46 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "amigaparallel.h"
+
+namespace amigadrive
+{
+	unsigned defaultWorkerCount(void)
+	{
+		unsigned n = std::thread::hardware_concurrency();
+
+		return n ? n : 1;
+	}
+
+	void parallelFor(u64 count, unsigned workers, const std::function<void(u64, unsigned)> &job)
+	{
+		std::atomic<u64> next(0);
+		std::vector<std::thread> pool;
+		unsigned w;
+
+		if (workers == 0)
+			workers = defaultWorkerCount();
+		if (workers > count)
+			workers = count;
+
+		// nothing to share out - don't pay for a thread
+		if (workers <= 1)
+		{
+			for (u64 i = 0; i < count; i++)
+				job(i, 0);
+			return;
+		}
+
+		for (w = 0; w < workers; w++)
+			pool.push_back(std::thread([&next, count, &job, w]()
+			{
+				u64 i;
+
+				while ((i = next.fetch_add(1)) < count)
+					job(i, w);
+			}));
+
+		for (w = 0; w < workers; w++)
+			pool[w].join();
+	}
+}
@@ -0,0 +1,332 @@
+#include <string.h>
+#include "amigapfs.h"
+#include "amigablock.h"
+#include "amigatrace.h"
+
+namespace amigadrive
+{
+	// the root extension block lists the superindex blocks
+	#define PFS_EX_SUPERINDEX 64
+	#define PFS_EX_SUPERINDEXES 16
+
+	// anode and index blocks: id, datestamp, sequence number, then anodes or indexes
+	#define PFS_SEQNR 8
+	#define PFS_ANODES 16
+	#define PFS_INDEXES 12
+	#define PFS_ANODE_BYTES 12
+
+	// a directory block: id, datestamp, the directory's anode, its parent's, then the entries
+	#define PFS_DB_ANODE 12
+	#define PFS_DB_ENTRIES 20
+
+	// a directory entry: size, type, anode, file size, date, protection, name, comment
+	#define PFS_DE_TYPE 1
+	#define PFS_DE_ANODE 2
+	#define PFS_DE_SIZE 6
+	#define PFS_DE_DAYS 10
+	#define PFS_DE_PROTECT 16
+	#define PFS_DE_NAMELEN 17
+	#define PFS_DE_NAME 18
+
+	// entry types, as AmigaDOS has them
+	#define PFS_ST_USERDIR 2
+	#define PFS_ST_SOFTLINK 3
+	#define PFS_ST_LINKDIR 4
+
+	PFSFileSystem::PFSFileSystem(Volume *volume, UI *messenger) : FileSystem(volume, messenger, volume->volBytesPerBlock())
+	{
+		m_blocks = (u64)volume->volBlockCount() * BLOCKSIZE / m_blockBytes;
+		m_options = 0;
+		m_reservedBytes = 0;
+		m_cluster = 0;
+		m_firstReserved = 0;
+		m_lastReserved = 0;
+		m_anodesPerBlock = 0;
+		m_indexPerBlock = 0;
+	}
+
+	bool PFSFileSystem::isPFS(u32 dosType)
+	{
+		u32 version = dosType & 0xFF;
+
+		return ((dosType & 0xFFFFFF00) == 0x50465300 || (dosType & 0xFFFFFF00) == 0x50445300) && version >= 1 && version <= 3;
+	}
+
+	/*
+	 * The reserved block size is checked before anything is read with it.
+	 */
+	bool PFSFileSystem::init(void)
+	{
+		u8 *head = new u8[m_blockBytes];
+		u8 *root = nullptr;
+		bool ok = false;
+		u32 i;
+
+		if (m_blocks > PFS_ROOTBLOCK && readMeta(PFS_ROOTBLOCK, head))
+		{
+			m_reservedBytes = be16(head + PFS_ROOT_RESERVEDBYTES);
+			m_firstReserved = be32(head + PFS_ROOT_FIRSTRESERVED);
+			m_lastReserved = be32(head + PFS_ROOT_LASTRESERVED);
+			ok = validBlockBytes(m_reservedBytes) && m_reservedBytes >= m_blockBytes && be32(head + PFS_ROOT_DISKSIZE) <= m_blocks &&
+				m_firstReserved <= PFS_ROOTBLOCK && m_lastReserved < m_blocks;
+		}
+		delete [] head;
+		if (!ok)
+			return false;
+
+		m_cluster = m_reservedBytes / m_blockBytes;
+		m_anodesPerBlock = (m_reservedBytes - PFS_ANODES) / PFS_ANODE_BYTES;
+		m_indexPerBlock = (m_reservedBytes - PFS_INDEXES) / 4;
+
+		root = new u8[m_reservedBytes];
+		ok = readReserved(PFS_ROOTBLOCK, root, 0);
+		if (ok)
+		{
+			const u8 *name = root + PFS_ROOT_NAME;
+
+			m_options = be32(root + PFS_ROOT_OPTIONS);
+			m_root.key = PFS_ANODE_ROOTDIR;
+			m_root.type = FT_DIR;
+			m_root.size = 0;
+			m_root.protect = 0;
+			m_root.days = be16(root + PFS_ROOT_DAYS);
+			m_root.mins = be16(root + PFS_ROOT_DAYS + 2);
+			m_root.ticks = be16(root + PFS_ROOT_DAYS + 4);
+			m_root.name.assign((const char *)name + 1, name[0] < 31 ? name[0] : 31);
+
+			// big volumes find their index blocks through superindex blocks, listed in the root extension
+			if (m_options & PFS_MODE_SUPERINDEX)
+			{
+				ok = (m_options & PFS_MODE_EXTENSION) && readReserved(be32(root + PFS_ROOT_EXTENSION), root, PFS_ID_EX);
+				for (i = 0; ok && i < PFS_EX_SUPERINDEXES; i++)
+					m_index.push_back(be32(root + PFS_EX_SUPERINDEX + i * 4));
+			}
+			else
+			{
+				for (i = 0; i < PFS_ROOT_INDEXES; i++)
+					m_index.push_back(be32(root + PFS_ROOT_INDEX + i * 4));
+			}
+		}
+		delete [] root;
+		return ok;
+	}
+
+	const char *PFSFileSystem::fsName(void)
+	{
+		return "PFS3";
+	}
+
+	/*
+	 * Reserved blocks are numbered in volume blocks, and cover m_cluster of them.
+	 * An id of 0 takes any block, for the root, which has none.
+	 */
+	bool PFSFileSystem::readReserved(u32 block, u8 *buffer, u32 id)
+	{
+		u32 i;
+
+		if (block < m_firstReserved || block > m_lastReserved || block + m_cluster > m_blocks)
+			return false;
+
+		for (i = 0; i < m_cluster; i++)
+			if (!readMeta(block + i, buffer + i * m_blockBytes))
+				return false;
+
+		if (id && be16(buffer) != id)
+		{
+			m_messenger->textWarning("Block %u of volume %s is damaged\n", block, m_volume->volName());
+			return false;
+		}
+		return true;
+	}
+
+	u32 PFSFileSystem::anodeBlock(u32 seqnr, u8 *buffer)
+	{
+		u32 perSuper = m_indexPerBlock * m_indexPerBlock;
+		u32 index, block;
+
+		{
+			std::lock_guard<std::mutex> lock(m_anodeLock);
+			auto i = m_anodeBlocks.find(seqnr);
+
+			if (i != m_anodeBlocks.end())
+				return i->second;
+		}
+
+		if (m_options & PFS_MODE_SUPERINDEX)
+		{
+			if (seqnr / perSuper >= m_index.size() || !readReserved(m_index[seqnr / perSuper], buffer, PFS_ID_SB))
+				return 0;
+			index = be32(buffer + PFS_INDEXES + (seqnr / m_indexPerBlock % m_indexPerBlock) * 4);
+		}
+		else
+		{
+			if (seqnr / m_indexPerBlock >= m_index.size())
+				return 0;
+			index = m_index[seqnr / m_indexPerBlock];
+		}
+
+		if (!readReserved(index, buffer, PFS_ID_IB))
+			return 0;
+		block = be32(buffer + PFS_INDEXES + (seqnr % m_indexPerBlock) * 4);
+
+		std::lock_guard<std::mutex> lock(m_anodeLock);
+		m_anodeBlocks[seqnr] = block;
+		return block;
+	}
+
+	/*
+	 * Volumes with split anode numbers keep the sequence number in the upper half
+	 * and the offset in the block in the lower; others just count anodes.
+	 */
+	bool PFSFileSystem::readAnode(u32 number, Anode &anode)
+	{
+		u8 *buffer = new u8[m_reservedBytes];
+		u32 seqnr, offset, block;
+		bool ok;
+
+		if (m_options & PFS_MODE_SPLITTED_ANODES)
+		{
+			seqnr = number >> 16;
+			offset = number & 0xFFFF;
+		}
+		else
+		{
+			seqnr = number / m_anodesPerBlock;
+			offset = number % m_anodesPerBlock;
+		}
+
+		block = anodeBlock(seqnr, buffer);
+		ok = offset < m_anodesPerBlock && block && readReserved(block, buffer, PFS_ID_AB) && be32(buffer + PFS_SEQNR) == seqnr;
+		if (ok)
+		{
+			const u8 *a = buffer + PFS_ANODES + offset * PFS_ANODE_BYTES;
+
+			anode.clusterSize = be32(a);
+			anode.block = be32(a + 4);
+			anode.next = be32(a + 8);
+		}
+		else
+			m_messenger->textWarning("Anode %u of volume %s is damaged\n", number, m_volume->volName());
+
+		delete [] buffer;
+		return ok;
+	}
+
+	bool PFSFileSystem::rootInfo(FileInfo &info)
+	{
+		info = m_root;
+		return true;
+	}
+
+	bool PFSFileSystem::entryInfo(const u8 *entry, u32 room, FileInfo &info)
+	{
+		u32 nameLen;
+		s8 type;
+
+		if (room <= PFS_DE_NAME || entry[0] > room)
+			return false;
+
+		nameLen = entry[PFS_DE_NAMELEN];
+		type = (s8)entry[PFS_DE_TYPE];
+		if (PFS_DE_NAME + nameLen + 1 > entry[0] || PFS_DE_NAME + nameLen + 1 + entry[PFS_DE_NAME + nameLen] > entry[0])
+			return false;
+
+		info.key = be32(entry + PFS_DE_ANODE);
+		info.size = be32(entry + PFS_DE_SIZE);
+		info.days = be16(entry + PFS_DE_DAYS);
+		info.mins = be16(entry + PFS_DE_DAYS + 2);
+		info.ticks = be16(entry + PFS_DE_DAYS + 4);
+		info.protect = entry[PFS_DE_PROTECT];
+		info.name.assign((const char *)entry + PFS_DE_NAME, nameLen);
+		info.comment.assign((const char *)entry + PFS_DE_NAME + nameLen + 1, entry[PFS_DE_NAME + nameLen]);
+
+		if (type == PFS_ST_USERDIR || type == PFS_ST_LINKDIR)
+		{
+			info.type = FT_DIR;
+			info.size = 0;
+		}
+		else
+			info.type = type == PFS_ST_SOFTLINK ? FT_SOFTLINK : FT_FILE;
+		return true;
+	}
+
+	/*
+	 * Each anode of a directory is a run of directory blocks, whose entries end at
+	 * one with a size of 0.
+	 */
+	bool PFSFileSystem::list(const FileInfo &dir, std::vector<FileInfo> &entries)
+	{
+		u8 *buffer = new u8[m_reservedBytes];
+		u32 number = dir.key;
+		u64 steps = 0;
+		bool ok = true;
+
+		while (ok && number)
+		{
+			Anode anode;
+			u32 i;
+
+			if (++steps > m_blocks || !readAnode(number, anode))
+			{
+				ok = false;
+				break;
+			}
+
+			for (i = 0; ok && i < anode.clusterSize; i++)
+			{
+				u32 at = PFS_DB_ENTRIES;
+
+				if (!readReserved(anode.block + i * m_cluster, buffer, PFS_ID_DB) || be32(buffer + PFS_DB_ANODE) != dir.key)
+				{
+					ok = false;
+					break;
+				}
+
+				while (at < m_reservedBytes && buffer[at])
+				{
+					FileInfo info;
+
+					if (!entryInfo(buffer + at, m_reservedBytes - at, info))
+					{
+						m_messenger->textWarning("Directory %s of volume %s is damaged\n", dir.name.c_str(), m_volume->volName());
+						break;
+					}
+					entries.push_back(info);
+					at += buffer[at];
+				}
+			}
+			number = anode.next;
+		}
+
+		delete [] buffer;
+		return ok;
+	}
+
+	std::shared_ptr<const ExtentMap> PFSFileSystem::mapFile(const FileInfo &info)
+	{
+		TraceSpan span("map file", "fs");
+		u64 needed = (info.size + m_blockBytes - 1) / m_blockBytes;
+		ExtentMap *map = new ExtentMap;
+		u32 number = info.key;
+		u64 steps = 0;
+
+		while (map->blockCount() < needed && number && ++steps <= m_blocks)
+		{
+			Anode anode;
+			u32 i;
+
+			if (!readAnode(number, anode))
+				break;
+			for (i = 0; i < anode.clusterSize && map->blockCount() < needed; i++)
+				map->add((u64)anode.block + i);
+			number = anode.next;
+		}
+
+		return std::shared_ptr<const ExtentMap>(map);
+	}
+
+	File *PFSFileSystem::openFile(const FileInfo &info)
+	{
+		return new MappedFile(this, info, fileMap(info));
+	}
+}
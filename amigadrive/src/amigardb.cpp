@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "amigardb.h"
+#include "amigatrace.h"
+#include "endianness.h"
+
+namespace amigadrive
+{
+	RDBBlocks::RDBBlocks(DeviceIO *io, struct rigidDiskBlock *rdb, u32 blockBytes, Block *header, int headerBlocks)
+	{
+		m_io = io;
+		m_rdb = rdb;
+		m_blockBytes = blockBytes;
+		m_perBlock = blockBytes / BLOCKSIZE;
+		m_header = header;
+		m_headerBlocks = (headerBlocks > 0) ? headerBlocks : 0;
+	}
+
+	RDBBlocks::~RDBBlocks()
+	{
+		for (Window &w : m_windows)
+			delete [] w.data;
+		m_windows.clear();
+		m_header = nullptr;
+		m_io = nullptr;
+	}
+
+	u32 RDBBlocks::blockBytes(void)
+	{
+		return m_blockBytes;
+	}
+
+	/*
+	 * The RDB says which blocks it reserves for itself with rdbBlocksLo and
+	 * rdbBlocksHi, and its lists live there. Old tools left both zero.
+	 */
+	bool RDBBlocks::inArea(u32 block)
+	{
+		u32 lo = fe32(m_rdb->rdbBlocksLo);
+		u32 hi = fe32(m_rdb->rdbBlocksHi);
+
+		if (hi == 0 || hi < lo)
+			return true;
+		return block >= lo && block <= hi;
+	}
+
+	u8 *RDBBlocks::get(u32 block)
+	{
+		u64 device = (u64)block * m_perBlock;
+		u64 last = m_io->m_sectorCount / m_perBlock;
+		u32 hi = fe32(m_rdb->rdbBlocksHi);
+		Window w;
+
+		if (block == 0xFFFFFFFF || !inArea(block) || block >= last)
+			return nullptr;
+
+		if (device + m_perBlock <= m_headerBlocks)
+			return (u8 *)m_header[device];
+
+		for (Window &c : m_windows)
+			if (block >= c.first && block < c.first + c.count)
+				return (u8 *)c.data[(block - c.first) * m_perBlock];
+
+		// read ahead, but not past the end of the RDB area or the device
+		w.first = block;
+		w.count = RDB_PREFETCH;
+		if (hi >= fe32(m_rdb->rdbBlocksLo) && hi != 0 && (u64)hi + 1 - block < w.count)
+			w.count = hi + 1 - block;
+		if (last - block < w.count)
+			w.count = last - block;
+
+		w.data = new Block[w.count * m_perBlock];
+		if (!m_io->ioReadBlocks(w.data, device, w.count * m_perBlock))
+		{
+			// perhaps there's a bad block further on - settle for just this one
+			w.count = 1;
+			if (!m_io->ioReadBlocks(w.data, device, m_perBlock))
+			{
+				delete [] w.data;
+				return nullptr;
+			}
+		}
+
+		m_windows.push_back(w);
+		return (u8 *)w.data[0];
+	}
+
+	RDBChain::RDBChain(RDBBlocks *blocks, u32 first, u32 id)
+	{
+		m_blocks = blocks;
+		m_next = first;
+		m_block = first;
+		m_id = id;
+		m_broken = false;
+	}
+
+	u8 *RDBChain::next(void)
+	{
+		u32 bytes = m_blocks->blockBytes();
+		struct blockHeader *h;
+		u8 *b;
+
+		if (m_next == 0xFFFFFFFF || m_broken)
+			return nullptr;
+
+		m_block = m_next;
+		b = m_blocks->get(m_block);
+		h = (struct blockHeader *)b;
+
+		if (!b || !m_seen.insert(m_block).second || fe32(h->id) != m_id || sumBlock(h, bytes) != 0)
+		{
+			m_broken = true;
+			return nullptr;
+		}
+
+		// every list block has its link in the same place, straight after the header
+		m_next = fe32(((u32 *)b)[4]);
+		return b;
+	}
+
+	u32 RDBChain::block(void)
+	{
+		return m_block;
+	}
+
+	bool RDBChain::broken(void)
+	{
+		return m_broken;
+	}
+
+	/*
+	 * The FSHD blocks are kept as views, in the order of the chain.
+	 */
+	void Device::loadFileSystems(void)
+	{
+		TraceSpan span("file system chain", "device");
+		RDBChain chain(m_rdbBlocks, fe32(m_rdb->fileSysHeaderList), AMIGA_ID_FSHD);
+		u8 *p;
+
+		while ((p = chain.next()) != nullptr)
+			m_fileSystems.push_back((struct fileSysHeaderBlock *)p);
+
+		if (chain.broken())
+			m_messenger->textWarning("The file system list is broken at block %u\n", chain.block());
+	}
+
+	int Device::fileSystemCount(void)
+	{
+		return m_fileSystems.size();
+	}
+
+	const struct fileSysHeaderBlock *Device::fileSystemHeader(int fileSystem)
+	{
+		if (fileSystem < 1 || fileSystem > (int)m_fileSystems.size())
+			return nullptr;
+		return m_fileSystems[fileSystem - 1];
+	}
+
+	/*
+	 * An LSEG block's code is the longwords after its header, as many as summedLongs
+	 * says are in use.
+	 */
+	bool Device::fileSystemCode(int fileSystem, std::vector<u8> &code)
+	{
+		const struct fileSysHeaderBlock *fs = fileSystemHeader(fileSystem);
+		u8 *p;
+
+		code.clear();
+		if (!fs)
+			return false;
+
+		RDBChain chain(m_rdbBlocks, fe32(fs->segListBlocks), AMIGA_ID_LSEG);
+
+		while ((p = chain.next()) != nullptr)
+		{
+			struct loadSegBlock *l = (struct loadSegBlock *)p;
+			u32 longs = fe32(l->summedLongs);
+
+			if (longs > 5)
+				code.insert(code.end(), (u8 *)l->loadData, (u8 *)l->loadData + (longs - 5) * 4);
+		}
+
+		return !chain.broken() && !code.empty();
+	}
+
+	bool Device::extractFileSystems(const char *dir)
+	{
+		std::vector<u8> code;
+		bool ok = true;
+		int I;
+
+		if (m_fileSystems.empty())
+		{
+			m_messenger->textError("There are no file systems stored on the drive\n");
+			return false;
+		}
+
+		if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+		{
+			m_messenger->textError("Can't create directory [%s] - %s\n", dir, strerror(errno));
+			return false;
+		}
+
+		for (I = 1; I <= fileSystemCount(); I++)
+		{
+			const struct fileSysHeaderBlock *fs = fileSystemHeader(I);
+			u32 dosType = fe32(fs->dosType);
+			u32 version = fe32(fs->version);
+			char type[6], name[4096];
+			FILE *f;
+			int i;
+
+			// DOS\3 becomes DOS3, and anything awkward in a file name becomes _
+			dosTypeString(type, dosType);
+			type[3] = type[4];
+			type[4] = 0;
+			for (i = 0; i < 4; i++)
+				if ((u8)type[i] < 0x21 || (u8)type[i] > 0x7e || type[i] == '/' || type[i] == '\\')
+					type[i] = '_';
+			snprintf(name, sizeof(name), "%s/%d-%s-%u.%u.bin", dir, I, type, version >> 16, version & 0xFFFF);
+
+			if (!fileSystemCode(I, code))
+			{
+				m_messenger->textError("The code of file system %d is missing or broken\n", I);
+				ok = false;
+				continue;
+			}
+
+			f = fopen(name, "wb");
+			if (!f || fwrite(code.data(), 1, code.size(), f) != code.size())
+			{
+				m_messenger->textError("Can't write [%s]\n", name);
+				ok = false;
+			}
+			else
+				m_messenger->textInfo("File system %d -> [%s], %lu bytes\n", I, name, code.size());
+			if (f && fclose(f) != 0)
+				ok = false;
+		}
+
+		return ok;
+	}
+}
@@ -0,0 +1,772 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "amigarecover.h"
+#include "amigablock.h"
+#include "amigaffs.h"
+#include "amigasfs.h"
+#include "amigapfs.h"
+#include "amigaparallel.h"
+#include "amigatrace.h"
+#include "endianness.h"
+
+// the longest PART chain followed
+#define RECOVER_MAX_PARTS 128
+
+namespace amigadrive
+{
+	PartitionRecovery::PartitionRecovery(Device *device, UI *messenger, unsigned workers)
+	{
+		m_device = device;
+		m_messenger = messenger;
+		m_workers = workers ? workers : defaultWorkerCount();
+	}
+
+	const std::vector<RecoveredLayout> &PartitionRecovery::layouts(void)
+	{
+		return m_layouts;
+	}
+
+	/*
+	 * File systems of a family share their first blocks, whatever the partition's
+	 * dos type says of the variant.
+	 */
+	static bool sameFamily(u32 a, u32 b)
+	{
+		return a == b || (FFSFileSystem::isFFS(a) && FFSFileSystem::isFFS(b)) || (SFSFileSystem::isSFS(a) && SFSFileSystem::isSFS(b)) ||
+			(PFSFileSystem::isPFS(a) && PFSFileSystem::isPFS(b));
+	}
+
+	/*
+	 * Most blocks are data, and the first longword rules them out without a
+	 * checksum being worked out. RDB blocks are kept whole, as they're put back
+	 * together later; of the rest only where they are matters.
+	 */
+	void PartitionRecovery::sweepBlock(u64 block, const u8 *buffer, u32 room, std::vector<Signature> &found)
+	{
+		struct blockHeader *header = (struct blockHeader *)buffer;
+		u32 id = be32(buffer);
+		u32 bytes;
+
+		switch (id)
+		{
+			case AMIGA_ID_RDISK:
+				bytes = fe32(((struct rigidDiskBlock *)buffer)->blockBytes);
+				if (!validBlockBytes(bytes) || bytes > RDB_MAX_BLOCKBYTES)
+					bytes = BLOCKSIZE;
+				break;
+
+			case AMIGA_ID_PART:
+			case AMIGA_ID_FSHD:
+			case AMIGA_ID_LSEG:
+			case AMIGA_ID_BADB:
+			case AMIGA_ID_BOOT:
+				bytes = RDB_MAX_BLOCKBYTES;
+				break;
+
+			case FFS_T_HEADER:
+				// a root block, which names itself by its hash table's size rather than its key
+				bytes = be32(buffer + 12);
+				if (bytes > MAX_BLOCKBYTES / 4 - 56)
+					return;
+				bytes = (bytes + 56) * 4;
+				if (validBlockBytes(bytes) && bytes <= room && be32(buffer + 4) == 0 &&
+					(s32)be32(buffer + bytes - FFS_SECTYPE) == FFS_ST_ROOT && blockKernels(bytes)->sum(buffer, bytes) == 0)
+				{
+					found.push_back({block, Signature::ROOT, bytes, {0}});
+				}
+				return;
+
+			default:
+				if (FFSFileSystem::isFFS(id) || SFSFileSystem::isSFS(id) || PFSFileSystem::isPFS(id))
+					found.push_back({block, Signature::BOOT, id, {0}});
+				return;
+		}
+
+		if (bytes > room)
+			bytes = room;
+		if (sumBlock(header, bytes) == 0)
+		{
+			found.push_back({block, Signature::RDB, id, {0}});
+			memcpy(found.back().copy, buffer, BLOCKSIZE);
+		}
+	}
+
+	/*
+	 * An FFS root block is midway through its file system, so the boot blocks before
+	 * it are tried, nearest first, as its start. Which one it is shows in the blocks
+	 * the root points at: the first header in its hash table names itself by its
+	 * block number counted from the start, and failing that the first bitmap block
+	 * must be sound. SFS and PFS give their sizes in their root blocks.
+	 */
+	bool PartitionRecovery::checkRoot(u64 start, u64 root, u32 blockBytes, u64 blocks)
+	{
+		u32 per = blockBytes / BLOCKSIZE;
+		u32 hashSize = blockBytes / 4 - 56;
+		Block *buffer = new Block[2 * per];
+		u8 *rootBlock = (u8 *)buffer;
+		u8 *block = (u8 *)&buffer[per];
+		bool ok = false;
+		u32 i, key = 0;
+
+		if (m_device->readBlocks(buffer, start + root * per, per))
+		{
+			for (i = 0; i < hashSize && !key; i++)
+				key = be32(rootBlock + FFS_TABLE + i * 4);
+
+			if (key)
+				ok = key > 1 && key < blocks && m_device->readBlocks((Block *)block, start + (u64)key * per, per) &&
+					be32(block) == FFS_T_HEADER && be32(block + 4) == key && blockKernels(blockBytes)->sum(block, blockBytes) == 0;
+			else
+			{
+				key = be32(rootBlock + blockBytes - FFS_BITMAP);
+				ok = key > 1 && key < blocks && m_device->readBlocks((Block *)block, start + (u64)key * per, per) &&
+					blockKernels(blockBytes)->sum(block, blockBytes) == 0;
+			}
+		}
+		delete [] buffer;
+		return ok;
+	}
+
+	void PartitionRecovery::findFileSystems(void)
+	{
+		u64 deviceBlocks = m_device->blockCount();
+		Block *buffer = new Block[MAX_BLOCKBYTES / BLOCKSIZE];
+		u8 *block = (u8 *)buffer;
+		std::vector<FileSystemFound> found;
+
+		for (auto &r : m_roots)
+		{
+			u32 per = r.second / BLOCKSIZE;
+			auto b = m_boots.lower_bound(r.first);
+			int tried = 0;
+
+			while (b != m_boots.begin() && tried < RECOVER_MAX_BOOTS)
+			{
+				u64 root, blocks;
+
+				--b;
+				if (!FFSFileSystem::isFFS(b->second) || (r.first - b->first) % per != 0)
+					continue;
+				tried++;
+
+				// the two boot blocks are reserved, so the root block is midway through an even or odd count
+				root = (r.first - b->first) / per;
+				blocks = 2 * root;
+				if (b->first + blocks * per > deviceBlocks)
+					blocks--;
+				if (root >= 2 && checkRoot(b->first, root, r.second, blocks))
+				{
+					found.push_back({b->first, blocks * per, b->second, r.second});
+					break;
+				}
+			}
+		}
+
+		for (auto &b : m_boots)
+		{
+			u64 left = deviceBlocks - b.first;
+
+			if (SFSFileSystem::isSFS(b.second))
+			{
+				u32 bytes;
+				u64 blocks;
+
+				if (!m_device->readBlocks(buffer, b.first, 1))
+					continue;
+				bytes = be32(block + SFS_ROOT_BLOCKSIZE);
+				if (!validBlockBytes(bytes) || bytes > MAX_BLOCKBYTES || bytes / BLOCKSIZE > left ||
+					!m_device->readBlocks(buffer, b.first, bytes / BLOCKSIZE))
+					continue;
+				blocks = (u64)be32(block + SFS_ROOT_TOTALBLOCKS) * (bytes / BLOCKSIZE);
+				if (be32(block) == SFS_ID_ROOT && be32(block + SFS_OWNBLOCK) == 0 &&
+					blockKernels(bytes)->sum(block, bytes) == 0xFFFFFFFF && blocks > 0 && blocks <= left)
+				{
+					found.push_back({b.first, blocks, b.second, bytes});
+				}
+			}
+			else if (PFSFileSystem::isPFS(b.second))
+			{
+				u64 blocks;
+
+				if (left <= PFS_ROOTBLOCK || !m_device->readBlocks(buffer, b.first + PFS_ROOTBLOCK, 1))
+					continue;
+				blocks = be32(block + PFS_ROOT_DISKSIZE);
+				if (PFSFileSystem::isPFS(be32(block)) && validBlockBytes(be16(block + PFS_ROOT_RESERVEDBYTES)) &&
+					be32(block + PFS_ROOT_FIRSTRESERVED) <= PFS_ROOTBLOCK && be32(block + PFS_ROOT_LASTRESERVED) < blocks &&
+					blocks > PFS_ROOTBLOCK && blocks <= left)
+				{
+					found.push_back({b.first, blocks, b.second, BLOCKSIZE});
+				}
+			}
+		}
+		delete [] buffer;
+
+		/*
+		 * File systems inside others - diskette images kept as files, say - aren't
+		 * partitions. Where two overlap by a block, the first was taken to have a
+		 * block more than it has.
+		 */
+		std::sort(found.begin(), found.end(), [](const FileSystemFound &a, const FileSystemFound &b)
+		{
+			return a.start < b.start || (a.start == b.start && a.count > b.count);
+		});
+		m_found.clear();
+		for (const FileSystemFound &f : found)
+		{
+			if (!m_found.empty())
+			{
+				FileSystemFound &last = m_found.back();
+
+				if (f.start < last.start + last.count)
+				{
+					if (f.start + last.blockBytes / BLOCKSIZE != last.start + last.count)
+						continue;
+					last.count -= last.blockBytes / BLOCKSIZE;
+				}
+			}
+			m_found.push_back(f);
+		}
+	}
+
+	/*
+	 * The partition's cylinders move with the offset if it's a whole number of
+	 * them; otherwise the geometry is given in single sectors.
+	 */
+	bool PartitionRecovery::place(const struct partitionBlock &part, s64 offset, u32 rdbBlockBytes, RecoveredPartition &partition)
+	{
+		struct amigaPartGeometry *g;
+		u32 sectorBytes;
+		u64 perSector, cylSectors, lowCyl, highCyl, count;
+		s64 start;
+
+		partition.part = part;
+		g = (struct amigaPartGeometry *)&(partition.part.environment);
+		sectorBytes = fe32(g->sizeBlocks) * 4;
+		if (!validBlockBytes(sectorBytes))
+		{
+			sectorBytes = rdbBlockBytes;
+			g->sizeBlocks = fe32(sectorBytes / 4);
+		}
+
+		perSector = sectorBytes / BLOCKSIZE;
+		cylSectors = (u64)fe32(g->blockPerTrack) * fe32(g->surfaces);
+		lowCyl = fe32(g->lowCyl);
+		highCyl = fe32(g->highCyl);
+		if (!cylSectors || highCyl < lowCyl)
+			return false;
+
+		start = offset + (s64)(lowCyl * cylSectors * perSector);
+		count = (highCyl - lowCyl + 1) * cylSectors * perSector;
+		if (start < 0 || (u64)start + count > m_device->blockCount())
+			return false;
+
+		if (offset % (s64)(cylSectors * perSector) == 0)
+		{
+			lowCyl += offset / (s64)(cylSectors * perSector);
+			highCyl += offset / (s64)(cylSectors * perSector);
+		}
+		else if (start % perSector == 0)
+		{
+			g->surfaces = fe32(1);
+			g->blockPerTrack = fe32(1);
+			lowCyl = start / perSector;
+			highCyl = (start + count) / perSector - 1;
+		}
+		else
+			return false;
+		if (highCyl > 0xFFFFFFFF)
+			return false;
+		g->lowCyl = fe32(lowCyl);
+		g->highCyl = fe32(highCyl);
+
+		partition.start = start;
+		partition.count = count;
+		auto boot = m_boots.find(start);
+		partition.found = boot != m_boots.end() && sameFamily(boot->second, fe32(g->dosType));
+		return true;
+	}
+
+	std::vector<u64> PartitionRecovery::partChain(u32 first, s64 offset, u32 perBlock)
+	{
+		std::vector<u64> chain;
+		std::set<u64> seen;
+		u32 next = first;
+
+		while (next != 0xFFFFFFFF && chain.size() < RECOVER_MAX_PARTS)
+		{
+			s64 block = offset + (s64)next * perBlock;
+			auto part = m_parts.find(block);
+
+			if (block < 0 || part == m_parts.end() || !seen.insert(block).second)
+				break;
+			chain.push_back(block);
+			next = fe32(part->second.next);
+		}
+		return chain;
+	}
+
+	/*
+	 * An RDSK block found may be at any of the first 16 blocks of the RDB, so
+	 * each is tried for where the RDB starts, and the one which reaches the most
+	 * PART blocks wins - where the RDSK block would start it if none do better.
+	 */
+	void PartitionRecovery::addRDSKLayouts(std::set<u64> &used)
+	{
+		for (auto &r : m_rdsks)
+		{
+			u32 bytes = fe32(r.second.blockBytes);
+			u32 per, k;
+			RecoveredLayout layout;
+			std::vector<u64> best;
+
+			if (!validBlockBytes(bytes) || bytes > RDB_MAX_BLOCKBYTES)
+				bytes = BLOCKSIZE;
+			per = bytes / BLOCKSIZE;
+
+			layout.source = RecoveredLayout::FROM_RDSK;
+			layout.block = r.first;
+			layout.rdbBlockBytes = bytes;
+			layout.offset = (r.first % per == 0 && r.first / per < AMIGA_BLOCK_LIMIT) ? 0 : (s64)r.first;
+			best = partChain(fe32(r.second.partitionList), layout.offset, per);
+
+			for (k = 0; k < AMIGA_BLOCK_LIMIT; k++)
+			{
+				s64 offset = (s64)r.first - (s64)k * per;
+				std::vector<u64> chain = partChain(fe32(r.second.partitionList), offset, per);
+
+				if (chain.size() > best.size())
+				{
+					best = chain;
+					layout.offset = offset;
+				}
+			}
+
+			for (u64 block : best)
+			{
+				RecoveredPartition p;
+
+				used.insert(block);
+				if (place(m_parts[block], layout.offset, bytes, p))
+					layout.partitions.push_back(p);
+			}
+			m_layouts.push_back(layout);
+		}
+	}
+
+	/*
+	 * PART blocks without an RDSK block don't say where they are, but the next
+	 * block each names, and the file systems found where they say partitions
+	 * start, suggest where the RDB began. The offset which puts the most
+	 * partitions on file systems, and links the most PART blocks, is taken.
+	 */
+	void PartitionRecovery::addPARTLayout(const std::set<u64> &used)
+	{
+		std::vector<u64> orphans;
+		std::map<s64, int> votes;
+		RecoveredLayout layout;
+		int best = -1;
+
+		layout.offset = 0;
+		for (auto &p : m_parts)
+			if (!used.count(p.first))
+				orphans.push_back(p.first);
+		if (orphans.empty())
+			return;
+
+		votes[0] = 0;
+		for (u64 p : orphans)
+		{
+			u32 next = fe32(m_parts[p].next);
+			RecoveredPartition at0;
+
+			if (next != 0xFFFFFFFF)
+				for (u64 q : orphans)
+					if (q != p)
+						votes[(s64)q - next]++;
+
+			// where the partition would be with the RDB at the start of the device
+			if (place(m_parts[p], 0, BLOCKSIZE, at0))
+				for (const FileSystemFound &f : m_found)
+					if (sameFamily(f.dosType, fe32(((struct amigaPartGeometry *)&at0.part.environment)->dosType)))
+						votes.insert({(s64)f.start - (s64)at0.start, 0});
+		}
+
+		for (auto &v : votes)
+		{
+			std::vector<RecoveredPartition> partitions;
+			int score = v.second;
+
+			for (u64 p : orphans)
+			{
+				RecoveredPartition q;
+
+				if (place(m_parts[p], v.first, BLOCKSIZE, q))
+				{
+					partitions.push_back(q);
+					if (q.found)
+						score += 3;
+				}
+			}
+			if (score > best || (score == best && std::llabs(v.first) < std::llabs(layout.offset)))
+			{
+				best = score;
+				layout.offset = v.first;
+				layout.partitions = partitions;
+			}
+		}
+
+		// copies of a PART block, and stale ones a new table overlaps, give way to partitions with file systems
+		std::stable_sort(layout.partitions.begin(), layout.partitions.end(), [](const RecoveredPartition &a, const RecoveredPartition &b)
+		{
+			return a.found && !b.found;
+		});
+		std::vector<RecoveredPartition> kept;
+		for (const RecoveredPartition &p : layout.partitions)
+		{
+			bool overlaps = false;
+
+			for (const RecoveredPartition &k : kept)
+				if (p.start < k.start + k.count && k.start < p.start + p.count)
+					overlaps = true;
+			if (!overlaps)
+				kept.push_back(p);
+		}
+		std::sort(kept.begin(), kept.end(), [](const RecoveredPartition &a, const RecoveredPartition &b)
+		{
+			return a.start < b.start;
+		});
+
+		layout.source = RecoveredLayout::FROM_PARTS;
+		layout.block = 0;
+		layout.rdbBlockBytes = BLOCKSIZE;
+		layout.partitions = kept;
+		m_layouts.push_back(layout);
+	}
+
+	/*
+	 * The file systems found become partitions of their own, named as a hardfile's
+	 * would be. Cylinders are a track of 32 sectors where the partition is whole
+	 * tracks, else a sector.
+	 */
+	void PartitionRecovery::addFileSystemLayout(void)
+	{
+		RecoveredLayout layout;
+		int number = 0;
+
+		if (m_found.empty())
+			return;
+
+		layout.source = RecoveredLayout::FROM_FILESYSTEMS;
+		layout.block = 0;
+		layout.offset = 0;
+		layout.rdbBlockBytes = BLOCKSIZE;
+
+		for (const FileSystemFound &f : m_found)
+		{
+			RecoveredPartition p;
+			struct amigaPartGeometry *g;
+			u32 sectors = (f.start % 32 == 0 && f.count % 32 == 0) ? 32 : 1;
+			char name[32];
+
+			if ((f.start + f.count) / sectors - 1 > 0xFFFFFFFF)
+				continue;
+
+			memset(&p.part, 0, sizeof(p.part));
+			p.part.id = fe32(AMIGA_ID_PART);
+			p.part.summedLongs = fe32(sizeof(struct partitionBlock) / 4);
+			p.part.hostid = fe32(7);
+			p.part.next = 0xFFFFFFFF;
+			snprintf(name, sizeof(name), "DH%d", number++);
+			p.part.driveName[0] = strlen(name);
+			memcpy(&p.part.driveName[1], name, strlen(name));
+
+			g = (struct amigaPartGeometry *)&(p.part.environment);
+			g->tableSize = fe32(16);
+			g->sizeBlocks = fe32(BLOCKSIZE / 4);
+			g->surfaces = fe32(1);
+			g->sectorPerBlock = fe32(f.blockBytes / BLOCKSIZE);
+			g->blockPerTrack = fe32(sectors);
+			g->reserved = fe32(2);
+			g->lowCyl = fe32(f.start / sectors);
+			g->highCyl = fe32((f.start + f.count) / sectors - 1);
+			g->numBuffers = fe32(30);
+			g->maxTransfer = fe32(0x7FFFFFFF);
+			g->mask = fe32(0xFFFFFFFE);
+			g->dosType = fe32(f.dosType);
+
+			p.start = f.start;
+			p.count = f.count;
+			p.found = true;
+			layout.partitions.push_back(p);
+		}
+		m_layouts.push_back(layout);
+	}
+
+	/*
+	 * Three for each partition with its file system where it starts, one more for
+	 * each found as a PART block, two for an RDSK block, and four off for each two
+	 * partitions which overlap.
+	 */
+	void PartitionRecovery::score(RecoveredLayout &layout)
+	{
+		size_t i, j;
+
+		layout.score = (layout.source == RecoveredLayout::FROM_RDSK) ? 2 : 0;
+		for (i = 0; i < layout.partitions.size(); i++)
+		{
+			const RecoveredPartition &p = layout.partitions[i];
+
+			if (p.found)
+				layout.score += 3;
+			if (layout.source != RecoveredLayout::FROM_FILESYSTEMS)
+				layout.score++;
+			for (j = i + 1; j < layout.partitions.size(); j++)
+			{
+				const RecoveredPartition &q = layout.partitions[j];
+
+				if (p.start < q.start + q.count && q.start < p.start + p.count)
+					layout.score -= 4;
+			}
+		}
+	}
+
+	static bool samePartitions(const RecoveredLayout &a, const RecoveredLayout &b)
+	{
+		size_t i;
+
+		if (a.partitions.size() != b.partitions.size())
+			return false;
+		for (i = 0; i < a.partitions.size(); i++)
+			if (a.partitions[i].start != b.partitions[i].start || a.partitions[i].count != b.partitions[i].count)
+				return false;
+		return true;
+	}
+
+	/*
+	 * A chunk which can't be read is read again a block at a time, and the blocks
+	 * which still can't be are searched as zeroes.
+	 */
+	bool PartitionRecovery::sweep(void)
+	{
+		TraceSpan span("recover", "device");
+		u64 blocks = m_device->blockCount();
+		u64 chunks = (blocks + RECOVER_CHUNK - 1) / RECOVER_CHUNK, i;
+		std::vector<std::vector<Signature>> found(chunks);
+		std::vector<Block *> buffers(m_workers, nullptr);
+		std::atomic<u64> unreadable(0);
+		std::set<u64> used;
+		std::vector<RecoveredLayout> layouts;
+
+		m_rdsks.clear();
+		m_parts.clear();
+		m_fileSystems.clear();
+		m_others.clear();
+		m_boots.clear();
+		m_roots.clear();
+		m_layouts.clear();
+
+		parallelFor(chunks, m_workers, [&](u64 c, unsigned w)
+		{
+			u64 start = c * RECOVER_CHUNK;
+			u64 left = blocks - start;
+			u64 n = (left < RECOVER_CHUNK) ? left : RECOVER_CHUNK;
+			u64 m = (left < n + RECOVER_OVERLAP) ? left : n + RECOVER_OVERLAP;
+			u64 b;
+
+			if (!buffers[w])
+				buffers[w] = new Block[RECOVER_CHUNK + RECOVER_OVERLAP];
+
+			if (!m_device->readBlocks(buffers[w], start, m))
+				for (b = 0; b < m; b++)
+					if (!m_device->readBlocks(&buffers[w][b], start + b, 1))
+					{
+						memset(buffers[w][b], 0, BLOCKSIZE);
+						if (b < n)
+							unreadable++;
+					}
+
+			for (b = 0; b < n; b++)
+				sweepBlock(start + b, buffers[w][b], (m - b) * BLOCKSIZE, found[c]);
+		});
+
+		for (i = 0; i < m_workers; i++)
+			delete [] buffers[i];
+
+		for (i = 0; i < chunks; i++)
+			for (Signature &s : found[i])
+			{
+				if (s.kind == Signature::BOOT)
+					m_boots[s.block] = s.value;
+				else if (s.kind == Signature::ROOT)
+					m_roots[s.block] = s.value;
+				else if (s.value == AMIGA_ID_RDISK)
+					memcpy(&m_rdsks[s.block], s.copy, sizeof(struct rigidDiskBlock));
+				else if (s.value == AMIGA_ID_PART)
+					memcpy(&m_parts[s.block], s.copy, sizeof(struct partitionBlock));
+				else
+				{
+					if (s.value == AMIGA_ID_FSHD)
+						memcpy(&m_fileSystems[s.block], s.copy, sizeof(struct fileSysHeaderBlock));
+					m_others[s.block] = s.value;
+				}
+			}
+
+		if (unreadable)
+			m_messenger->textWarning("%lu blocks couldn't be read, and weren't searched\n", (u64)unreadable);
+
+		findFileSystems();
+		addRDSKLayouts(used);
+		addPARTLayout(used);
+		addFileSystemLayout();
+
+		for (RecoveredLayout &l : m_layouts)
+			score(l);
+		std::stable_sort(m_layouts.begin(), m_layouts.end(), [](const RecoveredLayout &a, const RecoveredLayout &b)
+		{
+			return a.score > b.score;
+		});
+
+		// a layout which is no more than another, better one is left out
+		for (const RecoveredLayout &l : m_layouts)
+		{
+			bool same = l.partitions.empty();
+
+			for (const RecoveredLayout &k : layouts)
+				if (samePartitions(k, l))
+					same = true;
+			if (!same)
+				layouts.push_back(l);
+		}
+		m_layouts = layouts;
+		return !m_layouts.empty();
+	}
+
+	/*
+	 * The new PART blocks go in blocks which held none of the RDB blocks found, and
+	 * are written before the RDSK block which lists them, so the old table stands
+	 * until the new one is whole. The RDSK block may take the place of an old one,
+	 * which it replaces in one write; an old RDSK block lower down would be found
+	 * first, so it can't go above one. Blocks holding file system drivers and the
+	 * other RDB blocks found are left alone. Where the layout came
+	 * from an RDSK block at the start of the device, that's kept with its drivers;
+	 * otherwise the first FSHD block no other lists is taken as the head of the list
+	 * of drivers, and the geometry is a hardfile's, of one head of 32 sectors.
+	 */
+	bool PartitionRecovery::write(const RecoveredLayout &layout)
+	{
+		TraceSpan span("recover write", "device");
+		u32 bytes = layout.rdbBlockBytes;
+		u32 per = bytes / BLOCKSIZE;
+		bool reuse = layout.source == RecoveredLayout::FROM_RDSK && layout.offset == 0;
+		std::vector<u64> room;
+		struct rigidDiskBlock rdb;
+		Block *buffer;
+		u64 first, limit, high, i;
+		bool ok = true;
+
+		if (layout.partitions.empty())
+			return false;
+
+		first = layout.partitions[0].start;
+		for (const RecoveredPartition &p : layout.partitions)
+			if (p.start < first)
+				first = p.start;
+		limit = first / per;
+
+		for (i = 0; i < limit && room.size() < layout.partitions.size() + 1; i++)
+			if (!m_others.count(i * per) && !m_parts.count(i * per) && (room.empty() || !m_rdsks.count(i * per)))
+				room.push_back(i);
+		if (room.size() < layout.partitions.size() + 1 || room[0] >= AMIGA_BLOCK_LIMIT)
+		{
+			m_messenger->textError("There's no room for an RDSK block and %lu PART blocks before the first partition, at block %lu\n",
+				layout.partitions.size(), first);
+			return false;
+		}
+		// the highest block the RDB takes up, with the drivers kept
+		high = room.back();
+		for (auto &o : m_others)
+			if (o.first < first && o.first / per > high)
+				high = o.first / per;
+
+		if (reuse)
+			rdb = m_rdsks[layout.block];
+		else
+		{
+			u64 blocks = m_device->blockCount();
+			u32 sectors = (blocks % 32 == 0) ? 32 : 1;
+
+			memset(&rdb, 0, sizeof(rdb));
+			rdb.id = fe32(AMIGA_ID_RDISK);
+			rdb.summedLongs = fe32(sizeof(struct rigidDiskBlock) / 4);
+			rdb.hostid = fe32(7);
+			rdb.blockBytes = fe32(bytes);
+			rdb.badBlockList = 0xFFFFFFFF;
+			rdb.fileSysHeaderList = 0xFFFFFFFF;
+			rdb.driveInit = 0xFFFFFFFF;
+			rdb.bootCodeBlock = 0xFFFFFFFF;
+			memset(rdb.reserved_1, 0xFF, sizeof(rdb.reserved_1));
+			rdb.cylinders = fe32((blocks / sectors > 0xFFFFFFFF) ? 0xFFFFFFFF : blocks / sectors);
+			rdb.sectors = fe32(sectors);
+			rdb.heads = fe32(1);
+			rdb.interleave = fe32(1);
+			rdb.park = rdb.cylinders;
+			rdb.rdbBlocksLo = 0;
+			rdb.rdbBlocksHi = fe32(limit - 1);
+			rdb.loCylinder = fe32(first / sectors);
+			rdb.hiCylinder = fe32(fe32(rdb.cylinders) - 1);
+			rdb.cylBlocks = fe32(sectors);
+
+			for (auto &f : m_fileSystems)
+			{
+				bool listed = false;
+
+				if (f.first >= first || f.first % per != 0)
+					continue;
+				for (auto &g : m_fileSystems)
+					if (fe32(g.second.next) == f.first / per)
+						listed = true;
+				if (!listed)
+				{
+					rdb.fileSysHeaderList = fe32(f.first / per);
+					break;
+				}
+			}
+		}
+		rdb.partitionList = fe32(room[1]);
+		rdb.highRDSKblock = fe32(high);
+		if (fe32(rdb.rdbBlocksHi) < high)
+			rdb.rdbBlocksHi = fe32(high);
+
+		buffer = new Block[per];
+		for (i = 0; ok && i < layout.partitions.size(); i++)
+		{
+			struct partitionBlock part = layout.partitions[i].part;
+
+			part.next = (i + 1 < layout.partitions.size()) ? fe32(room[i + 2]) : 0xFFFFFFFF;
+			part.summedLongs = fe32(sizeof(struct partitionBlock) / 4);
+			setChecksum((struct blockHeader *)&part);
+			memset(buffer, 0, bytes);
+			memcpy(buffer, &part, sizeof(part));
+			ok = m_device->writeBlocks(buffer, room[i + 1] * per, per);
+		}
+		if (ok)
+		{
+			setChecksum((struct blockHeader *)&rdb);
+			memset(buffer, 0, bytes);
+			memcpy(buffer, &rdb, sizeof(rdb));
+			ok = m_device->writeBlocks(buffer, room[0] * per, per);
+		}
+		delete [] buffer;
+
+		if (!ok)
+		{
+			m_messenger->textError("Writing the RDB failed\n");
+			return false;
+		}
+		m_messenger->textInfo("Wrote an RDSK block at block %lu and %lu PART blocks after it\n", room[0], layout.partitions.size());
+		return true;
+	}
+}
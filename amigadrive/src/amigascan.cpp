@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include "amigadrive.h"
+#include "amigadumpfile.h"
+#include "amigafloppy.h"
+#include "amigahash.h"
+#include "amigaparallel.h"
+#include "amigascan.h"
+#include "endianness.h"
+
+namespace amigadrive
+{
+	/*
+	 * Append a C string to a record as a quoted JSON string
+	 */
+	static void jsonString(std::string &out, const char *s)
+	{
+		char esc[8];
+
+		out += '"';
+		for (; *s; s++)
+		{
+			u8 c = *s;
+
+			if (c == '"' || c == '\\')
+			{
+				out += '\\';
+				out += c;
+			}
+			else if (c < 0x20 || c > 0x7e)
+			{
+				snprintf(esc, sizeof(esc), "\\u%04x", c);
+				out += esc;
+			}
+			else
+				out += c;
+		}
+		out += '"';
+	}
+
+	static void jsonNumber(std::string &out, const char *key, s64 value)
+	{
+		char buffer[64];
+
+		snprintf(buffer, sizeof(buffer), ",\"%s\":%lld", key, (long long)value);
+		out += buffer;
+	}
+
+	/*
+	 * Append the CRC-32 and SHA-1 of an image held in memory, as hex strings
+	 */
+	static void jsonHashes(std::string &out, const u8 *image, u64 bytes)
+	{
+		char hex[41];
+		u8 digest[20];
+		u8 crc[4];
+		u32 c = crc32Update(0, image, bytes);
+		SHA1 sha;
+
+		crc[0] = c >> 24;
+		crc[1] = c >> 16;
+		crc[2] = c >> 8;
+		crc[3] = c;
+		hexString(hex, crc, 4);
+		out += ",\"crc32\":";
+		jsonString(out, hex);
+
+		sha.update(image, bytes);
+		sha.final(digest);
+		hexString(hex, digest, 20);
+		out += ",\"sha1\":";
+		jsonString(out, hex);
+	}
+
+	Scanner::Scanner(UI *messenger, unsigned workers)
+	{
+		m_messenger = messenger;
+		m_workers = workers ? workers : defaultWorkerCount();
+	}
+
+	Scanner::~Scanner()
+	{
+		m_messenger = nullptr;
+	}
+
+	void Scanner::addImage(const char *fileName)
+	{
+		m_images.push_back(fileName);
+	}
+
+	bool Scanner::addDirectory(const char *dirName)
+	{
+		DIR *dir = opendir(dirName);
+		struct dirent *entry;
+
+		if (!dir)
+		{
+			m_messenger->textError("Couldn't read directory [%s] - %s\n", dirName, strerror(errno));
+			return false;
+		}
+
+		while ((entry = readdir(dir)) != nullptr)
+		{
+			std::string path;
+			struct stat s;
+
+			if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+				continue;
+
+			path = dirName;
+			path += '/';
+			path += entry->d_name;
+
+			// lstat, so a symlinked directory can't send us round in circles
+			if (lstat(path.c_str(), &s) != 0)
+				continue;
+
+			if (S_ISDIR(s.st_mode))
+				addDirectory(path.c_str());
+			else if (S_ISREG(s.st_mode) || (S_ISLNK(s.st_mode) && stat(path.c_str(), &s) == 0 && S_ISREG(s.st_mode)))
+				m_images.push_back(path);
+		}
+
+		closedir(dir);
+		return true;
+	}
+
+	bool Scanner::addList(const char *listName)
+	{
+		FILE *list = strcmp(listName, "-") ? fopen(listName, "r") : stdin;
+		char line[4096];
+
+		if (!list)
+		{
+			m_messenger->textError("Couldn't open list [%s] - %s\n", listName, strerror(errno));
+			return false;
+		}
+
+		while (fgets(line, sizeof(line), list))
+		{
+			size_t len = strlen(line);
+
+			while (len && (line[len-1] == '\n' || line[len-1] == '\r'))
+				line[--len] = 0;
+			if (len)
+				m_images.push_back(line);
+		}
+
+		if (list != stdin)
+			fclose(list);
+		return true;
+	}
+
+	u64 Scanner::imageCount(void)
+	{
+		return m_images.size();
+	}
+
+	bool Scanner::probe(const char *fileName, std::string &record)
+	{
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		SilentUI ui;
+		ADFIO io;
+		Device *D = nullptr;
+		bool opened;
+
+		record = "{\"image\":";
+		jsonString(record, fileName);
+
+		try
+		{
+			D = new Device(&io, &ui, fileName, true);
+		}
+		catch (Exception E)
+		{
+			E.textMsg();
+		}
+		catch (u32 E)
+		{
+			;
+		}
+
+		opened = (D != nullptr);
+		if (!opened)
+		{
+			record += ",\"ok\":false,\"error\":";
+			jsonString(record, *ui.lastError() ? ui.lastError() : "unable to open device");
+		}
+		else
+		{
+			record += ",\"ok\":true";
+			jsonNumber(record, "bytes", D->blockCount() * BLOCKSIZE);
+			if (D->physicalSectorBytes() != BLOCKSIZE)
+				jsonNumber(record, "physicalSectorBytes", D->physicalSectorBytes());
+
+			record += ",\"type\":";
+			jsonString(record, D->m_drvType == DD_DISKETTE ? "dd_diskette" :
+				(D->m_drvType == HD_DISKETTE ? "hd_diskette" : "hard_drive"));
+			record += D->m_rdb ? ",\"rdb\":true" : ",\"rdb\":false";
+			if (D->isBareVolume())
+				record += ",\"bare\":true";
+
+			if (D->m_rdb)
+			{
+				jsonNumber(record, "blockBytes", fe32(D->m_rdb->blockBytes));
+				jsonNumber(record, "cylinders", fe32(D->m_rdb->cylinders));
+				jsonNumber(record, "heads", fe32(D->m_rdb->heads));
+				jsonNumber(record, "sectors", fe32(D->m_rdb->sectors));
+			}
+			record += D->m_bootcode ? ",\"bootable\":true" : ",\"bootable\":false";
+
+			// stored file system drivers, hashed so their versions can be audited
+			if (D->fileSystemCount())
+			{
+				record += ",\"fileSystems\":[";
+				for (int I = 1; I <= D->fileSystemCount(); I++)
+				{
+					const struct fileSysHeaderBlock *fs = D->fileSystemHeader(I);
+					std::vector<u8> code;
+					char text[32];
+
+					if (I > 1)
+						record += ',';
+					dosTypeString(text, fe32(fs->dosType));
+					record += "{\"dosType\":";
+					jsonString(record, text);
+					snprintf(text, sizeof(text), "%u.%u", fe32(fs->version) >> 16, fe32(fs->version) & 0xFFFF);
+					record += ",\"version\":";
+					jsonString(record, text);
+					if (D->fileSystemCode(I, code))
+					{
+						jsonNumber(record, "bytes", code.size());
+						jsonHashes(record, code.data(), code.size());
+					}
+					else
+						record += ",\"broken\":true";
+					record += '}';
+				}
+				record += ']';
+			}
+
+			// diskettes are already in memory, so hashing them costs no I/O
+			if (D->m_drvType != HARD_DRIVE)
+			{
+				record += ",\"bootblock\":";
+				jsonString(record, bootClassName(D->bootBlockClass()));
+				if (D->m_floppy)
+					jsonHashes(record, D->m_floppy->image(), D->m_floppy->imageBytes());
+			}
+
+			record += ",\"partitions\":[";
+			for (int I = 1; I <= D->volumeCount(); I++)
+			{
+				Volume *V = D->volumeNumber(I);
+
+				if (I > 1)
+					record += ',';
+				record += "{\"name\":";
+				jsonString(record, V->volName());
+				jsonNumber(record, "start", V->volStartBlock());
+				jsonNumber(record, "count", V->volBlockCount());
+				if (V->volBytesPerBlock() != BLOCKSIZE)
+					jsonNumber(record, "blockBytes", V->volBytesPerBlock());
+				record += ",\"dosType\":";
+				jsonString(record, V->volType());
+				jsonNumber(record, "bootPri", V->volBootPriority());
+				record += '}';
+			}
+			record += ']';
+
+			delete D;
+		}
+
+		jsonNumber(record, "probeUsec", std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count());
+		record += "}\n";
+		return opened;
+	}
+
+	u64 Scanner::run(FILE *out)
+	{
+		std::vector<std::string> records(m_workers);
+		std::atomic<u64> failed(0);
+		std::mutex outLock;
+
+		parallelFor(m_images.size(), m_workers, [&](u64 i, unsigned w)
+		{
+			std::string &record = records[w];
+
+			if (!probe(m_images[i].c_str(), record))
+				failed++;
+
+			std::lock_guard<std::mutex> lock(outLock);
+			fputs(record.c_str(), out);
+		});
+
+		fflush(out);
+		return failed;
+	}
+}
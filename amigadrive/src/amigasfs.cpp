@@ -0,0 +1,322 @@
+#include <string.h>
+#include "amigasfs.h"
+#include "amigablock.h"
+#include "amigatrace.h"
+
+namespace amigadrive
+{
+	// an object container: parent node, next and previous containers, then the objects
+	#define SFS_OBJC_NEXT 16
+	#define SFS_OBJC_OBJECTS 24
+
+	// an object: owner, node, protection, data and size or hash table and first container, date, bits, name
+	#define SFS_OBJ_NODE 4
+	#define SFS_OBJ_PROTECT 8
+	#define SFS_OBJ_DATA 12
+	#define SFS_OBJ_SIZE 16
+	#define SFS_OBJ_DATE 20
+	#define SFS_OBJ_BITS 24
+	#define SFS_OBJ_NAME 25
+
+	// a B-tree node container: node count, leaf flag, node size, then the nodes
+	#define SFS_BNDC_COUNT 12
+	#define SFS_BNDC_LEAF 14
+	#define SFS_BNDC_NODESIZE 15
+	#define SFS_BNDC_NODES 16
+
+	// an object node container: first node number, nodes per entry, then the entries
+	#define SFS_NDC_FIRST 12
+	#define SFS_NDC_NODES 16
+	#define SFS_NDC_ENTRIES 20
+	// a leaf's entries are packed object nodes: the object's container, the next node of its hash chain, a hash
+	#define SFS_NDC_OBJECTNODE 10
+
+	SFSFileSystem::SFSFileSystem(Volume *volume, UI *messenger, u32 blockBytes) : FileSystem(volume, messenger, blockBytes)
+	{
+		m_blocks = (u64)volume->volBlockCount() * BLOCKSIZE / blockBytes;
+		m_rootContainer = 0;
+		m_extentRoot = 0;
+		m_nodeRoot = 0;
+
+		// inner node entries count 32 byte units, which leaves their low bits for flags
+		for (m_nodeShift = 0; (32u << m_nodeShift) < blockBytes; m_nodeShift++)
+			;
+	}
+
+	bool SFSFileSystem::isSFS(u32 dosType)
+	{
+		return dosType == 0x53465300 || dosType == 0x53465302;
+	}
+
+	bool SFSFileSystem::init(void)
+	{
+		u8 *root = new u8[m_blockBytes];
+		bool ok = readChecked(0, root, SFS_ID_ROOT) && be32(root + SFS_ROOT_BLOCKSIZE) == m_blockBytes &&
+			be32(root + SFS_ROOT_TOTALBLOCKS) <= m_blocks;
+
+		if (ok)
+		{
+			m_blocks = be32(root + SFS_ROOT_TOTALBLOCKS);
+			m_rootContainer = be32(root + SFS_ROOT_OBJECTCONTAINER);
+			m_extentRoot = be32(root + SFS_ROOT_EXTENTROOT);
+			m_nodeRoot = be32(root + SFS_ROOT_NODEROOT);
+		}
+		delete [] root;
+		return ok;
+	}
+
+	const char *SFSFileSystem::fsName(void)
+	{
+		return "SFS";
+	}
+
+	/*
+	 * SFS checksums start from 1, so a sound block sums to -1.
+	 */
+	bool SFSFileSystem::readChecked(u64 block, u8 *buffer, u32 id)
+	{
+		if (block >= m_blocks || !readMeta(block, buffer))
+			return false;
+
+		if (be32(buffer) != id || blockKernels(m_blockBytes)->sum(buffer, m_blockBytes) != 0xFFFFFFFF ||
+			be32(buffer + SFS_OWNBLOCK) != block)
+		{
+			m_messenger->textWarning("Block %lu of volume %s is damaged\n", block, m_volume->volName());
+			return false;
+		}
+		return true;
+	}
+
+	/*
+	 * An object is followed by its name and its comment, each ending in a zero, and
+	 * padded to an even length. A zero node number marks the end of the container.
+	 */
+	u32 SFSFileSystem::objectSize(const u8 *container, u32 at)
+	{
+		const u8 *name, *comment, *end = container + m_blockBytes;
+
+		if (at + SFS_OBJ_NAME + 2 > m_blockBytes || be32(container + at + SFS_OBJ_NODE) == 0)
+			return 0;
+
+		name = container + at + SFS_OBJ_NAME;
+		comment = (const u8 *)memchr(name, 0, end - name);
+		if (!comment || ++comment >= end || !memchr(comment, 0, end - comment))
+			return 0;
+		return (SFS_OBJ_NAME + strlen((const char *)name) + 1 + strlen((const char *)comment) + 1 + 1) & ~1;
+	}
+
+	bool SFSFileSystem::objectInfo(const u8 *object, FileInfo &info, int depth)
+	{
+		const u8 *name = object + SFS_OBJ_NAME;
+		u8 bits = object[SFS_OBJ_BITS];
+		u32 date = be32(object + SFS_OBJ_DATE);
+
+		info.name = (const char *)name;
+
+		// a hard link's data is the node of what it links to
+		if (bits & SFS_OTYPE_HARDLINK)
+		{
+			u8 *target = new u8[m_blockBytes];
+			std::string name = info.name;
+			bool ok = depth < SFS_MAX_DEPTH && findObject(be32(object + SFS_OBJ_DATA), target) && objectInfo(target, info, depth + 1);
+
+			info.name = name;
+			delete [] target;
+			return ok;
+		}
+
+		info.comment = (const char *)name + info.name.size() + 1;
+		info.protect = be32(object + SFS_OBJ_PROTECT);
+
+		// SFS dates are seconds since 1978, like AmigaDOS ones
+		info.days = date / 86400;
+		info.mins = (date % 86400) / 60;
+		info.ticks = (date % 60) * 50;
+
+		if (bits & SFS_OTYPE_DIR)
+		{
+			info.type = FT_DIR;
+			info.key = be32(object + SFS_OBJ_SIZE);
+			info.size = 0;
+		}
+		else
+		{
+			info.type = (bits & SFS_OTYPE_LINK) ? FT_SOFTLINK : FT_FILE;
+			info.key = be32(object + SFS_OBJ_DATA);
+			info.size = be32(object + SFS_OBJ_SIZE);
+		}
+		return true;
+	}
+
+	/*
+	 * The first object of the root container is the root directory.
+	 */
+	bool SFSFileSystem::rootInfo(FileInfo &info)
+	{
+		u8 *buffer = new u8[m_blockBytes];
+		bool ok = readChecked(m_rootContainer, buffer, SFS_ID_OBJC) && objectSize(buffer, SFS_OBJC_OBJECTS) &&
+			objectInfo(buffer + SFS_OBJC_OBJECTS, info) && info.type == FT_DIR;
+
+		delete [] buffer;
+		return ok;
+	}
+
+	bool SFSFileSystem::list(const FileInfo &dir, std::vector<FileInfo> &entries)
+	{
+		u8 *buffer = new u8[m_blockBytes];
+		u64 block = dir.key;
+		u64 steps = 0;
+		bool ok = true;
+
+		while (block)
+		{
+			u32 at = SFS_OBJC_OBJECTS, size;
+
+			if (++steps > m_blocks || !readChecked(block, buffer, SFS_ID_OBJC))
+			{
+				ok = false;
+				break;
+			}
+
+			while ((size = objectSize(buffer, at)) != 0)
+			{
+				FileInfo info;
+
+				if (objectInfo(buffer + at, info))
+					entries.push_back(info);
+				at += size;
+			}
+			block = be32(buffer + SFS_OBJC_NEXT);
+		}
+
+		delete [] buffer;
+		return ok;
+	}
+
+	/*
+	 * Each level of the node tree splits the node numbers it covers evenly between
+	 * its entries, which give the child container's block shifted up by m_nodeShift.
+	 * A leaf's entries give the object container holding each node.
+	 */
+	bool SFSFileSystem::findObject(u32 node, u8 *object)
+	{
+		u8 *buffer = new u8[m_blockBytes];
+		u64 block = m_nodeRoot;
+		bool found = false;
+		int depth;
+
+		for (depth = 0; depth < SFS_MAX_DEPTH; depth++)
+		{
+			u32 first, nodes, entry;
+
+			if (!readChecked(block, buffer, SFS_ID_NDC))
+				break;
+
+			first = be32(buffer + SFS_NDC_FIRST);
+			nodes = be32(buffer + SFS_NDC_NODES);
+			if (node < first || nodes == 0)
+				break;
+
+			if (nodes > 1)
+			{
+				entry = SFS_NDC_ENTRIES + (node - first) / nodes * 4;
+				if (entry + 4 > m_blockBytes)
+					break;
+				block = be32(buffer + entry) >> m_nodeShift;
+				continue;
+			}
+
+			entry = SFS_NDC_ENTRIES + (node - first) * SFS_NDC_OBJECTNODE;
+			if (entry + SFS_NDC_OBJECTNODE > m_blockBytes || !readChecked(be32(buffer + entry), buffer, SFS_ID_OBJC))
+				break;
+
+			for (u32 at = SFS_OBJC_OBJECTS, size; (size = objectSize(buffer, at)) != 0; at += size)
+				if (be32(buffer + at + SFS_OBJ_NODE) == node)
+				{
+					memcpy(object, buffer + at, m_blockBytes - at);
+					found = true;
+					break;
+				}
+			break;
+		}
+
+		delete [] buffer;
+		return found;
+	}
+
+	/*
+	 * Inner nodes hold the lowest key under each child, so the child to follow is
+	 * the last whose key isn't above the one sought. Leaves have to match exactly.
+	 */
+	bool SFSFileSystem::findExtent(u32 key, u32 &next, u32 &blocks)
+	{
+		u8 *buffer = new u8[m_blockBytes];
+		u64 block = m_extentRoot;
+		bool found = false;
+		int depth;
+
+		for (depth = 0; depth < SFS_MAX_DEPTH; depth++)
+		{
+			u32 count, size, i;
+			const u8 *n = nullptr;
+
+			if (!readChecked(block, buffer, SFS_ID_BNDC))
+				break;
+
+			count = be16(buffer + SFS_BNDC_COUNT);
+			size = buffer[SFS_BNDC_NODESIZE];
+			if (size < 8 || SFS_BNDC_NODES + count * size > m_blockBytes)
+				break;
+
+			for (i = 0; i < count && be32(buffer + SFS_BNDC_NODES + i * size) <= key; i++)
+				n = buffer + SFS_BNDC_NODES + i * size;
+			if (!n)
+				break;
+
+			if (!buffer[SFS_BNDC_LEAF])
+			{
+				block = be32(n + 4);
+				continue;
+			}
+
+			// key, next, previous, block count
+			if (be32(n) == key && size >= 14)
+			{
+				next = be32(n + 4);
+				blocks = be16(n + 12);
+				found = true;
+			}
+			break;
+		}
+
+		delete [] buffer;
+		return found;
+	}
+
+	std::shared_ptr<const ExtentMap> SFSFileSystem::mapFile(const FileInfo &info)
+	{
+		TraceSpan span("map file", "fs");
+		u64 needed = (info.size + m_blockBytes - 1) / m_blockBytes;
+		ExtentMap *map = new ExtentMap;
+		u32 key = info.key;
+		u64 steps = 0;
+
+		while (map->blockCount() < needed && key && ++steps <= m_blocks)
+		{
+			u32 next, blocks, i;
+
+			if (!findExtent(key, next, blocks) || blocks == 0)
+				break;
+			for (i = 0; i < blocks && map->blockCount() < needed; i++)
+				map->add((u64)key + i);
+			key = next;
+		}
+
+		return std::shared_ptr<const ExtentMap>(map);
+	}
+
+	File *SFSFileSystem::openFile(const FileInfo &info)
+	{
+		return new MappedFile(this, info, fileMap(info));
+	}
+}
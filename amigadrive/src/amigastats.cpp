@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "amigastats.h"
+
+namespace amigadrive
+{
+	IOStats::IOStats()
+	{
+		reset();
+	}
+
+	IOStats::~IOStats()
+	{
+		;
+	}
+
+	void IOStats::reset(void)
+	{
+		int d, b;
+
+		for (d = 0; d < 2; d++)
+		{
+			Counters &c = m_counters[d];
+
+			c.ops = 0;
+			c.bytes = 0;
+			c.sequential = 0;
+			c.failed = 0;
+			c.nanos = 0;
+			c.nextBlock = 0;
+			for (b = 0; b < BUCKETS; b++)
+				c.histogram[b] = 0;
+		}
+	}
+
+	void IOStats::addChild(u64 start, u64 count, IOStats *child)
+	{
+		Child C;
+
+		C.start = start;
+		C.end = start + count;
+		C.stats = child;
+
+		m_children.insert(std::upper_bound(m_children.begin(), m_children.end(), C,
+			[](const Child &a, const Child &b) { return a.start < b.start; }), C);
+	}
+
+	IOStats *IOStats::childFor(u64 block)
+	{
+		size_t lo = 0, hi = m_children.size();
+
+		// find the last child starting at or before the block
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+
+			if (m_children[mid].start <= block)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo && block < m_children[lo-1].end)
+			return m_children[lo-1].stats;
+		return nullptr;
+	}
+
+	void IOStats::record(Direction dir, u64 block, u64 count, u64 nanos, bool ok)
+	{
+		Counters &c = m_counters[dir];
+		int bucket = 0;
+		IOStats *child;
+
+		while (bucket < BUCKETS - 1 && (nanos >> (bucket + 1)))
+			bucket++;
+
+		c.ops.fetch_add(1, std::memory_order_relaxed);
+		c.bytes.fetch_add(count * 512, std::memory_order_relaxed);
+		c.nanos.fetch_add(nanos, std::memory_order_relaxed);
+		c.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+		if (!ok)
+			c.failed.fetch_add(1, std::memory_order_relaxed);
+
+		// sequential if it picks up where the previous operation left off
+		if (c.nextBlock.exchange(block + count, std::memory_order_relaxed) == block)
+			c.sequential.fetch_add(1, std::memory_order_relaxed);
+
+		if (!m_children.empty() && (child = childFor(block)) != nullptr)
+			child->record(dir, block, count, nanos, ok);
+	}
+
+	const IOStats::Counters &IOStats::counters(Direction dir)
+	{
+		return m_counters[dir];
+	}
+
+	u64 IOStats::percentile(Direction dir, double pct)
+	{
+		Counters &c = m_counters[dir];
+		u64 ops = c.ops, want, seen = 0;
+		int b;
+
+		if (!ops)
+			return 0;
+
+		want = (u64)(ops * pct / 100.0);
+		if (want >= ops)
+			want = ops - 1;
+
+		for (b = 0; b < BUCKETS; b++)
+		{
+			seen += c.histogram[b];
+			if (seen > want)
+				break;
+		}
+		return (u64)2 << (b < BUCKETS ? b : BUCKETS - 1);
+	}
+
+	/*
+	 * Print a duration in nanoseconds with a sensible unit
+	 */
+	static const char *fmtNanos(char *buffer, size_t len, double ns)
+	{
+		if (ns < 1e3)
+			snprintf(buffer, len, "%.0fns", ns);
+		else if (ns < 1e6)
+			snprintf(buffer, len, "%.1fus", ns / 1e3);
+		else if (ns < 1e9)
+			snprintf(buffer, len, "%.1fms", ns / 1e6);
+		else
+			snprintf(buffer, len, "%.2fs", ns / 1e9);
+		return buffer;
+	}
+
+	void IOStats::dump(UI *msgr, const char *title)
+	{
+		static const char *names[2] = {"read", "write"};
+		char a[32], b[32], c50[32], c99[32];
+		int d, k;
+
+		msgr->textInfo("I/O statistics: %s\n", title);
+
+		for (d = 0; d < 2; d++)
+		{
+			Counters &c = m_counters[d];
+			u64 ops = c.ops, max = 0;
+
+			if (!ops)
+			{
+				msgr->textInfo("  %-5s: no operations\n", names[d]);
+				continue;
+			}
+
+			msgr->textInfo("  %-5s: %lu ops, %.1f MB, %.1f%% sequential, %lu failed, total %s, mean %s, p50 <%s, p99 <%s\n",
+				names[d], ops, c.bytes / 1048576.0, 100.0 * c.sequential / ops, (u64)c.failed,
+				fmtNanos(a, sizeof(a), c.nanos), fmtNanos(b, sizeof(b), (double)c.nanos / ops),
+				fmtNanos(c50, sizeof(c50), percentile((Direction)d, 50)),
+				fmtNanos(c99, sizeof(c99), percentile((Direction)d, 99)));
+
+			for (k = 0; k < BUCKETS; k++)
+				max = std::max(max, (u64)c.histogram[k]);
+
+			for (k = 0; k < BUCKETS; k++)
+			{
+				u64 n = c.histogram[k];
+				char bar[41];
+				int w;
+
+				if (!n)
+					continue;
+
+				w = (int)((n * 40 + max - 1) / max);
+				memset(bar, '#', w);
+				bar[w] = 0;
+				msgr->textInfo("         %8s - %-8s %10lu %s\n", fmtNanos(a, sizeof(a), (double)((u64)1 << k)),
+					fmtNanos(b, sizeof(b), (double)((u64)2 << k)), n, bar);
+			}
+		}
+	}
+}
@@ -0,0 +1,139 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "amigastream.h"
+
+namespace amigadrive
+{
+	StreamIO::StreamIO(int fd)
+	{
+		m_fd = fd;
+		m_head = nullptr;
+		m_headBytes = 0;
+		m_pos = 0;
+	}
+
+	StreamIO::~StreamIO()
+	{
+		if (m_head)
+		{
+			delete [] m_head;
+			m_head = nullptr;
+		}
+	}
+
+	/*
+	 * Read until the buffer is full or the stream ends. Pipes hand data over in
+	 * pieces, so a short read means nothing until read() returns 0.
+	 */
+	u64 StreamIO::fill(u8 *buffer, u64 bytes)
+	{
+		u64 got = 0;
+
+		while (got < bytes)
+		{
+			ssize_t n = read(m_fd, buffer + got, bytes - got);
+
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				break;
+			got += n;
+		}
+		return got;
+	}
+
+	void StreamIO::initDriver(UI *messenger, const char *devName, bool readOnly)
+	{
+		m_messenger = messenger;
+
+		if (!readOnly)
+			throw Exception(m_messenger, "StreamIO: a stream can only be read");
+
+		m_head = new u8[STREAM_HEAD_BYTES];
+		m_headBytes = fill(m_head, STREAM_HEAD_BYTES);
+		m_pos = m_headBytes;
+
+		if (m_headBytes < BLOCKSIZE)
+			throw Exception(m_messenger, "StreamIO: the stream is empty");
+
+		if (m_headBytes < STREAM_HEAD_BYTES)
+		{
+			// it all fitted, so this is the whole image
+			m_sectorCount = m_headBytes / BLOCKSIZE;
+			m_sequential = false;
+		}
+		else
+		{
+			m_sectorCount = STREAM_UNBOUNDED;
+			m_sequential = true;
+		}
+		m_drvArch = (m_sectorCount >> 32) ? DRV_64 : DRV_32;
+	}
+
+	bool StreamIO::readBlock(Block *readBuffer, u64 blockNumber)
+	{
+		return readBlocks(readBuffer, blockNumber, 1);
+	}
+
+	/*
+	 * The part of a request inside the head comes from memory. The rest has to be
+	 * at or after the stream's position; anything before that has already gone.
+	 */
+	bool StreamIO::readBlocks(Block *readBuffer, u64 blockNumber, u64 count)
+	{
+		u8 *out = (u8 *)readBuffer;
+		u64 offset = blockNumber * BLOCKSIZE;
+		u64 bytes = count * BLOCKSIZE;
+		u64 got;
+
+		if (blockNumber >= m_sectorCount || count > m_sectorCount - blockNumber)
+			return false;
+
+		if (offset < m_headBytes)
+		{
+			u64 n = (bytes < m_headBytes - offset) ? bytes : m_headBytes - offset;
+
+			memcpy(out, m_head + offset, n);
+			out += n;
+			offset += n;
+			bytes -= n;
+		}
+
+		if (!bytes)
+			return true;
+
+		if (offset < m_pos)
+		{
+			m_messenger->textError("StreamIO: block %lu has already been passed - a stream can only be read forwards\n", offset / BLOCKSIZE);
+			return false;
+		}
+
+		// skip forwards, using the caller's buffer to hold what's thrown away
+		while (m_pos < offset)
+		{
+			u64 n = (offset - m_pos < bytes) ? offset - m_pos : bytes;
+
+			got = fill(out, n);
+			m_pos += got;
+			if (got < n)
+				break;
+		}
+
+		got = (m_pos == offset) ? fill(out, bytes) : 0;
+		m_pos += got;
+
+		// now the end has been seen, the stream's size is known
+		if (got < bytes)
+		{
+			m_sectorCount = m_pos / BLOCKSIZE;
+			return false;
+		}
+		return true;
+	}
+
+	bool StreamIO::writeBlock(Block *writeBuffer, u64 blockNumber)
+	{
+		return false;
+	}
+}
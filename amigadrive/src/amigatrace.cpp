@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "amigatrace.h"
+
+namespace amigadrive
+{
+	std::atomic<bool> Tracer::s_enabled(false);
+
+	struct traceEvent
+	{
+		const char *name;
+		const char *category;
+		u64 start;
+		u64 duration;
+		s64 arg;
+	};
+
+	/*
+	 * Events are kept in fixed size chunks which are never moved once written,
+	 * so the owning thread can append without coordinating with anyone.
+	 */
+	#define TRACE_CHUNK 4096
+
+	struct traceChunk
+	{
+		traceEvent events[TRACE_CHUNK];
+		u32 used;
+		traceChunk *next;
+	};
+
+	struct traceBuffer
+	{
+		int tid;
+		traceChunk *first;
+		traceChunk *last;
+	};
+
+	static std::mutex s_registryLock;
+	static std::vector<traceBuffer *> s_buffers;
+	static std::string s_fileName;
+	static std::chrono::steady_clock::time_point s_epoch;
+	static std::atomic<u32> s_generation(0);
+
+	static thread_local traceBuffer *t_buffer = nullptr;
+	static thread_local u32 t_generation = 0;
+
+	bool Tracer::start(const char *fileName)
+	{
+		FILE *f = fopen(fileName, "w");
+
+		if (!f)
+			return false;
+		fclose(f);
+
+		std::lock_guard<std::mutex> lock(s_registryLock);
+		s_fileName = fileName;
+		s_epoch = std::chrono::steady_clock::now();
+		s_generation++;
+		s_enabled = true;
+		return true;
+	}
+
+	u64 Tracer::now(void)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_epoch).count();
+	}
+
+	void Tracer::record(const char *name, const char *category, u64 start, s64 arg)
+	{
+		u64 end = now();
+		traceBuffer *b = t_buffer;
+		traceEvent *e;
+
+		// first span on this thread, or first since the last trace was written
+		if (!b || t_generation != s_generation)
+		{
+			std::lock_guard<std::mutex> lock(s_registryLock);
+
+			if (!s_enabled)
+				return;
+			b = new traceBuffer;
+			b->tid = s_buffers.size() + 1;
+			b->first = b->last = new traceChunk;
+			b->first->used = 0;
+			b->first->next = nullptr;
+			s_buffers.push_back(b);
+			t_buffer = b;
+			t_generation = s_generation;
+		}
+
+		if (b->last->used == TRACE_CHUNK)
+		{
+			traceChunk *c = new traceChunk;
+
+			c->used = 0;
+			c->next = nullptr;
+			b->last->next = c;
+			b->last = c;
+		}
+
+		e = &b->last->events[b->last->used++];
+		e->name = name;
+		e->category = category;
+		e->start = start;
+		e->duration = end - start;
+		e->arg = arg;
+	}
+
+	void Tracer::finish(void)
+	{
+		std::lock_guard<std::mutex> lock(s_registryLock);
+		bool first = true;
+		int pid = getpid();
+		FILE *f;
+
+		if (!s_enabled)
+			return;
+		s_enabled = false;
+		s_generation++;
+
+		f = fopen(s_fileName.c_str(), "w");
+
+		if (f)
+			fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", f);
+
+		for (traceBuffer *b : s_buffers)
+		{
+			traceChunk *c, *n;
+
+			if (f)
+			{
+				fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+					first ? "" : ",\n", pid, b->tid, b->tid);
+				first = false;
+			}
+
+			for (c = b->first; c; c = n)
+			{
+				u32 i;
+
+				for (i = 0; f && i < c->used; i++)
+				{
+					traceEvent *e = &c->events[i];
+
+					fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+						e->name, e->category, e->start / 1e3, e->duration / 1e3, pid, b->tid);
+					if (e->arg >= 0)
+						fprintf(f, ",\"args\":{\"arg\":%lld}", (long long)e->arg);
+					fputc('}', f);
+				}
+
+				n = c->next;
+				delete c;
+			}
+			delete b;
+		}
+		s_buffers.clear();
+
+		if (f)
+		{
+			fputs("\n]}\n", f);
+			fclose(f);
+		}
+	}
+}
@@ -11,6 +11,7 @@ namespace amigadrive
 	ConsoleUI::ConsoleUI()
 	{
 		m_listOfStrings = new stringStore();
+		m_infoStream = stdout;
 	}
 
 	ConsoleUI::~ConsoleUI()
@@ -22,6 +23,11 @@ namespace amigadrive
 		}
 	}
 
+	void ConsoleUI::setInfoStream(FILE *stream)
+	{
+		m_infoStream = stream;
+	}
+
 	void ConsoleUI::progressBar(int percent)
 	{
 		static int lastcount=0;
@@ -30,7 +36,7 @@ namespace amigadrive
 
 		if (percent > lastcount)
 		{
-			fputc('.', stdout);
+			fputc('.', m_infoStream);
 			lastcount = percent;
 		}
 	}
@@ -42,7 +48,7 @@ namespace amigadrive
 
 		va_start(ap, format);
 		vsnprintf(txtBuffer, 1024, format, ap);
-		fputs(txtBuffer, stdout);
+		fputs(txtBuffer, m_infoStream);
 		va_end(ap);
 	}
 
@@ -67,4 +73,43 @@ namespace amigadrive
 		fputs(txtBuffer, stderr);
 		va_end(ap);
 	}
+
+	SilentUI::SilentUI()
+	{
+		m_lastError[0] = 0;
+	}
+
+	SilentUI::~SilentUI()
+	{
+		;
+	}
+
+	void SilentUI::progressBar(int percent)
+	{
+		;
+	}
+
+	void SilentUI::textInfo(const char *format, ...)
+	{
+		;
+	}
+
+	void SilentUI::textWarning(const char *format, ...)
+	{
+		;
+	}
+
+	void SilentUI::textError(const char *format, ...)
+	{
+		va_list ap;
+
+		va_start(ap, format);
+		vsnprintf(m_lastError, sizeof(m_lastError), format, ap);
+		va_end(ap);
+	}
+
+	const char *SilentUI::lastError(void)
+	{
+		return m_lastError;
+	}
 }
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <unordered_set>
+#include "amigaundelete.h"
+#include "amigablock.h"
+#include "amigaparallel.h"
+#include "amigatrace.h"
+
+namespace amigadrive
+{
+	Undelete::Undelete(Volume *volume, UI *messenger, unsigned workers)
+	{
+		m_volume = volume;
+		m_messenger = messenger;
+		m_workers = workers ? workers : defaultWorkerCount();
+		m_fs = nullptr;
+	}
+
+	Undelete::~Undelete()
+	{
+		m_files.clear();
+		if (m_fs)
+		{
+			delete m_fs;
+			m_fs = nullptr;
+		}
+	}
+
+	const std::vector<LostFile> &Undelete::files(void)
+	{
+		return m_files;
+	}
+
+	/*
+	 * Most blocks are data, and the type and secondary type longwords rule them out
+	 * without a checksum being worked out. Headers name themselves, bar the root,
+	 * which is told by its hash table size instead.
+	 */
+	void Undelete::sweepBlock(u64 block, u8 *buffer, std::vector<std::pair<u64, Header>> &headers,
+		std::vector<std::pair<u64, Extension>> &lists)
+	{
+		u32 blockBytes = m_fs->m_blockBytes;
+		u32 type = be32(buffer);
+		s32 secType;
+
+		if (type != FFS_T_HEADER && type != FFS_T_LIST)
+			return;
+
+		secType = be32(buffer + blockBytes - FFS_SECTYPE);
+		if (type == FFS_T_LIST)
+		{
+			if (secType != FFS_ST_FILE || be32(buffer + 4) != block || be32(buffer + 8) > m_fs->m_hashSize ||
+				m_volume->volKernels()->sum(buffer, blockBytes) != 0)
+				return;
+			lists.push_back({block, {be32(buffer + blockBytes - FFS_PARENT)}});
+			return;
+		}
+
+		if (secType == FFS_ST_ROOT)
+		{
+			if (be32(buffer + 4) != 0 || be32(buffer + 12) != m_fs->m_hashSize)
+				return;
+		}
+		else if (secType == FFS_ST_FILE || secType == FFS_ST_USERDIR)
+		{
+			if (be32(buffer + 4) != block || (secType == FFS_ST_FILE && be32(buffer + 8) > m_fs->m_hashSize))
+				return;
+		}
+		else
+			return;
+
+		if (m_volume->volKernels()->sum(buffer, blockBytes) == 0)
+		{
+			Header h;
+
+			h.secType = secType;
+			h.parent = be32(buffer + blockBytes - FFS_PARENT);
+			if (m_fs->headerInfo(block, buffer, h.info))
+				headers.push_back({block, h});
+		}
+	}
+
+	/*
+	 * An extension block is only followed if the sweep found it sound and naming
+	 * the file as its parent, so a chain whose blocks went to another file stops
+	 * where it was written over.
+	 */
+	std::shared_ptr<const ExtentMap> Undelete::rebuild(const FileInfo &info, bool &complete)
+	{
+		u32 blockBytes = m_fs->m_blockBytes;
+		u32 payload = blockBytes - m_fs->dataOffset();
+		u64 needed = (info.size + payload - 1) / payload;
+		ExtentMap *map = new ExtentMap;
+		u8 *buffer = new u8[blockBytes];
+		u64 list = info.key;
+		bool broken = false;
+
+		while (!broken && map->blockCount() < needed && list)
+		{
+			u32 count, i;
+
+			if (list != info.key)
+			{
+				auto e = m_lists.find(list);
+
+				if (e == m_lists.end() || e->second.parent != info.key)
+					break;
+			}
+			if (!m_fs->readMeta(list, buffer))
+				break;
+
+			count = be32(buffer + 8);
+			for (i = 0; i < count && map->blockCount() < needed; i++)
+			{
+				u64 block = be32(buffer + FFS_TABLE + (m_fs->m_hashSize - 1 - i) * 4);
+
+				if (block < 2 || block >= m_fs->m_blocks)
+				{
+					broken = true;
+					break;
+				}
+				map->add(block);
+			}
+			list = be32(buffer + blockBytes - FFS_EXTENSION);
+		}
+
+		complete = map->blockCount() >= needed;
+		delete [] buffer;
+		return std::shared_ptr<const ExtentMap>(map);
+	}
+
+	/*
+	 * The path is put together from the headers of the directories above the file.
+	 * Where one of them is gone, the path starts with ?/.
+	 */
+	std::string Undelete::lostPath(const Header &header)
+	{
+		std::string path = header.info.name;
+		u64 parent = header.parent;
+		int depth;
+
+		for (depth = 0; depth < FS_MAX_DEPTH; depth++)
+		{
+			auto p = m_headers.find(parent);
+
+			if (p == m_headers.end())
+				return "?/" + path;
+			if (p->second.secType == FFS_ST_ROOT)
+				return path;
+			path = p->second.info.name + "/" + path;
+			parent = p->second.parent;
+		}
+		return "?/" + path;
+	}
+
+	bool Undelete::scan(void)
+	{
+		TraceSpan span("undelete", "fs");
+		u8 *boot = new u8[m_volume->volBytesPerBlock()];
+		std::vector<std::vector<std::pair<u64, Header>>> headers;
+		std::vector<std::vector<std::pair<u64, Extension>>> lists;
+		std::vector<u8 *> buffers(m_workers, nullptr);
+		std::unordered_set<u64> reachable;
+		std::vector<bool> live;
+		std::atomic<u64> unreadable(0);
+		u32 dosType = 0, blockBytes;
+		u64 blocks, per, chunks, i;
+
+		if (m_volume->volRead(boot, 0))
+			dosType = be32(boot);
+		delete [] boot;
+		if (!FFSFileSystem::isFFS(dosType))
+			dosType = m_volume->volDosType();
+		if (!FFSFileSystem::isFFS(dosType))
+		{
+			m_messenger->textError("Volume %s doesn't hold an OFS or FFS file system\n", m_volume->volName());
+			return false;
+		}
+
+		if (m_fs)
+			delete m_fs;
+		m_fs = new FFSFileSystem(m_volume, m_messenger, dosType);
+		m_headers.clear();
+		m_lists.clear();
+		m_files.clear();
+
+		blockBytes = m_fs->m_blockBytes;
+		blocks = m_fs->m_blocks;
+		per = UNDELETE_CHUNK * BLOCKSIZE / blockBytes;
+		chunks = (blocks + per - 1) / per;
+		headers.resize(chunks);
+		lists.resize(chunks);
+
+		// a chunk which can't be read is gone through a block at a time, so only the bad blocks are missed
+		parallelFor(chunks, m_workers, [&](u64 c, unsigned w)
+		{
+			u64 first = c * per;
+			u64 n = (blocks - first < per) ? blocks - first : per;
+			bool whole;
+			u64 b;
+
+			if (!buffers[w])
+				buffers[w] = new u8[per * blockBytes];
+
+			whole = m_volume->volRead(buffers[w], first, n);
+			for (b = 0; b < n; b++)
+			{
+				u8 *buffer = buffers[w] + b * blockBytes;
+
+				if (first + b < 2)
+					continue;
+				if (!whole && !m_volume->volRead(buffer, first + b))
+				{
+					unreadable++;
+					continue;
+				}
+				sweepBlock(first + b, buffer, headers[c], lists[c]);
+			}
+		});
+
+		for (i = 0; i < m_workers; i++)
+			delete [] buffers[i];
+		for (i = 0; i < chunks; i++)
+		{
+			for (auto &h : headers[i])
+				m_headers.insert(h);
+			for (auto &l : lists[i])
+				m_lists.insert(l);
+		}
+
+		if (unreadable)
+			m_messenger->textWarning("%lu blocks of volume %s couldn't be read, and weren't searched\n", (u64)unreadable, m_volume->volName());
+
+		// what's reachable, and the blocks live files use
+		live.resize(blocks);
+		if (m_fs->init())
+			m_fs->walk([&](const std::string &path, const FileInfo &info, const ExtentMap &map)
+			{
+				reachable.insert(info.key);
+				for (const ExtentMap::Extent &e : map.extents())
+					for (u64 b = e.block; b < e.block + e.count && b < blocks; b++)
+						live[b] = true;
+			});
+		else
+			m_messenger->textWarning("The root block of volume %s is damaged, so every file found counts as lost\n", m_volume->volName());
+
+		for (auto &h : m_headers)
+		{
+			LostFile f;
+
+			if (h.second.secType != FFS_ST_FILE || reachable.count(h.first))
+				continue;
+
+			f.info = h.second.info;
+			f.path = lostPath(h.second);
+			f.map = rebuild(f.info, f.complete);
+			f.reused = 0;
+			for (const ExtentMap::Extent &e : f.map->extents())
+				for (i = e.block; i < e.block + e.count; i++)
+					if (live[i])
+						f.reused++;
+			m_files.push_back(f);
+		}
+
+		std::sort(m_files.begin(), m_files.end(), [](const LostFile &a, const LostFile &b)
+		{
+			return a.info.key < b.info.key;
+		});
+		return true;
+	}
+
+	bool Undelete::recover(const LostFile &file, const char *fileName, u64 &bad)
+	{
+		FileInfo info = file.info;
+		u64 mapped = file.map->blockCount() * (m_fs->m_blockBytes - m_fs->dataOffset());
+		FILE *out;
+		u8 *buffer;
+		u64 offset;
+		bool ok = true;
+
+		if (info.size > mapped)
+			info.size = mapped;
+
+		out = fopen(fileName, "wb");
+		if (!out)
+		{
+			m_messenger->textError("Can't open [%s] for writing - %s\n", fileName, strerror(errno));
+			return false;
+		}
+
+		FFSFile F(m_fs, info, file.map);
+
+		buffer = new u8[UNDELETE_COPY];
+		bad = 0;
+		for (offset = 0; offset < info.size; offset += UNDELETE_COPY)
+		{
+			u64 n = (info.size - offset < UNDELETE_COPY) ? info.size - offset : UNDELETE_COPY;
+
+			if (F.pread(buffer, n, offset) != (s64)n)
+			{
+				memset(buffer, 0, n);
+				bad += n;
+			}
+			if (fwrite(buffer, 1, n, out) != n)
+			{
+				ok = false;
+				break;
+			}
+		}
+		delete [] buffer;
+
+		if (fclose(out) != 0)
+			ok = false;
+		if (!ok)
+			m_messenger->textError("Writing [%s] failed\n", fileName);
+		return ok;
+	}
+
+	bool Undelete::recoverAll(const char *dir)
+	{
+		TraceSpan span("recover", "fs");
+		bool ok = true;
+
+		if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+		{
+			m_messenger->textError("Can't create directory [%s] - %s\n", dir, strerror(errno));
+			return false;
+		}
+
+		for (const LostFile &f : m_files)
+		{
+			std::string name = f.info.name;
+			char fileName[4096];
+			u64 bad;
+
+			// names can't hold these, but a header that's been tampered with may
+			std::replace(name.begin(), name.end(), '/', '_');
+			std::replace(name.begin(), name.end(), ':', '_');
+			snprintf(fileName, sizeof(fileName), "%s/%lu-%s", dir, f.info.key, name.c_str());
+
+			if (!recover(f, fileName, bad))
+			{
+				ok = false;
+				continue;
+			}
+			m_messenger->textInfo("%s -> [%s]\n", f.path.c_str(), fileName);
+			if (bad)
+				m_messenger->textWarning("%lu bytes of [%s] couldn't be read, and are zeroes\n", bad, fileName);
+			if (!f.complete)
+				m_messenger->textWarning("Only the first %lu bytes of [%s] could be found\n", (u64)f.map->blockCount() * (m_fs->m_blockBytes - m_fs->dataOffset()), fileName);
+		}
+		return ok;
+	}
+}
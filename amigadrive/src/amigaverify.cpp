@@ -0,0 +1,116 @@
+#include "amigaverify.h"
+#include "amigahash.h"
+#include "amigatrace.h"
+
+namespace amigadrive
+{
+	CopyVerifier::CopyVerifier(UI *messenger, s64 base, const Reader &reread)
+	{
+		m_messenger = messenger;
+		m_base = base;
+		m_reread = reread;
+		m_done = false;
+		m_finished = false;
+		m_thread = std::thread([this]() { run(); });
+	}
+
+	CopyVerifier::~CopyVerifier()
+	{
+		if (!m_finished)
+			finish();
+		m_messenger = nullptr;
+	}
+
+	void CopyVerifier::submit(const Block *data, s64 block, s64 count)
+	{
+		Pending P;
+		s64 i;
+
+		P.block = block;
+		P.count = count;
+		P.crcs.resize(count);
+		for (i = 0; i < count; i++)
+			P.crcs[i] = crc32Update(0, data[i], BLOCKSIZE);
+
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_taken.wait(lock, [this]() { return m_queue.size() < VERIFY_DEPTH; });
+		m_queue.push_back(std::move(P));
+		m_queued.notify_one();
+	}
+
+	/*
+	 * Adds a block to the list of bad ones. Blocks come in order, so a block next
+	 * to the last range of the same kind just extends it.
+	 */
+	void CopyVerifier::mismatch(s64 block, bool unreadable)
+	{
+		if (!m_bad.empty() && m_bad.back().last + 1 == block && m_bad.back().unreadable == unreadable)
+		{
+			m_bad.back().last = block;
+			return;
+		}
+		m_bad.push_back({block, block, unreadable});
+	}
+
+	void CopyVerifier::run(void)
+	{
+		Block *buffer = nullptr;
+		s64 size = 0;
+
+		for (;;)
+		{
+			Pending P;
+			s64 i;
+			bool ok;
+
+			{
+				std::unique_lock<std::mutex> lock(m_lock);
+
+				m_queued.wait(lock, [this]() { return !m_queue.empty() || m_done; });
+				if (m_queue.empty())
+					break;
+				P = std::move(m_queue.front());
+				m_queue.pop_front();
+				m_taken.notify_one();
+			}
+
+			if (size < P.count)
+			{
+				delete [] buffer;
+				buffer = new Block[P.count];
+				size = P.count;
+			}
+
+			{
+				TraceSpan span("verify", "chunk", m_base + P.block);
+				ok = m_reread(buffer, P.block, P.count);
+			}
+
+			// only this thread touches the list until finish() has joined it
+			for (i = 0; i < P.count; i++)
+				if (!ok)
+					mismatch(m_base + P.block + i, true);
+				else if (crc32Update(0, buffer[i], BLOCKSIZE) != P.crcs[i])
+					mismatch(m_base + P.block + i, false);
+		}
+
+		delete [] buffer;
+	}
+
+	bool CopyVerifier::finish(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_done = true;
+			m_queued.notify_one();
+		}
+		if (m_thread.joinable())
+			m_thread.join();
+		m_finished = true;
+
+		for (Range &R : m_bad)
+			m_messenger->textError("Verify: blocks %ld to %ld %s\n", R.first, R.last,
+				R.unreadable ? "couldn't be read back" : "don't match what was written");
+		return m_bad.empty();
+	}
+}
@@ -0,0 +1,514 @@
+#include <amigadrive.h>
+#include <amigadumpfile.h>
+#include <amigaui.h>
+#include <endianness.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace std;
+using namespace amigadrive;
+
+/*
+ * ADFIO with its block interface opened up, so the driver can be timed on its own
+ */
+class BenchIO: public ADFIO
+{
+	public:
+		using ADFIO::initDriver;
+		using ADFIO::readBlock;
+		using ADFIO::readBlocks;
+};
+
+typedef enum {FILL_ZERO, FILL_RANDOM, FILL_PATTERN} FillPattern;
+
+typedef chrono::steady_clock Clock;
+
+static volatile u32 g_sink;
+
+void showUsage(ConsoleUI *C)
+{
+	C->textWarning("\n");
+	C->textWarning("Usage:\n");
+	C->textWarning("    bench [-s <MB>] [-p <partitions>] [-b <block bytes>] [-f zero|random|pattern] [-n <samples>] [-k <image>]\n");
+	C->textWarning("        generate a synthetic RDB image and run the benchmarks against it.\n");
+	C->textWarning("        -b sets the RDB and partition block size, 512 by default.\n");
+	C->textWarning("        -k keeps the image at the given path, otherwise a temporary one is used.\n");
+	C->textWarning("\n");
+	C->textWarning("    bench -g <image> [-s <MB>] [-p <partitions>] [-b <block bytes>] [-f zero|random|pattern]\n");
+	C->textWarning("        only generate the image.\n");
+	C->textWarning("\n");
+}
+
+/*
+ * Small, fast and good enough to defeat any compression or dedup below us
+ */
+static u64 xorshift(u64 &state)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static void fillBlock(Block *b, u64 blockNum, FillPattern fill, u64 &seed)
+{
+	u64 *p = (u64 *)b;
+	u32 i;
+
+	for (i = 0; i < sizeof(Block) / sizeof(u64); i++)
+		p[i] = (fill == FILL_RANDOM) ? xorshift(seed) : blockNum;
+}
+
+/*
+ * Write a sparse image with a valid rigid disk block and the given number of
+ * equally sized DOS\3 partitions. The first two cylinders hold the RDB. Unless
+ * the fill is FILL_ZERO the partitions are filled with data, otherwise only
+ * the RDB area is ever written and the file stays sparse. The RDB and the
+ * partitions use blocks of blockBytes bytes, and the geometry counts those.
+ */
+static bool makeImage(UI *C, const char *fileName, u64 bytes, int partitions, u32 blockBytes, FillPattern fill)
+{
+	const u32 heads = 16, sectors = 63, cylBlocks = heads * sectors, rdbCyls = 2;
+	const u32 cylBytes = cylBlocks * blockBytes;
+	u32 cylinders = bytes / cylBytes;
+	u32 perPart, lowCyl;
+	vector<u8> chunk(cylBytes);
+	vector<u8> block(blockBytes);
+	u64 seed = 0x9E3779B97F4A7C15ULL;
+	u8 *b = &block[0];
+	int fd, i;
+
+	if (!validBlockBytes(blockBytes))
+	{
+		C->textError("%u isn't a usable block size\n", blockBytes);
+		return false;
+	}
+
+	if (partitions < 1 || cylinders < rdbCyls + partitions)
+	{
+		C->textError("An image of %lu bytes is too small for %d partitions\n", bytes, partitions);
+		return false;
+	}
+
+	fd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, (off_t)cylinders * cylBytes) != 0)
+	{
+		C->textError("Couldn't create image [%s]\n", fileName);
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+
+	struct rigidDiskBlock *rdb = (struct rigidDiskBlock *)b;
+	memset(b, 0, blockBytes);
+	rdb->id = fe32(AMIGA_ID_RDISK);
+	rdb->summedLongs = fe32(64);
+	rdb->hostid = fe32(7);
+	rdb->blockBytes = fe32(blockBytes);
+	rdb->badBlockList = 0xFFFFFFFF;
+	rdb->partitionList = fe32(1);
+	rdb->fileSysHeaderList = 0xFFFFFFFF;
+	rdb->driveInit = 0xFFFFFFFF;
+	rdb->bootCodeBlock = 0xFFFFFFFF;
+	rdb->cylinders = fe32(cylinders);
+	rdb->sectors = fe32(sectors);
+	rdb->heads = fe32(heads);
+	rdb->rdbBlocksLo = 0;
+	rdb->rdbBlocksHi = fe32(rdbCyls * cylBlocks - 1);
+	rdb->loCylinder = fe32(rdbCyls);
+	rdb->hiCylinder = fe32(cylinders - 1);
+	rdb->cylBlocks = fe32(cylBlocks);
+	memcpy(rdb->diskVendor, "AMIGADRV", 8);
+	memcpy(rdb->diskProduct, "BENCH IMAGE     ", 16);
+	setChecksum((struct blockHeader *)b);
+	if (pwrite(fd, b, blockBytes, 0) != (ssize_t)blockBytes)
+	{
+		C->textError("Short write of the RDSK block to [%s]\n", fileName);
+		close(fd);
+		return false;
+	}
+
+	perPart = (cylinders - rdbCyls) / partitions;
+	for (i = 0, lowCyl = rdbCyls; i < partitions; i++, lowCyl += perPart)
+	{
+		struct partitionBlock *p = (struct partitionBlock *)b;
+		struct amigaPartGeometry *g = (struct amigaPartGeometry *)&(p->environment);
+		u32 highCyl = (i == partitions - 1) ? cylinders - 1 : lowCyl + perPart - 1;
+		char name[16];
+		u32 c;
+
+		memset(b, 0, blockBytes);
+		p->id = fe32(AMIGA_ID_PART);
+		p->summedLongs = fe32(64);
+		p->hostid = fe32(7);
+		p->next = (i == partitions - 1) ? 0xFFFFFFFF : fe32(i + 2);
+		snprintf(name, sizeof(name), "DH%d", i);
+		p->driveName[0] = strlen(name);
+		memcpy(&p->driveName[1], name, strlen(name));
+		g->tableSize = fe32(16);
+		g->sizeBlocks = fe32(blockBytes / 4);
+		g->surfaces = fe32(heads);
+		g->sectorPerBlock = fe32(1);
+		g->blockPerTrack = fe32(sectors);
+		g->reserved = fe32(2);
+		g->lowCyl = fe32(lowCyl);
+		g->highCyl = fe32(highCyl);
+		g->numBuffers = fe32(30);
+		g->maxTransfer = fe32(0x00FFFFFF);
+		g->mask = fe32(0x7FFFFFFE);
+		g->dosType = fe32(0x444F5303);
+		setChecksum((struct blockHeader *)b);
+		if (pwrite(fd, b, blockBytes, (off_t)(i + 1) * blockBytes) != (ssize_t)blockBytes)
+		{
+			C->textError("Short write of a PART block to [%s]\n", fileName);
+			close(fd);
+			return false;
+		}
+
+		if (fill == FILL_ZERO)
+			continue;
+
+		for (c = lowCyl; c <= highCyl; c++)
+		{
+			u64 first = (u64)c * cylBytes / BLOCKSIZE;
+			u32 k;
+
+			for (k = 0; k < cylBytes / BLOCKSIZE; k++)
+				fillBlock((Block *)&chunk[k * BLOCKSIZE], first + k, fill, seed);
+			if (pwrite(fd, &chunk[0], chunk.size(), (off_t)first * BLOCKSIZE) != (ssize_t)chunk.size())
+			{
+				C->textError("Short write filling [%s]\n", fileName);
+				close(fd);
+				return false;
+			}
+		}
+	}
+
+	close(fd);
+	return true;
+}
+
+/*
+ * Print one line of results. Each sample is the mean time of one operation
+ * within a timed batch, so the percentiles are over batches, not single calls.
+ */
+static void report(const char *name, vector<double> &nsPerOp, double bytesPerOp)
+{
+	double mean = 0;
+	size_t n = nsPerOp.size();
+
+	if (!n)
+		return;
+
+	sort(nsPerOp.begin(), nsPerOp.end());
+	for (double v : nsPerOp)
+		mean += v;
+	mean /= n;
+
+	printf("%-26s %12.1f %12.1f %12.1f %12.1f %14.0f %10.1f\n", name,
+		nsPerOp[n / 2], nsPerOp[(n * 90) / 100], nsPerOp[(n * 99) / 100], nsPerOp[n - 1],
+		1e9 / mean, bytesPerOp ? bytesPerOp * 1e3 / mean : 0.0);
+}
+
+static double nsSince(Clock::time_point t0, u64 ops)
+{
+	return chrono::duration<double, nano>(Clock::now() - t0).count() / ops;
+}
+
+static void benchSumBlock(int samples)
+{
+	const u32 count = 1024;
+	vector<Block> blocks(count);
+	vector<double> ns;
+	u64 seed = 1;
+	u32 i;
+
+	for (i = 0; i < count; i++)
+	{
+		struct blockHeader *h = (struct blockHeader *)blocks[i];
+
+		fillBlock(&blocks[i], i, FILL_RANDOM, seed);
+		h->id = fe32(AMIGA_ID_PART);
+		h->summedLongs = fe32(BLOCKSIZE / 4);
+		setChecksum(h);
+	}
+
+	while (samples--)
+	{
+		Clock::time_point t0 = Clock::now();
+		u32 bad = 0;
+
+		for (i = 0; i < count; i++)
+			bad += sumBlock((struct blockHeader *)blocks[i]);
+		ns.push_back(nsSince(t0, count));
+		g_sink = bad;
+	}
+	report("sumBlock", ns, BLOCKSIZE);
+}
+
+/*
+ * The whole-block checksum and zero-detect kernels for each block size. The
+ * sizes without a specialisation of their own go through the generic kernels.
+ */
+static void benchKernels(int samples)
+{
+	const u32 sizes[] = {512, 1024, 2048, 4096, 8192};
+	const u32 total = 1 << 20;
+	vector<u8> data(total);
+	u64 seed = 3;
+	u32 i, k;
+
+	for (i = 0; i < total; i += sizeof(Block))
+		fillBlock((Block *)&data[i], i, FILL_RANDOM, seed);
+
+	for (k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++)
+	{
+		const BlockKernels *K = blockKernels(sizes[k]);
+		u32 count = total / sizes[k];
+		vector<double> sum, zero;
+		char name[32];
+		int s;
+
+		for (s = 0; s < samples; s++)
+		{
+			Clock::time_point t0 = Clock::now();
+			u32 acc = 0;
+
+			for (i = 0; i < count; i++)
+				acc += K->sum(&data[i * sizes[k]], sizes[k]);
+			sum.push_back(nsSince(t0, count));
+
+			t0 = Clock::now();
+			for (i = 0; i < count; i++)
+				acc += K->isZero(&data[i * sizes[k]], sizes[k]);
+			zero.push_back(nsSince(t0, count));
+			g_sink = acc;
+		}
+
+		snprintf(name, sizeof(name), "sum kernel %u", sizes[k]);
+		report(name, sum, sizes[k]);
+		snprintf(name, sizeof(name), "zero kernel %u", sizes[k]);
+		report(name, zero, sizes[k]);
+	}
+}
+
+static void benchFe32(int samples)
+{
+	const u32 count = 65536;
+	vector<u32> longs(count);
+	vector<double> ns;
+	u32 i;
+
+	for (i = 0; i < count; i++)
+		longs[i] = i * 2654435761U;
+
+	while (samples--)
+	{
+		Clock::time_point t0 = Clock::now();
+		u32 sum = 0;
+
+		for (i = 0; i < count; i++)
+			sum += fe32(longs[i]);
+		ns.push_back(nsSince(t0, count));
+		g_sink = sum;
+	}
+	report("fe32", ns, sizeof(u32));
+}
+
+static void benchReadBlock(UI *C, const char *image, u64 blocks, int samples)
+{
+	const u32 batch = 256, range = 128;
+	vector<double> seq, rnd, rng;
+	vector<Block> buffer(range);
+	u64 seed = 7, next = 0;
+	BenchIO io;
+	int s;
+	u32 i;
+
+	io.initDriver(C, image, true);
+
+	for (s = 0; s < samples; s++)
+	{
+		Clock::time_point t0 = Clock::now();
+
+		for (i = 0; i < batch; i++, next = (next + 1) % blocks)
+			io.readBlock(&buffer[0], next);
+		seq.push_back(nsSince(t0, batch));
+
+		t0 = Clock::now();
+		for (i = 0; i < batch; i++)
+			io.readBlock(&buffer[0], xorshift(seed) % blocks);
+		rnd.push_back(nsSince(t0, batch));
+
+		t0 = Clock::now();
+		for (i = 0; i < batch / 16; i++)
+			io.readBlocks(&buffer[0], xorshift(seed) % (blocks - range), range);
+		rng.push_back(nsSince(t0, batch / 16));
+	}
+	report("ADFIO::readBlock seq", seq, BLOCKSIZE);
+	report("ADFIO::readBlock random", rnd, BLOCKSIZE);
+	report("ADFIO::readBlocks x128", rng, BLOCKSIZE * range);
+}
+
+static void benchDevice(UI *C, const char *image, int samples)
+{
+	vector<double> open, lookup;
+	u64 seed = 11;
+	int s, i, n;
+
+	for (s = 0; s < samples; s++)
+	{
+		Clock::time_point t0 = Clock::now();
+		ADFIO *A = new ADFIO();
+		Device *D = new Device(A, C, image, true);
+
+		open.push_back(nsSince(t0, 1));
+
+		n = D->volumeCount();
+		t0 = Clock::now();
+		for (i = 0; i < 1024; i++)
+			g_sink = D->volumeNumber(1 + xorshift(seed) % n)->volStartBlock();
+		lookup.push_back(nsSince(t0, 1024));
+
+		delete D;
+		delete A;
+	}
+	report("Device open", open, 0);
+	report("Device::volumeNumber", lookup, 0);
+}
+
+static void benchCopies(UI *C, const char *image, int samples)
+{
+	vector<double> out, in, part;
+	char outFile[256];
+	ADFIO *A = new ADFIO();
+	Device *D = new Device(A, C, image, false);
+	s64 partBlocks = D->volumeNumber(1)->volBlockCount();
+	s64 count = partBlocks;
+	int s;
+
+	snprintf(outFile, sizeof(outFile), "%s.copy", image);
+
+	for (s = 0; s < samples; s++)
+	{
+		Clock::time_point t0 = Clock::now();
+
+		D->blockCopyOut(outFile, 0, count);
+		out.push_back(nsSince(t0, 1));
+
+		t0 = Clock::now();
+		D->blockCopyIn(outFile, 0, count);
+		in.push_back(nsSince(t0, 1));
+
+		t0 = Clock::now();
+		D->partCopyOut(outFile, 1);
+		part.push_back(nsSince(t0, 1));
+	}
+	unlink(outFile);
+
+	report("Device::blockCopyOut", out, count * BLOCKSIZE);
+	report("Device::blockCopyIn", in, count * BLOCKSIZE);
+	report("Device::partCopyOut", part, partBlocks * BLOCKSIZE);
+
+	delete D;
+	delete A;
+}
+
+int main(int argc, char **argv)
+{
+	const char *image = nullptr;
+	const char *generate = nullptr;
+	char tempImage[64];
+	FillPattern fill = FILL_PATTERN;
+	u64 megabytes = 64;
+	u32 blockBytes = BLOCKSIZE;
+	int partitions = 4;
+	int samples = 100;
+	ConsoleUI C;
+	SilentUI S;	// the copy paths draw progress bars - keep them out of the table
+	struct stat st;
+	int c;
+
+	opterr = 0;
+
+	while ((c = getopt (argc, argv, "s:p:b:f:n:k:g:h")) != -1)
+		switch (c)
+		{
+			case 's':
+				megabytes = strtoull(optarg, nullptr, 10);
+				break;
+			case 'p':
+				partitions = strtol(optarg, nullptr, 10);
+				break;
+			case 'b':
+				blockBytes = strtoul(optarg, nullptr, 10);
+				break;
+			case 'f':
+				if (!strcmp(optarg, "zero"))
+					fill = FILL_ZERO;
+				else if (!strcmp(optarg, "random"))
+					fill = FILL_RANDOM;
+				else if (!strcmp(optarg, "pattern"))
+					fill = FILL_PATTERN;
+				else
+				{
+					showUsage(&C);
+					return 1;
+				}
+				break;
+			case 'n':
+				samples = strtol(optarg, nullptr, 10);
+				break;
+			case 'k':
+				image = optarg;
+				break;
+			case 'g':
+				generate = optarg;
+				break;
+			default:
+				showUsage(&C);
+				return 1;
+		}
+
+	if (samples < 1)
+		samples = 1;
+
+	if (generate)
+		return makeImage(&C, generate, megabytes << 20, partitions, blockBytes, fill) ? 0 : 1;
+
+	if (!image)
+	{
+		snprintf(tempImage, sizeof(tempImage), "/tmp/amigabench-%d.hdf", (int)getpid());
+		image = tempImage;
+	}
+
+	C.textInfo("Generating %luMB image [%s] with %d partitions...\n", megabytes, image, partitions);
+	if (!makeImage(&C, image, megabytes << 20, partitions, blockBytes, fill) || stat(image, &st) != 0)
+		return 1;
+
+	printf("\n%-26s %12s %12s %12s %12s %14s %10s\n", "benchmark", "p50 ns", "p90 ns", "p99 ns", "max ns", "ops/s", "MB/s");
+
+	try
+	{
+		benchSumBlock(samples);
+		benchKernels(samples);
+		benchFe32(samples);
+		benchReadBlock(&S, image, st.st_size / BLOCKSIZE, samples);
+		benchDevice(&S, image, samples);
+		benchCopies(&S, image, samples < 5 ? samples : 5);
+	}
+	catch (Exception E)
+	{
+		E.textMsg();
+	}
+
+	if (image == tempImage)
+		unlink(image);
+
+	return 0;
+}
@@ -1,8 +1,19 @@
 #include <amigadrive.h>
 #include <amigadumpfile.h>
+#include <amigastream.h>
 #include <amigaui.h>
+#include <amigascan.h>
+#include <amigagrep.h>
+#include <amigaundelete.h>
+#include <amigarecover.h>
+#include <amigafs.h>
+#include <amigabsd.h>
+#include <amigatrace.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
 
 using namespace std;
 using namespace amigadrive;
@@ -12,13 +23,14 @@ void showUsage(ConsoleUI *C)
 	C->textWarning("\n");
 	C->textWarning("Usage:\n");
 	C->textWarning("    amigatool -f <dump file>\n");
-	C->textWarning("        run amigatool for the given dump file\n");
+	C->textWarning("        run amigatool for the given dump file. - reads it from stdin, which\n");
+	C->textWarning("        needn't seek: it's read once, forwards, and can only be copied out.\n");
 	C->textWarning("\n");
 	C->textWarning("    amigatool -d\n");
 	C->textWarning("        describe the given dump file (-o)\n");
 	C->textWarning("\n");
 	C->textWarning("    amigatool -o <output file>\n");
-	C->textWarning("        copy dump file to output file\n");
+	C->textWarning("        copy dump file to output file. - writes to stdout, and messages go to stderr.\n");
 	C->textWarning("\n");
 	C->textWarning("    amigatool -i <input file>\n");
 	C->textWarning("        copy input file to dump file\n");
@@ -26,46 +38,561 @@ void showUsage(ConsoleUI *C)
 	C->textWarning("    amigatool -p <partition>\n");
 	C->textWarning("        copy dump file partition number (use -d to view)\n");
 	C->textWarning("\n");
+	C->textWarning("    amigatool --extract-part <partition>\n");
+	C->textWarning("        copy a partition to stdout - the same as -p <partition> -o -. With -f -\n");
+	C->textWarning("        this streams, e.g. zstdcat hd.hdf.zst | amigatool -f - --extract-part 2 | ...\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool -p <partition> --slice <letter>\n");
+	C->textWarning("        copy one slice of a NetBSD partition, or of a BSD disklabel inside a\n");
+	C->textWarning("        partition, instead of all of it (use -d to view).\n");
+	C->textWarning("\n");
 	C->textWarning("    amigatool -b <start block>\n");
 	C->textWarning("        copy dump file starting with this block\n");
 	C->textWarning("\n");
 	C->textWarning("    amigatool -s <count>\n");
 	C->textWarning("        copy dump file for <size> blocks\n");
 	C->textWarning("\n");
+	C->textWarning("    amigatool --journal <journal file>\n");
+	C->textWarning("        record the progress of a -o, -i or -p copy in the journal file. If the copy\n");
+	C->textWarning("        is interrupted, the same command resumes it from the last chunk which checks out.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --verify\n");
+	C->textWarning("        read back everything a -o, -i or -p copy writes, and report blocks which differ.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --trace <trace file>\n");
+	C->textWarning("        write a Chrome/Perfetto trace of the run. AMIGATOOL_TRACE=<trace file>\n");
+	C->textWarning("        in the environment does the same, and also works for scan.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --direct\n");
+	C->textWarning("        open the dump file with O_DIRECT, keeping bulk copies out of the page cache.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --export-all <directory>\n");
+	C->textWarning("        copy every partition to a file of its own in the directory, reading the\n");
+	C->textWarning("        dump file once, in order.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --extract-fs <directory>\n");
+	C->textWarning("        write the file system drivers stored in the RDB to files in the directory,\n");
+	C->textWarning("        named after their dos type and version.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --ls <path>\n");
+	C->textWarning("        list a directory of the file system on partition -p, 1 by default.\n");
+	C->textWarning("        OFS, FFS and their variants, SFS and PFS3 can be read.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --cat <path>\n");
+	C->textWarning("        copy a file out of the file system on partition -p to -o, or to stdout.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --lost\n");
+	C->textWarning("        sweep the OFS or FFS file system on partition -p, 1 by default, for files\n");
+	C->textWarning("        which can't be reached from its root - deleted ones - and list them.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --undelete <directory>\n");
+	C->textWarning("        list the lost files as --lost does, and copy them into the directory.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --recover [--layout <n>]\n");
+	C->textWarning("        sweep the dump file for what's left of its partition table - RDSK and PART\n");
+	C->textWarning("        blocks, and the file systems they held - and list the layouts it could be,\n");
+	C->textWarning("        best first. Layout n, 1 by default, is then used read-only in place of the\n");
+	C->textWarning("        RDB by the other options, e.g. --recover -d, or --recover -p 2 -o part.hdf.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --recover --write-rdb [--layout <n>]\n");
+	C->textWarning("        write the layout to the dump file as a new RDB.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool --stats\n");
+	C->textWarning("        print I/O statistics and latency histograms on exit.\n");
+	C->textWarning("\n");
 	C->textWarning("    amigatool -h <dump file>\n");
 	C->textWarning("        output this text and exit.\n");
 	C->textWarning("\n");
+	C->textWarning("    amigatool scan [-j <threads>] [-l <list file>] [-o <output file>] <dir|dump file> ...\n");
+	C->textWarning("        probe many dump files in parallel, writing one JSON record per file.\n");
+	C->textWarning("        directories are searched recursively, -l reads paths from a file (- for stdin).\n");
+	C->textWarning("        ADF diskette images also get their boot block classified and are hashed.\n");
+	C->textWarning("\n");
+	C->textWarning("    amigatool grep [-j <threads>] [-p <partition>] [-e <text>]... [-x <hex>]... [-o <output file>] <dump file> ...\n");
+	C->textWarning("        search dump files, or one partition of them, for any number of strings and\n");
+	C->textWarning("        hex byte patterns at once. Each match is given with its block and offset,\n");
+	C->textWarning("        and the partition and file it lies in where the file system can be read.\n");
+	C->textWarning("\n");
+}
+
+int scanMain(int argc, char **argv, ConsoleUI *C)
+{
+	const char *output = nullptr;
+	const char *list = nullptr;
+	unsigned workers = 0;
+	FILE *out = stdout;
+	u64 failed;
+	int c;
+
+	optind = 1;
+	while ((c = getopt (argc, argv, "j:l:o:h")) != -1)
+		switch (c)
+		{
+			case 'j':
+				workers = strtol(optarg, nullptr, 10);
+				break;
+			case 'l':
+				list = optarg;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			default:
+				showUsage(C);
+				return 1;
+		}
+
+	Scanner S(C, workers);
+
+	if (list && !S.addList(list))
+		return 1;
+
+	for (; optind < argc; optind++)
+	{
+		struct stat s;
+
+		if (stat(argv[optind], &s) == 0 && S_ISDIR(s.st_mode))
+			S.addDirectory(argv[optind]);
+		else
+			S.addImage(argv[optind]);
+	}
+
+	if (S.imageCount() == 0)
+	{
+		showUsage(C);
+		return 1;
+	}
+
+	if (output)
+	{
+		out = fopen(output, "w");
+		if (!out)
+		{
+			C->textError("Couldn't open [%s] for writing\n", output);
+			return 1;
+		}
+	}
+
+	failed = S.run(out);
+
+	if (out != stdout)
+		fclose(out);
+
+	C->textWarning("Scanned %lu images, %lu could not be probed.\n", S.imageCount(), failed);
+	return failed ? 2 : 0;
+}
+
+int grepMain(int argc, char **argv, ConsoleUI *C)
+{
+	const char *output = nullptr;
+	unsigned workers = 0;
+	int partition = 0;
+	PatternSet P;
+	FILE *out = stdout;
+	s64 matches = 0;
+	bool failed = false;
+	int c;
+
+	optind = 1;
+	while ((c = getopt (argc, argv, "j:p:e:x:o:h")) != -1)
+		switch (c)
+		{
+			case 'j':
+				workers = strtol(optarg, nullptr, 10);
+				break;
+			case 'p':
+				partition = strtol(optarg, nullptr, 10);
+				break;
+			case 'e':
+				if (!P.addLiteral(optarg))
+				{
+					C->textError("Can't search for [%s]\n", optarg);
+					return 2;
+				}
+				break;
+			case 'x':
+				if (!P.addHex(optarg))
+				{
+					C->textError("[%s] isn't a hex byte pattern\n", optarg);
+					return 2;
+				}
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			default:
+				showUsage(C);
+				return 2;
+		}
+
+	if (P.patternCount() == 0 || optind >= argc)
+	{
+		showUsage(C);
+		return 2;
+	}
+
+	if (output)
+	{
+		out = fopen(output, "w");
+		if (!out)
+		{
+			C->textError("Couldn't open [%s] for writing\n", output);
+			return 2;
+		}
+	}
+
+	Grep G(C, &P, workers);
+
+	for (; optind < argc; optind++)
+	{
+		s64 found = G.run(argv[optind], partition, out);
+
+		if (found < 0)
+			failed = true;
+		else
+			matches += found;
+	}
+
+	if (out != stdout)
+		fclose(out);
+
+	if (failed)
+		return 2;
+	return matches ? 0 : 1;
+}
+
+static void finishTrace(void)
+{
+	Tracer::finish();
+}
+
+/*
+ * Start tracing to the named file - the trace is written when amigatool exits.
+ * Returns non-zero on failure.
+ */
+int startTrace(ConsoleUI *C, const char *traceFile)
+{
+	if (!Tracer::start(traceFile))
+	{
+		C->textError("Couldn't create trace file [%s]\n", traceFile);
+		return 1;
+	}
+	atexit(finishTrace);
+	return 0;
+}
+
+/*
+ * Format the date of an entry - AmigaDOS counts days from the start of 1978.
+ */
+static void amigaDate(char *date, size_t size, const FileInfo &info)
+{
+	time_t t = 252460800 + (time_t)info.days * 86400 + info.mins * 60 + info.ticks / 50;
+	struct tm tm;
+
+	gmtime_r(&t, &tm);
+	strftime(date, size, "%Y-%m-%d %H:%M", &tm);
+}
+
+/*
+ * List a directory of a partition's file system, a line per entry, with its
+ * size and date. Returns non-zero on failure.
+ */
+int listPath(ConsoleUI *C, Device *D, int partition, const char *path)
+{
+	FileSystem *F = FileSystem::mount(D->volumeNumber(partition), C);
+	std::vector<FileInfo> entries;
+	int rc = 0;
+
+	if (!F)
+		return 1;
+
+	if (F->readDir(path, entries))
+	{
+		for (FileInfo &e : entries)
+		{
+			char date[32];
+
+			amigaDate(date, sizeof(date), e);
+			C->textInfo("%10lu %s %s%s\n", e.size, date, e.name.c_str(),
+				(e.type == FT_DIR) ? "/" : (e.type == FT_SOFTLINK) ? "@" : "");
+		}
+	}
+	else
+	{
+		C->textError("Can't list [%s] on partition %d\n", path, partition);
+		rc = 1;
+	}
+
+	delete F;
+	return rc;
+}
+
+/*
+ * Copy a file out of a partition's file system. Returns non-zero on failure.
+ */
+int catPath(ConsoleUI *C, Device *D, int partition, const char *path, const char *output)
+{
+	FileSystem *F = FileSystem::mount(D->volumeNumber(partition), C);
+	bool toStdout = !output || !strcmp(output, "-");
+	File *I = nullptr;
+	FILE *out = nullptr;
+	u8 *buffer = nullptr;
+	int rc = 1;
+	s64 n;
+
+	if (!F)
+		return 1;
+
+	I = F->open(path);
+	if (!I)
+		C->textError("Can't open [%s] on partition %d\n", path, partition);
+	else if (!(out = toStdout ? stdout : fopen(output, "wb")))
+		C->textError("Couldn't open [%s] for writing\n", output);
+	else
+	{
+		buffer = new u8[1024 * 1024];
+		while ((n = I->read(buffer, 1024 * 1024)) > 0)
+			if (fwrite(buffer, 1, n, out) != (size_t)n)
+			{
+				n = -1;
+				break;
+			}
+		if (n == 0)
+			rc = 0;
+		else
+			C->textError("Copying [%s] failed\n", path);
+		delete [] buffer;
+	}
+
+	if (out && !toStdout && fclose(out) != 0)
+		rc = 1;
+	if (I)
+		delete I;
+	delete F;
+	return rc;
+}
+
+/*
+ * List the lost files of a partition's file system, a line per file with its
+ * header block, size, date, how much of it is left and where it was, and copy
+ * them into a directory if one is given. A file is partial if its block list
+ * couldn't all be found, and reused if live files have taken some of its
+ * blocks. Returns non-zero on failure.
+ */
+int undeletePath(ConsoleUI *C, Device *D, int partition, const char *dir)
+{
+	Undelete U(D->volumeNumber(partition), C);
+
+	if (!U.scan())
+		return 1;
+
+	for (const LostFile &f : U.files())
+	{
+		char date[32];
+
+		amigaDate(date, sizeof(date), f.info);
+		C->textInfo("%10lu %10lu %s %-7s %s", f.info.key, f.info.size, date,
+			!f.complete ? "partial" : f.reused ? "reused" : "whole", f.path.c_str());
+		if (f.reused)
+			C->textInfo(" (%lu blocks in use by other files)", f.reused);
+		C->textInfo("\n");
+	}
+	C->textInfo("%lu lost files on partition %d\n", U.files().size(), partition);
+
+	if (dir && !U.recoverAll(dir))
+		return 1;
+	return 0;
+}
+
+/*
+ * Sweep the device for its partition table, list the layouts found, and use the
+ * one picked, numbered from 1, in place of the RDB - or write it to the device
+ * as a new one. Returns non-zero on failure.
+ */
+int recoverLayout(ConsoleUI *C, Device *D, int layout, bool write)
+{
+	PartitionRecovery R(D, C);
+	size_t i, j;
+
+	if (!R.sweep())
+	{
+		C->textError("Neither partition blocks nor file systems were found\n");
+		return 1;
+	}
+
+	for (i = 0; i < R.layouts().size(); i++)
+	{
+		const RecoveredLayout &L = R.layouts()[i];
+
+		C->textInfo("Layout %lu, score %d, from ", i + 1, L.score);
+		if (L.source == RecoveredLayout::FROM_RDSK)
+			C->textInfo("the RDSK block at block %lu", L.block);
+		else if (L.source == RecoveredLayout::FROM_PARTS)
+			C->textInfo("PART blocks no RDSK block lists");
+		else
+			C->textInfo("the file systems found");
+		if (L.offset)
+			C->textInfo(", with the RDB's block 0 at block %ld", L.offset);
+		C->textInfo("\n");
+
+		for (j = 0; j < L.partitions.size(); j++)
+		{
+			const RecoveredPartition &P = L.partitions[j];
+			const struct amigaPartGeometry *g = (const struct amigaPartGeometry *)&P.part.environment;
+			char type[6];
+
+			dosTypeString(type, be32(&g->dosType));
+			C->textInfo("\t%lu. %.*s start [%lu], count [%lu], type [%s]%s\n", j + 1, (int)(u8)P.part.driveName[0] < 31 ? (u8)P.part.driveName[0] : 31,
+				&P.part.driveName[1], P.start, P.count, type, P.found ? ", file system found" : "");
+		}
+	}
+
+	if (layout < 1 || (size_t)layout > R.layouts().size())
+	{
+		C->textError("There's no layout %d\n", layout);
+		return 1;
+	}
+
+	const RecoveredLayout &L = R.layouts()[layout - 1];
+
+	if (write)
+		return R.write(L) ? 0 : 1;
+
+	std::vector<struct partitionBlock> parts;
+
+	for (const RecoveredPartition &P : L.partitions)
+		parts.push_back(P.part);
+	D->usePartitions(parts);
+	C->textInfo("Using layout %d\n", layout);
+	return 0;
 }
 
 bool ifDescribe = false;
+bool ifStats = false;
+bool ifDirect = false;
+bool ifVerify = false;
+
+static struct option longOptions[] =
+{
+	{"stats", no_argument, nullptr, 'S'},
+	{"trace", required_argument, nullptr, 'T'},
+	{"direct", no_argument, nullptr, 'D'},
+	{"export-all", required_argument, nullptr, 'X'},
+	{"extract-part", required_argument, nullptr, 'E'},
+	{"extract-fs", required_argument, nullptr, 'F'},
+	{"journal", required_argument, nullptr, 'J'},
+	{"verify", no_argument, nullptr, 'V'},
+	{"ls", required_argument, nullptr, 'L'},
+	{"cat", required_argument, nullptr, 'C'},
+	{"slice", required_argument, nullptr, 'B'},
+	{"lost", no_argument, nullptr, 'N'},
+	{"undelete", required_argument, nullptr, 'U'},
+	{"recover", no_argument, nullptr, 'R'},
+	{"layout", required_argument, nullptr, 'Y'},
+	{"write-rdb", no_argument, nullptr, 'W'},
+	{nullptr, 0, nullptr, 0}
+};
 
 int main(int argc, char **argv)
 {
 	char *devname = nullptr;
 	char *output = nullptr;
 	char *input = nullptr;
+	char *exportDir = nullptr;
+	char *journal = nullptr;
+	char *fsDir = nullptr;
+	char *listDir = nullptr;
+	char *catFile = nullptr;
+	char *undeleteDir = nullptr;
+	bool ifLost = false;
+	bool ifRecover = false;
+	bool ifWriteRdb = false;
+	int layout = 1;
+	char slice = 0;
     stringStore S;
 	ConsoleUI C;	// All error, warning and info messages via console
 	Device *D;		// Device
-	ADFIO *A;		// Dump file IO driver
-	long begin=-1;
-	long size=-1;
+	DeviceIO *A;	// Dump file IO driver
+	s64 begin=-1;
+	s64 size=-1;
 	int partition=-1;
+	int status = 0;
 	int c;
 
 	opterr = 0;
 
-	while ((c = getopt (argc, argv, "p:b:s:di:o:f:h")) != -1)
+	if (getenv("AMIGATOOL_TRACE") && startTrace(&C, getenv("AMIGATOOL_TRACE")))
+		return 1;
+
+	if (argc > 1 && !strcmp(argv[1], "scan"))
+		return scanMain(argc - 1, argv + 1, &C);
+
+	if (argc > 1 && !strcmp(argv[1], "grep"))
+		return grepMain(argc - 1, argv + 1, &C);
+
+	while ((c = getopt_long (argc, argv, "p:b:s:di:o:f:h", longOptions, nullptr)) != -1)
 		switch (c)
 		{
+			case 'S':
+				ifStats = true;
+				break;
+			case 'D':
+				ifDirect = true;
+				break;
+			case 'X':
+				exportDir = S.copyString(optarg, strlen(optarg)+1);
+				break;
+			case 'V':
+				ifVerify = true;
+				break;
+			case 'F':
+				fsDir = S.copyString(optarg, strlen(optarg)+1);
+				break;
+			case 'L':
+				listDir = S.copyString(optarg, strlen(optarg)+1);
+				break;
+			case 'C':
+				catFile = S.copyString(optarg, strlen(optarg)+1);
+				break;
+			case 'B':
+				slice = optarg[0];
+				break;
+			case 'N':
+				ifLost = true;
+				break;
+			case 'U':
+				undeleteDir = S.copyString(optarg, strlen(optarg)+1);
+				break;
+			case 'R':
+				ifRecover = true;
+				break;
+			case 'Y':
+				ifRecover = true;
+				layout = strtol(optarg, nullptr, 10);
+				break;
+			case 'W':
+				ifRecover = true;
+				ifWriteRdb = true;
+				break;
+			case 'J':
+				journal = S.copyString(optarg, strlen(optarg)+1);
+				break;
+			case 'E':
+				partition = strtol(optarg, nullptr, 10);
+				output = (char *)"-";
+				break;
+			case 'T':
+				if (startTrace(&C, optarg))
+					return 1;
+				break;
 			case 'p':
 				partition = strtol(optarg, nullptr, 10);
 				break;
 			case 'b':
-				begin = strtol(optarg, nullptr, 10);
+				begin = strtoll(optarg, nullptr, 10);
 				break;
 			case 's':
-				size = strtol(optarg, nullptr, 10);
+				size = strtoll(optarg, nullptr, 10);
 				break;
 			case 'd':
 				ifDescribe = true;
@@ -95,14 +622,53 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	// with data on stdout, everything else goes to stderr
+	if ((output && !strcmp(output, "-")) || (catFile && !output))
+		C.setInfoStream(stderr);
+
 	try
 	{
-		A = new ADFIO();
-		D = new Device(A, &C, devname, (output));
+		// a stream can only be read, so it's opened read-only unless it's to be written
+		if (!strcmp(devname, "-"))
+		{
+			A = new StreamIO(0);
+			D = new Device(A, &C, devname, (output) || !input);
+		}
+		else
+		{
+			A = new ADFIO(ifDirect);
+			D = new Device(A, &C, devname, (output) || exportDir || fsDir || listDir || catFile || ifLost || undeleteDir || (ifRecover && !ifWriteRdb));
+		}
+
+		if (ifRecover)
+		{
+			int rc;
+
+			if (!strcmp(devname, "-"))
+			{
+				C.textError("A stream can't be swept for its partition table\n");
+				return 1;
+			}
+			rc = recoverLayout(&C, D, layout, ifWriteRdb);
+			if (rc || ifWriteRdb)
+			{
+				delete D;
+				delete A;
+				return rc;
+			}
+		}
+
+		if (ifStats)
+			D->enableStats();
+		if (journal)
+			D->setJournal(journal);
+		D->setVerify(ifVerify);
 
 		if (ifDescribe && D)
         {
 			D->About();
+			if (ifStats)
+				D->dumpStats();
             return 0;
         }
 
@@ -118,38 +684,111 @@ int main(int argc, char **argv)
 			return 1;
 		}
 
-		if (partition > D->volumeCount() || partition < 1)
+		if (partition > -1 && (partition > D->volumeCount() || partition < 1))
 		{
 			C.textInfo("Check the partition numbers using the -d option.\n");
 			showUsage(&C);
 			return 1;
 		}
-		else
+		else if (partition > -1)
         {
             Volume *V = D->volumeNumber(partition);
 
             begin = V->volStartBlock();
             size = V->volBlockCount();
+
+			if (slice)
+			{
+				DiskLabel L(V, &C);
+				const BSDSlice *B;
+
+				if (!strcmp(devname, "-"))
+				{
+					C.textError("A stream can't be searched for slices\n");
+					return 1;
+				}
+				if (!L.read() || !(B = L.slice(slice)))
+				{
+					C.textError("Partition %d has no slice %c\n", partition, slice);
+					return 1;
+				}
+				begin += B->start;
+				size = B->count;
+			}
         }
+		else if (slice)
+		{
+			C.textInfo("A slice is picked out of a partition, so --slice needs -p.\n");
+			showUsage(&C);
+			return 1;
+		}
 
         // C.textInfo("devname [%s], output [%s]\n", devname, output);
 
-		if (devname && output && begin >-1 && size > -1)
+		if (listDir || catFile || ifLost || undeleteDir)
+		{
+			int rc;
+
+			if (partition < 0)
+				partition = 1;
+			if (ifLost || undeleteDir)
+				rc = undeletePath(&C, D, partition, undeleteDir);
+			else
+				rc = listDir ? listPath(&C, D, partition, listDir) : catPath(&C, D, partition, catFile, output);
+			if (ifStats)
+				D->dumpStats();
+			delete D;
+			delete A;
+			return rc;
+		}
+		else if (fsDir)
+		{
+			if (!D->extractFileSystems(fsDir))
+			{
+				C.textError("\n\nFile system extraction failed.\n\n");
+				status = 1;
+			}
+		}
+		else if (exportDir)
+		{
+			C.textInfo("Export every partition of [%s] to [%s]\n\n", devname, exportDir);
+			if (D->exportAllPartitions(exportDir))
+				C.textInfo("\n\nExport complete.\n\n");
+			else
+			{
+				C.textError("\n\nExport failed.\n\n");
+				status = 1;
+			}
+		}
+		else if (devname && output && begin >-1 && size > -1)
 		{
 			C.textInfo("Copy dump file section [%s] to output [%s] from block %ld for %ld blocks\n\n", devname, output, begin, size);
-			D->blockCopyOut(output, begin, size);
-			C.textInfo("\n\nCopy complete.\n\n");
+			if (D->blockCopyOut(output, begin, size))
+				C.textInfo("\n\nCopy complete.\n\n");
+			else
+			{
+				C.textError("\n\nCopy failed.\n\n");
+				status = 1;
+			}
 		}
 		else
         {
             if (devname && input && begin >-1 && size > -1)
             {
                 C.textInfo("Copy input file [%s] to dump file section [%s] from block %ld for %ld blocks\n\n", input, devname, begin, size);
-                D->blockCopyIn(input, begin, size);
-                C.textInfo("\n\nCopy complete.\n\n");
+                if (D->blockCopyIn(input, begin, size))
+                    C.textInfo("\n\nCopy complete.\n\n");
+                else
+                {
+                    C.textError("\n\nCopy failed.\n\n");
+                    status = 1;
+                }
             }
         }
 
+		if (ifStats)
+			D->dumpStats();
+
 		C.textInfo("The end...\n");
 		delete D;
 		delete A;
@@ -157,7 +796,8 @@ int main(int argc, char **argv)
 	catch (Exception E)
 	{
 		E.textMsg();
+		status = 1;
 	}
 
-	return 0;
+	return status;
 }